@@ -0,0 +1,632 @@
+/*
+ * oceand.c
+ *
+ * Owns a spectrometer, acquires continuously and serves control commands
+ * and frames to clients of a Unix domain socket. See oceand.h for the
+ * protocol.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <libocean.h>
+#include <oceand.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof (x[0]))
+#endif
+
+#define MAX_CLIENTS 32
+/* a subscriber with more pending data looses frames */
+#define MAX_QUEUE (8u << 20)
+#define MAX_BATCH 1024
+
+struct client {
+	int fd;
+	uint8_t in[sizeof(struct oceand_header) + OCEAND_MAX_COMMAND];
+	size_t in_len;
+	/* not yet sent */
+	uint8_t *out;
+	size_t out_len;
+	size_t out_size;
+	/* OCEAND_FRAMES message under construction, batch 0 when not subscribed */
+	unsigned batch;
+	unsigned count;
+	uint8_t *frames;
+	uint64_t dropped;
+};
+
+struct oceand {
+	struct ocean *ctx;
+	struct ocean_spectra *spec;
+	struct ocean_publisher *pub;
+	struct oceand_info info;
+	int fd;
+	struct client *clients[MAX_CLIENTS];
+	unsigned num_of_clients;
+	uint64_t frames;
+};
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static size_t frame_size(const struct oceand *d)
+{
+	return sizeof(struct oceand_frame) + d->info.num_of_pixels * sizeof(double);
+}
+
+static int client_queue(struct client *c, const void *buf, size_t len)
+{
+	if (c->out_len + len > c->out_size) {
+		size_t size = c->out_size ? c->out_size : 4096;
+		uint8_t *out;
+
+		while (size < c->out_len + len)
+			size *= 2;
+		/* frames stop at MAX_QUEUE, there is always room for replies */
+		if (size > 2 * MAX_QUEUE)
+			return -ENOBUFS;
+
+		out = realloc(c->out, size);
+		if (!out)
+			return -ENOMEM;
+		c->out = out;
+		c->out_size = size;
+	}
+
+	memcpy(c->out + c->out_len, buf, len);
+	c->out_len += len;
+	return 0;
+}
+
+static int client_flush(struct client *c)
+{
+	size_t pos = 0;
+
+	while (pos < c->out_len) {
+		ssize_t ret = send(c->fd, c->out + pos, c->out_len - pos,
+				   MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -errno;
+		}
+		pos += ret;
+	}
+
+	memmove(c->out, c->out + pos, c->out_len - pos);
+	c->out_len -= pos;
+	return 0;
+}
+
+/* Queue the header of a reply with @len bytes of payload to follow */
+static int client_reply_header(struct client *c, uint16_t type, int result, size_t len)
+{
+	struct oceand_header hdr = {
+		.type = type | OCEAND_REPLY,
+		.length = sizeof(struct oceand_reply) + len,
+	};
+	struct oceand_reply reply = {
+		.result = result,
+	};
+	int ret;
+
+	/* replies are small, they are never dropped */
+	ret = client_queue(c, &hdr, sizeof(hdr));
+	if (ret == 0)
+		ret = client_queue(c, &reply, sizeof(reply));
+	return ret;
+}
+
+static int client_reply(struct client *c, uint16_t type, int result,
+			const void *payload, size_t len)
+{
+	int ret;
+
+	ret = client_reply_header(c, type, result, len);
+	if (ret == 0 && len)
+		ret = client_queue(c, payload, len);
+	return ret;
+}
+
+/* Queue the pending frames of a subscriber, or drop them if it lags behind */
+static void client_send_frames(struct oceand *d, struct client *c)
+{
+	struct oceand_header *hdr = (struct oceand_header *)c->frames;
+	struct oceand_frames *frames = (struct oceand_frames *)(hdr + 1);
+	const size_t len = sizeof(*frames) + c->count * frame_size(d);
+
+	if (c->count == 0)
+		return;
+
+	hdr->type = OCEAND_FRAMES;
+	hdr->reserved = 0;
+	hdr->length = len;
+	frames->count = c->count;
+	frames->num_of_pixels = d->info.num_of_pixels;
+	frames->dropped = c->dropped;
+
+	if (c->out_len + sizeof(*hdr) + len > MAX_QUEUE ||
+	    client_queue(c, hdr, sizeof(*hdr) + len) < 0)
+		c->dropped += c->count;
+
+	c->count = 0;
+}
+
+static void client_add_frame(struct oceand *d, struct client *c)
+{
+	const size_t offset = sizeof(struct oceand_header) + sizeof(struct oceand_frames) +
+			      c->count * frame_size(d);
+	struct oceand_frame *frame = (struct oceand_frame *)(c->frames + offset);
+
+	frame->sequence = ocean_spectra_get_sequence(d->spec);
+	frame->timestamp = ocean_spectra_get_timestamp(d->spec);
+	frame->integration_time = ocean_spectra_get_integration_time(d->spec);
+	frame->flags = ocean_spectra_get_flags(d->spec);
+	memcpy(frame + 1, ocean_spectra_get_data(d->spec),
+	       d->info.num_of_pixels * sizeof(double));
+
+	if (++c->count == c->batch)
+		client_send_frames(d, c);
+}
+
+static int client_subscribe(struct oceand *d, struct client *c, uint32_t batch)
+{
+	uint8_t *frames;
+
+	if (batch == 0 || batch > MAX_BATCH ||
+	    batch * frame_size(d) > MAX_QUEUE / 2)
+		return -EINVAL;
+
+	client_send_frames(d, c);
+
+	frames = realloc(c->frames, sizeof(struct oceand_header) +
+			 sizeof(struct oceand_frames) + batch * frame_size(d));
+	if (!frames)
+		return -ENOMEM;
+
+	c->frames = frames;
+	c->batch = batch;
+	return 0;
+}
+
+static int get_status(struct oceand *d, struct oceand_status *status)
+{
+	unsigned i;
+	int ret;
+
+	memset(status, 0, sizeof(*status));
+
+	ret = ocean_get_temperature(d->ctx, &status->pcb, &status->sink);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_get_integration_time(d->ctx, &status->integration_time);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (d->clients[i] && d->clients[i]->batch)
+			status->subscribers++;
+	status->frames = d->frames;
+	return 0;
+}
+
+static int handle_command(struct oceand *d, struct client *c,
+			  const struct oceand_header *hdr, const uint8_t *payload)
+{
+	struct oceand_status status;
+	uint32_t arg = 0;
+	int ret;
+
+	if (hdr->length >= sizeof(arg))
+		memcpy(&arg, payload, sizeof(arg));
+
+	switch (hdr->type) {
+	case OCEAND_HELLO:
+		return client_reply(c, hdr->type, 0, &d->info, sizeof(d->info));
+
+	case OCEAND_GET_STATUS:
+		ret = get_status(d, &status);
+		return client_reply(c, hdr->type, ret, &status, ret < 0 ? 0 : sizeof(status));
+
+	case OCEAND_GET_WAVELENGTHS: {
+		double wavelength[256];
+		uint32_t i, j, n;
+
+		ret = client_reply_header(c, hdr->type, 0,
+					  d->info.num_of_pixels * sizeof(double));
+
+		/* in chunks, the spectra only hands out single wavelengths */
+		for (i = 0; i < d->info.num_of_pixels && ret == 0; i += n) {
+			n = d->info.num_of_pixels - i;
+			if (n > ARRAY_SIZE(wavelength))
+				n = ARRAY_SIZE(wavelength);
+			for (j = 0; j < n; j++)
+				wavelength[j] = ocean_spectra_get_wavelength(d->spec, i + j);
+			ret = client_queue(c, wavelength, n * sizeof(double));
+		}
+		return ret;
+	}
+	}
+
+	if (hdr->type < OCEAND_SET_INTEGRATION_TIME || hdr->type > OCEAND_UNSUBSCRIBE)
+		return client_reply(c, hdr->type, -ENOSYS, NULL, 0);
+
+	if (hdr->length != (hdr->type == OCEAND_UNSUBSCRIBE ? 0 : sizeof(arg)))
+		return client_reply(c, hdr->type, -EINVAL, NULL, 0);
+
+	switch (hdr->type) {
+	case OCEAND_SET_INTEGRATION_TIME:
+		ret = ocean_set_integration_time(d->ctx, arg);
+		break;
+	case OCEAND_ENABLE_STROB:
+		ret = ocean_enable_strob(d->ctx, arg != 0);
+		break;
+	case OCEAND_ENABLE_FAN:
+		ret = ocean_enable_fan(d->ctx, arg != 0);
+		break;
+	case OCEAND_ENABLE_EXTERNAL_TRIGGER:
+		ret = ocean_enable_external_trigger(d->ctx, arg != 0);
+		break;
+	case OCEAND_SUBSCRIBE:
+		ret = client_subscribe(d, c, arg);
+		break;
+	case OCEAND_UNSUBSCRIBE:
+		/* the frames collected so far go out before the reply */
+		client_send_frames(d, c);
+		c->batch = 0;
+		ret = 0;
+		break;
+	default:
+		ret = -ENOSYS;
+		break;
+	}
+
+	return client_reply(c, hdr->type, ret, NULL, 0);
+}
+
+static int client_read(struct oceand *d, struct client *c)
+{
+	struct oceand_header hdr;
+	size_t pos = 0;
+	ssize_t len;
+	int ret = 0;
+
+	len = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+	if (len == 0)
+		return -ECONNRESET;
+	if (len < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -errno;
+	c->in_len += len;
+
+	while (ret == 0 && c->in_len - pos >= sizeof(hdr)) {
+		memcpy(&hdr, c->in + pos, sizeof(hdr));
+		if (hdr.length > OCEAND_MAX_COMMAND)
+			return -EMSGSIZE;
+		if (c->in_len - pos < sizeof(hdr) + hdr.length)
+			break;
+
+		ret = handle_command(d, c, &hdr, c->in + pos + sizeof(hdr));
+		pos += sizeof(hdr) + hdr.length;
+	}
+
+	memmove(c->in, c->in + pos, c->in_len - pos);
+	c->in_len -= pos;
+	return ret;
+}
+
+static void client_close(struct oceand *d, unsigned i)
+{
+	struct client *c = d->clients[i];
+
+	close(c->fd);
+	free(c->frames);
+	free(c->out);
+	free(c);
+	d->clients[i] = NULL;
+	d->num_of_clients--;
+}
+
+static void client_accept(struct oceand *d)
+{
+	struct client *c;
+	unsigned i;
+	int fd;
+
+	fd = accept4(d->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (!d->clients[i])
+			break;
+
+	c = i < MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+	if (!c) {
+		fprintf(stderr, "WARN: refusing client, too many connections\n");
+		close(fd);
+		return;
+	}
+
+	c->fd = fd;
+	d->clients[i] = c;
+	d->num_of_clients++;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	/* a stale socket of a previous run */
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 8) < 0) {
+		int ret = -errno;
+
+		close(fd);
+		return ret;
+	}
+
+	return fd;
+}
+
+static void acquire(struct oceand *d)
+{
+	const struct timespec pause = { .tv_nsec = 100000000 };
+	unsigned i;
+	int ret;
+
+	ret = ocean_request_spectra(d->ctx, d->spec);
+	if (ret < 0) {
+		fprintf(stderr, "ERR: ocean_request_spectra: %s\n", strerror(-ret));
+		nanosleep(&pause, NULL);
+		return;
+	}
+	d->frames++;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (d->clients[i] && d->clients[i]->batch)
+			client_add_frame(d, d->clients[i]);
+}
+
+static int run(struct oceand *d)
+{
+	struct pollfd fds[MAX_CLIENTS + 1];
+	unsigned idx[MAX_CLIENTS + 1];
+	unsigned i, n;
+
+	while (!quit) {
+		fds[0].fd = d->fd;
+		fds[0].events = POLLIN;
+		for (i = 0, n = 1; i < MAX_CLIENTS; i++) {
+			struct client *c = d->clients[i];
+
+			if (!c)
+				continue;
+			fds[n].fd = c->fd;
+			fds[n].events = POLLIN | (c->out_len ? POLLOUT : 0);
+			idx[n++] = i;
+		}
+
+		/* acquisition never stops, just look for pending requests */
+		if (poll(fds, n, 0) < 0 && errno != EINTR)
+			return -errno;
+
+		if (fds[0].revents & POLLIN)
+			client_accept(d);
+
+		for (i = 1; i < n; i++) {
+			struct client *c = d->clients[idx[i]];
+			int ret = 0;
+
+			if (fds[i].revents & (POLLERR | POLLHUP))
+				ret = -ECONNRESET;
+			if (ret == 0 && (fds[i].revents & POLLIN))
+				ret = client_read(d, c);
+			if (ret == 0 && c->out_len)
+				ret = client_flush(c);
+			if (ret < 0)
+				client_close(d, idx[i]);
+		}
+
+		acquire(d);
+
+		for (i = 0; i < MAX_CLIENTS; i++)
+			if (d->clients[i] && d->clients[i]->out_len &&
+			    client_flush(d->clients[i]) < 0)
+				client_close(d, i);
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -s PATH       socket to listen on (default %s)\n"
+	       "  -d VID:PID    device to open (default 2457:1026)\n"
+	       "  -i MS         integration time\n"
+	       "  -m NAME       also publish the frames to shared memory NAME\n"
+	       "  -n SLOTS      frames kept in shared memory (default 64)\n"
+	       "  -r CPU:PRIO   acquire pinned to CPU with SCHED_FIFO priority PRIO\n"
+	       "  -c PACKETS    receive frames in chunks of PACKETS usb packets\n"
+	       "  -h            show this help\n", name, OCEAND_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = OCEAND_SOCKET, *shm = NULL;
+	unsigned vendor = 0x2457, product = 0x1026, slots = 64, packets = 0;
+	struct sigaction sa = { .sa_handler = on_signal };
+	uint32_t integration_time = 0;
+	int rt_cpu = -1, rt_priority = 0;
+	struct oceand d;
+	unsigned i;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "s:d:i:m:n:r:c:h")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'd':
+			if (sscanf(optarg, "%x:%x", &vendor, &product) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'i':
+			integration_time = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			shm = optarg;
+			break;
+		case 'n':
+			slots = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%d:%d", &rt_cpu, &rt_priority) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'c':
+			packets = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	memset(&d, 0, sizeof(d));
+	d.fd = -1;
+
+	ret = ocean_create(&d.ctx);
+	if (ret < 0) {
+		fprintf(stderr, "ERR: ocean_create: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	ret = ocean_open(d.ctx, vendor, product);
+	if (ret < 0) {
+		fprintf(stderr, "ERR: ocean_open(%04x:%04x): %s\n", vendor, product,
+			strerror(-ret));
+		goto out;
+	}
+
+	/* a replugged spectrometer continues where it left off */
+	ret = ocean_set_reconnect(d.ctx, true);
+	if (ret < 0)
+		fprintf(stderr, "WRN: ocean_set_reconnect: %s\n", strerror(-ret));
+
+	if (integration_time) {
+		ret = ocean_set_integration_time(d.ctx, integration_time);
+		if (ret < 0) {
+			fprintf(stderr, "ERR: ocean_set_integration_time: %s\n", strerror(-ret));
+			goto out;
+		}
+	}
+
+	if (packets) {
+		ret = ocean_set_chunked_transfer(d.ctx, packets);
+		if (ret < 0) {
+			fprintf(stderr, "ERR: ocean_set_chunked_transfer: %s\n", strerror(-ret));
+			goto out;
+		}
+	}
+
+	ret = ocean_spectra_create(&d.spec, d.ctx);
+	if (ret < 0) {
+		fprintf(stderr, "ERR: ocean_spectra_create: %s\n", strerror(-ret));
+		goto out;
+	}
+
+	d.info.version = OCEAND_VERSION;
+	d.info.num_of_pixels = ocean_spectra_get_size(d.spec);
+	ocean_get_serial(d.ctx, d.info.serial, sizeof(d.info.serial));
+
+	if (shm) {
+		ret = ocean_publisher_create(&d.pub, shm, d.spec, slots);
+		if (ret < 0) {
+			fprintf(stderr, "ERR: ocean_publisher_create(%s): %s\n", shm,
+				strerror(-ret));
+			goto out;
+		}
+		ocean_set_publisher(d.ctx, d.pub);
+	}
+
+	/* this thread acquires, memory allocated later is locked as well */
+	if (rt_priority || rt_cpu >= 0) {
+		ret = ocean_set_realtime(d.ctx, rt_cpu, rt_priority);
+		if (ret < 0) {
+			fprintf(stderr, "ERR: ocean_set_realtime: %s\n", strerror(-ret));
+			goto out;
+		}
+	}
+
+	d.fd = listen_on(path);
+	if (d.fd < 0) {
+		ret = d.fd;
+		fprintf(stderr, "ERR: listen on %s: %s\n", path, strerror(-ret));
+		goto out;
+	}
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	ret = run(&d);
+	if (ret < 0)
+		fprintf(stderr, "ERR: %s\n", strerror(-ret));
+
+	unlink(path);
+
+out:
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (d.clients[i])
+			client_close(&d, i);
+	if (d.fd >= 0)
+		close(d.fd);
+	ocean_set_publisher(d.ctx, NULL);
+	ocean_publisher_free(d.pub);
+	ocean_spectra_free(d.spec);
+	ocean_close(d.ctx);
+	ocean_free(d.ctx);
+	return ret < 0 ? 1 : 0;
+}
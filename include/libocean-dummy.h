@@ -0,0 +1,80 @@
+/*
+ * libocean-dummy.h
+ *
+ * The simulated spectrometer of libocean-dummy, for load tests
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <libocean.h>
+
+#ifndef LIBOCEAN_DUMMY_H
+#define LIBOCEAN_DUMMY_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Simulator
+ *
+ * Out of the box the dummy plays back two recorded frames, alternating,
+ * whatever the integration time. With a model it renders a detector
+ * instead: the recorded scene scaled by the integration time, dark
+ * current, an offset, shot and read noise, clipped at the saturation
+ * level. Either way the raw bytes are those of a NIRQuest (16 bit little
+ * endian with the msb flipped, a sync byte after every 512 pixels) and
+ * the data is decoded from them. Only part of libocean-dummy. */
+struct ocean_dummy_model {
+	/* counts per ms at the brightest pixel of the scene */
+	double signal_rate;
+	/* counts per ms of every pixel, also in the dark */
+	double dark_rate;
+	/* counts of a readout without exposure */
+	double offset;
+	/* rms counts of the readout */
+	double read_noise;
+	/* photo electrons per count, the shot noise; 0 for none */
+	double gain;
+	/* counts at which the detector clips, 1 to 65535 */
+	uint16_t saturation;
+	/* of the noise, the same seed gives the same frames */
+	uint32_t seed;
+};
+
+enum ocean_dummy_pacing {
+	/* a frame is handed out as soon as it is requested */
+	OCEAN_DUMMY_UNTHROTTLED = 0,
+	/* a frame takes its integration time, back to back requests get
+	 * the rate of the real device */
+	OCEAN_DUMMY_PACED,
+};
+
+/* Transfers gone wrong, for the integrity checks of libocean */
+enum ocean_dummy_fault {
+	/* the frame ends half way */
+	OCEAN_DUMMY_SHORT_FRAME = 0,
+	/* a byte at the start was lost, the sync bytes are off by one */
+	OCEAN_DUMMY_BAD_SYNC,
+};
+
+/* Fills @model with a NIRQuest like detector, the defaults */
+void ocean_dummy_model_init(struct ocean_dummy_model *model);
+/* Renders the frames of @ctx from @model, NULL plays back the recording */
+int ocean_dummy_set_model(struct ocean *ctx, const struct ocean_dummy_model *model);
+/* 512 to 4096 pixels, -ERANGE otherwise. Spectra created before do not
+ * fit the device any more. */
+int ocean_dummy_set_num_of_pixels(struct ocean *ctx, uint32_t num_of_pixels);
+int ocean_dummy_set_pacing(struct ocean *ctx, enum ocean_dummy_pacing pacing);
+/* The next @count transfers suffer @fault, a retry is another transfer */
+int ocean_dummy_inject_fault(struct ocean *ctx, enum ocean_dummy_fault fault, unsigned count);
+/* Pulls the device and plugs it back in, which comes back at its power on
+ * settings. Meanwhile requests fail with -ENODEV, see ocean_set_reconnect(). */
+int ocean_dummy_set_plugged(struct ocean *ctx, bool plugged);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* LIBOCEAN_DUMMY_H */
@@ -29,6 +29,20 @@ struct ocean_spectra;
 int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ctx);
 void ocean_spectra_free(struct ocean_spectra *spec);
 
+/* The bytes the buffers of a spectra of the device take */
+int ocean_spectra_get_buffer_sizes(struct ocean *ctx, size_t *data_len, size_t *raw_len);
+/* Like ocean_spectra_create(), but the frames are decoded into @data, at
+ * least @data_len bytes as returned above and aligned to a double (64
+ * bytes keep vector code happy). @raw receives the undecoded frame, if
+ * NULL the spectra allocates it. The buffers stay the callers. */
+int ocean_spectra_create_with_buffers(struct ocean_spectra **spec, struct ocean *ctx,
+				      double *data, size_t data_len,
+				      uint8_t *raw, size_t raw_len);
+/* Decode the next frames into other buffers, a NULL @raw keeps the
+ * current one. Not possible for spectra of a pool. */
+int ocean_spectra_rebind(struct ocean_spectra *spec, double *data, size_t data_len,
+			 uint8_t *raw, size_t raw_len);
+
 /* The unprocessed raw data */
 size_t ocean_spectra_get_raw_size(struct ocean_spectra *spec);
 uint8_t *ocean_spectra_get_raw_data(struct ocean_spectra *spec);
@@ -39,6 +53,46 @@ double *ocean_spectra_get_data(struct ocean_spectra *spec);
 
 /* Returns the wavelength belonging to a pixel */
 double ocean_spectra_get_wavelength(struct ocean_spectra *spec, int pixel);
+/* Returns the wavelength at a fractional (sub-pixel) position */
+double ocean_spectra_get_wavelength_at(struct ocean_spectra *spec, double pixel);
+
+/* Information about the last frame received with ocean_request_spectra():
+ * the frame counter since ocean_open(), the time it was received (ns
+ * since the epoch) and the integration time it was taken with */
+uint64_t ocean_spectra_get_sequence(struct ocean_spectra *spec);
+uint64_t ocean_spectra_get_timestamp(struct ocean_spectra *spec);
+uint32_t ocean_spectra_get_integration_time(struct ocean_spectra *spec);
+
+enum ocean_frame_flags {
+	/* first frame after the device was lost and found again */
+	OCEAN_FRAME_RECONNECTED = 1 << 0,
+	/* the frame failed the integrity checks, see ocean_set_corrupt_policy() */
+	OCEAN_FRAME_CORRUPT = 1 << 1,
+};
+
+uint32_t ocean_spectra_get_flags(struct ocean_spectra *spec);
+
+/* The intensity of a saturated pixel, after correction */
+double ocean_spectra_get_saturation(struct ocean_spectra *spec);
+
+/* Statistics of the last frame, gathered while decoding it */
+struct ocean_spectra_stats {
+	double min;
+	double max;
+	double mean;
+	/* the pixel with the highest intensity */
+	size_t peak;
+	/* number of pixels at or above the saturation level */
+	size_t saturated;
+	/* number of pixels replaced by the spike rejection, the other values
+	 * describe the cleaned frame, except the saturated pixels */
+	size_t replaced;
+};
+
+int ocean_spectra_get_stats(struct ocean_spectra *spec, struct ocean_spectra_stats *stats);
+/* One bit per pixel, bit (i % 64) of word (i / 64) is set if pixel i is
+ * saturated */
+const uint64_t *ocean_spectra_get_saturation_map(struct ocean_spectra *spec);
 
 
 int ocean_create(struct ocean **ctx);
@@ -56,12 +110,668 @@ int ocean_get_integration_time(struct ocean *ctx, uint32_t *time);
 int ocean_enable_strob(struct ocean *ctx, bool enable);
 int ocean_enable_fan(struct ocean *ctx, bool enable);
 int ocean_enable_external_trigger(struct ocean *ctx, bool enable);
+/* How long a request waits for the external trigger in ms, 0 waits forever */
+int ocean_set_trigger_timeout(struct ocean *ctx, uint32_t timeout);
+
+/* Once the device is unplugged, ocean_request_spectra() returns -ENODEV
+ * until a device with the same serial is back. That one is opened and
+ * gets the settings made through this context. */
+int ocean_set_reconnect(struct ocean *ctx, bool enable);
+
+/* Every frame is checked for its length and for the sync bytes after
+ * every 512 pixels and at its end. A corrupt frame is dropped by default:
+ * the data endpoint is flushed and the frame requested again, twice at
+ * most before the request fails with -EBADMSG. Otherwise it is handed
+ * out with OCEAN_FRAME_CORRUPT. */
+enum ocean_corrupt_policy {
+	OCEAN_CORRUPT_DROP = 0,
+	OCEAN_CORRUPT_FLAG,
+};
+
+struct ocean_integrity_stats {
+	/* frames received and checked */
+	uint64_t frames;
+	/* fewer bytes than a frame */
+	uint64_t short_frames;
+	/* a sync byte missing or misplaced */
+	uint64_t bad_sync;
+	/* data transfers which timed out or stalled */
+	uint64_t timeouts;
+	uint64_t stalls;
+	/* flushes of the data endpoint */
+	uint64_t resyncs;
+	/* corrupt frames not handed out */
+	uint64_t dropped;
+};
+
+int ocean_set_corrupt_policy(struct ocean *ctx, enum ocean_corrupt_policy policy);
+/* The counters since ocean_create(), from any thread */
+int ocean_get_integrity_stats(struct ocean *ctx, struct ocean_integrity_stats *stats);
+
+/* Receives a frame in transfers of @packets usb packets (512 bytes) each
+ * and decodes every one as soon as it arrived, so the frame is ready
+ * right after its last packet. 0 takes the frame in one transfer, which
+ * the batches always do. */
+int ocean_set_chunked_transfer(struct ocean *ctx, unsigned packets);
 
 int ocean_request_spectra(struct ocean *ctx, struct ocean_spectra *spec);
 int ocean_stop_spectral_acquisition(struct ocean *ctx);
 int ocean_get_num_of_pixel(struct ocean *ctx, uint32_t *num_of_pixel);
 
 
+/* Peak detection
+ *
+ * Finds emission (or absorption) lines in a spectra in a single pass
+ * without allocating memory, so it can be run on every frame. Candidates
+ * are the zero crossings of the derivative of the box-car smoothed data,
+ * they are kept if their prominence and intensity pass the configured
+ * limits. The position is refined to sub-pixel accuracy. */
+enum ocean_peak_refinement {
+	OCEAN_PEAK_REFINE_NONE = 0,
+	OCEAN_PEAK_REFINE_CENTROID,
+	OCEAN_PEAK_REFINE_PARABOLIC,
+	OCEAN_PEAK_REFINE_GAUSSIAN,
+};
+
+struct ocean_peak {
+	double pixel;		/* sub-pixel position */
+	double wavelength;	/* position in nm */
+	double height;		/* (smoothed) intensity at the peak */
+	double prominence;	/* height above the higher of both bases */
+};
+
+struct ocean_peak_finder;
+
+int ocean_peak_finder_create(struct ocean_peak_finder **finder);
+void ocean_peak_finder_free(struct ocean_peak_finder *finder);
+
+/* Smooth over 2 * half_width + 1 pixels, 0 disables smoothing */
+int ocean_peak_finder_set_smoothing(struct ocean_peak_finder *finder, unsigned half_width);
+/* Minimum prominence in counts, 0 reports every local maximum */
+int ocean_peak_finder_set_prominence(struct ocean_peak_finder *finder, double prominence);
+/* Ignore lines below (absorption: above) this intensity */
+int ocean_peak_finder_set_threshold(struct ocean_peak_finder *finder, double threshold);
+int ocean_peak_finder_set_refinement(struct ocean_peak_finder *finder, enum ocean_peak_refinement refine);
+/* Look for minima instead of maxima */
+int ocean_peak_finder_set_absorption(struct ocean_peak_finder *finder, bool absorption);
+
+/* Returns the number of peaks stored in @peaks (at most @max_peaks) */
+int ocean_peak_finder_run(struct ocean_peak_finder *finder, struct ocean_spectra *spec,
+			  struct ocean_peak *peaks, size_t max_peaks);
+
+
+/* Band integration
+ *
+ * Integrates the intensity (counts * nm) over many wavelength bands. The
+ * bands are resolved to fractional pixel bounds once, the integrals of a
+ * frame then come from a single prefix sum, partially covered pixels are
+ * weighted by the covered fraction. */
+struct ocean_bands;
+
+/* @lower and @upper are in nm, resolved with the calibration of @spec */
+int ocean_bands_create(struct ocean_bands **bands, struct ocean_spectra *spec,
+		       const double *lower, const double *upper, size_t num_bands);
+void ocean_bands_free(struct ocean_bands *bands);
+
+size_t ocean_bands_get_size(struct ocean_bands *bands);
+/* The fractional pixel range a band was resolved to */
+int ocean_bands_get_bounds(struct ocean_bands *bands, size_t band,
+			   double *first, double *last);
+
+/* Stores the integral of every band in @result */
+int ocean_bands_integrate(struct ocean_bands *bands, struct ocean_spectra *spec,
+			  double *result);
+
+
+/* Lossless compression of raw spectra
+ *
+ * Streaming codec for frames as returned by ocean_spectra_get_raw_data(),
+ * taken as little endian 16 bit samples. Each block of 128 samples is
+ * predicted either from the neighbouring pixel or from the same pixel of
+ * the previous frame, the residuals are zigzag coded and bit-packed.
+ * Frames have to be decoded in the order they were encoded, starting
+ * with a key frame. */
+struct ocean_encoder;
+struct ocean_decoder;
+
+int ocean_encoder_create(struct ocean_encoder **enc, size_t frame_size);
+void ocean_encoder_free(struct ocean_encoder *enc);
+
+/* Emit a key frame every @interval frames, 0 only emits the first one */
+int ocean_encoder_set_key_interval(struct ocean_encoder *enc, unsigned interval);
+/* Make the next frame a key frame */
+void ocean_encoder_reset(struct ocean_encoder *enc);
+/* Worst case size of an encoded frame */
+size_t ocean_encoder_get_max_size(struct ocean_encoder *enc);
+
+/* Returns the number of bytes stored in @out, @len has to be at least
+ * ocean_encoder_get_max_size() */
+int ocean_encoder_encode(struct ocean_encoder *enc, const uint8_t *frame,
+			 uint8_t *out, size_t len);
+
+int ocean_decoder_create(struct ocean_decoder **dec, size_t frame_size);
+void ocean_decoder_free(struct ocean_decoder *dec);
+/* Drop the previous frame, wait for the next key frame */
+void ocean_decoder_reset(struct ocean_decoder *dec);
+
+/* Returns the number of bytes consumed from @in, -ENODATA if the stream
+ * did not start with a key frame and -EBADMSG on corrupt input */
+int ocean_decoder_decode(struct ocean_decoder *dec, const uint8_t *in, size_t len,
+			 uint8_t *frame);
+
+
+/* Automatic exposure
+ *
+ * Picks the integration time for the next frame, so a high percentile of
+ * the intensities reaches a target fraction of the saturation level. The
+ * frames keep reporting the integration time they were actually taken
+ * with, see ocean_spectra_get_integration_time(). */
+struct ocean_exposure;
+
+int ocean_exposure_create(struct ocean_exposure **exp);
+void ocean_exposure_free(struct ocean_exposure *exp);
+
+/* Fraction of the saturation level to aim for (default 0.75) */
+int ocean_exposure_set_target(struct ocean_exposure *exp, double target);
+/* The percentile to measure the level with (default 0.98) */
+int ocean_exposure_set_percentile(struct ocean_exposure *exp, double percentile);
+/* Integration time in ms (default 1 to 10000) */
+int ocean_exposure_set_limits(struct ocean_exposure *exp, uint32_t min, uint32_t max);
+/* Keep the integration time while the level is within this fraction of
+ * the target (default 0.05) */
+int ocean_exposure_set_hysteresis(struct ocean_exposure *exp, double tolerance);
+/* Forget the previous frames, e.g. after the light source changed */
+void ocean_exposure_reset(struct ocean_exposure *exp);
+
+/* Returns the integration time for the frame after @data, which was taken
+ * with @integration_time */
+uint32_t ocean_exposure_next(struct ocean_exposure *exp, const double *data, size_t len,
+			     double saturation, uint32_t integration_time);
+/* Sets the integration time for the next frame, returns 1 if it changed */
+int ocean_exposure_update(struct ocean_exposure *exp, struct ocean *ctx,
+			  struct ocean_spectra *spec);
+
+/* Update the exposure after every ocean_request_spectra(), NULL stops */
+int ocean_set_auto_exposure(struct ocean *ctx, struct ocean_exposure *exp);
+
+
+/* Shared memory publication
+ *
+ * A publisher writes frames and their information into a ring of slots in
+ * POSIX shared memory (/dev/shm), so other processes can read the stream
+ * of the one process owning the device. The publisher never waits for
+ * subscribers. Every slot is guarded by a sequence counter (seqlock), a
+ * subscriber reads the data in place and checks afterwards with
+ * ocean_subscriber_valid() that the slot was not overwritten meanwhile. */
+struct ocean_publisher;
+struct ocean_subscriber;
+
+struct ocean_shm_frame {
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t integration_time;
+	uint32_t num_of_pixels;
+	/* enum ocean_frame_flags */
+	uint32_t flags;
+	/* frames overwritten before they could be read */
+	uint64_t lost;
+	/* in shared memory, valid until the slot is overwritten */
+	const double *data;
+	const double *wavelength;
+	/* private */
+	const void *slot;
+	uint64_t token;
+};
+
+/* Create /dev/shm/@name for frames shaped like @spec, @slots deep */
+int ocean_publisher_create(struct ocean_publisher **pub, const char *name,
+			   struct ocean_spectra *spec, unsigned slots);
+/* Unmaps and removes the shared memory */
+void ocean_publisher_free(struct ocean_publisher *pub);
+int ocean_publisher_publish(struct ocean_publisher *pub, struct ocean_spectra *spec);
+
+/* Publish every frame returned by ocean_request_spectra(), NULL stops */
+int ocean_set_publisher(struct ocean *ctx, struct ocean_publisher *pub);
+
+int ocean_subscriber_open(struct ocean_subscriber **sub, const char *name);
+void ocean_subscriber_close(struct ocean_subscriber *sub);
+
+/* Returns the next frame, -EAGAIN if there is none yet. Waits up to
+ * @timeout ms for it, a negative @timeout waits forever */
+int ocean_subscriber_next(struct ocean_subscriber *sub, struct ocean_shm_frame *frame,
+			  int timeout);
+/* True as long as the frame data was not overwritten */
+bool ocean_subscriber_valid(struct ocean_subscriber *sub, const struct ocean_shm_frame *frame);
+
+
+/* Real-time profile
+ *
+ * Prepares the thread taking the frames, which also handles the usb
+ * events, to keep its timing on a busy host: it is pinned to one CPU, runs
+ * with SCHED_FIFO, all memory of the process is locked (current and
+ * future) and the stack is faulted in. The transfers are allocated up
+ * front: frames, batches, commands with their answers and the recovery
+ * after a failed transfer allocate nothing afterwards. Needs CAP_SYS_NICE
+ * and CAP_IPC_LOCK, or matching rlimits. */
+struct ocean_realtime_stats {
+	uint64_t frames;
+	/* ns from the end of the integration time until the thread had the
+	 * frame, including the readout and the transfer */
+	uint64_t latency_min;
+	uint64_t latency_max;
+	uint64_t latency_mean;
+	/* of the thread since the profile was entered */
+	uint64_t minor_faults;
+	uint64_t major_faults;
+	uint64_t preemptions;
+};
+
+/* Call from the thread requesting the frames. @cpu -1 keeps the affinity,
+ * @priority 0 the scheduling policy. A failing step leaves the ones
+ * before it in place. */
+int ocean_set_realtime(struct ocean *ctx, int cpu, int priority);
+int ocean_get_realtime_stats(struct ocean *ctx, struct ocean_realtime_stats *stats);
+
+
+/* Housekeeping monitor
+ *
+ * A thread polling the temperatures and state of the device at a low
+ * rate, in between frames. Reading the latest values neither waits for
+ * the device nor for the thread. */
+struct ocean_monitor;
+
+struct ocean_housekeeping {
+	float pcb;
+	float sink;
+	uint32_t integration_time;
+	uint8_t fan_and_tec_state;
+	uint8_t lamp_enable;
+	uint8_t trigger_mode;
+	uint8_t power_state;
+	/* when the values were read, ns since the epoch */
+	uint64_t timestamp;
+	/* number of polls so far */
+	uint64_t updates;
+};
+
+/* Polls the device of @ctx every @interval ms until freed */
+int ocean_monitor_create(struct ocean_monitor **mon, struct ocean *ctx, unsigned interval);
+void ocean_monitor_free(struct ocean_monitor *mon);
+/* The latest values, -EAGAIN before the first poll went through */
+int ocean_monitor_get(struct ocean_monitor *mon, struct ocean_housekeeping *hk);
+
+
+/* Per pixel statistics over many frames
+ *
+ * Mean, variance, minimum and maximum of every pixel, updated with each
+ * frame (Welford). Accumulators fed by different threads can be merged. */
+struct ocean_accumulator;
+
+enum ocean_accumulator_source {
+	/* the corrected data */
+	OCEAN_ACCUMULATE_DATA = 0,
+	/* the detector counts, before any correction */
+	OCEAN_ACCUMULATE_COUNTS,
+};
+
+int ocean_accumulator_create(struct ocean_accumulator **acc, struct ocean_spectra *spec,
+			     enum ocean_accumulator_source source);
+void ocean_accumulator_free(struct ocean_accumulator *acc);
+void ocean_accumulator_reset(struct ocean_accumulator *acc);
+int ocean_accumulator_add(struct ocean_accumulator *acc, struct ocean_spectra *spec);
+int ocean_accumulator_add_values(struct ocean_accumulator *acc, const double *values,
+				 size_t len);
+/* Adds the frames of @other to @acc */
+int ocean_accumulator_merge(struct ocean_accumulator *acc, const struct ocean_accumulator *other);
+
+uint64_t ocean_accumulator_get_count(struct ocean_accumulator *acc);
+size_t ocean_accumulator_get_num_of_pixels(struct ocean_accumulator *acc);
+/* Arrays of ocean_accumulator_get_num_of_pixels(), valid until the next
+ * update. The variance is the sample variance. */
+const double *ocean_accumulator_get_mean(struct ocean_accumulator *acc);
+const double *ocean_accumulator_get_variance(struct ocean_accumulator *acc);
+const double *ocean_accumulator_get_min(struct ocean_accumulator *acc);
+const double *ocean_accumulator_get_max(struct ocean_accumulator *acc);
+
+
+/* Spike rejection
+ *
+ * Keeps the last frames of a stream (the window, 3 to 15 frames) and
+ * replaces the pixels of the newest frame which stand out from the others,
+ * like cosmic rays or readout glitches. A pixel is a spike if it differs
+ * from the center of the window by more than the threshold times the
+ * spread and more than the floor. The first frames pass unchanged until
+ * three are known. */
+struct ocean_despike;
+
+enum ocean_despike_mode {
+	/* median and median absolute deviation of the window */
+	OCEAN_DESPIKE_MEDIAN = 0,
+	/* sigma clipped mean and standard deviation of the previous frames */
+	OCEAN_DESPIKE_SIGMA,
+};
+
+int ocean_despike_create(struct ocean_despike **ds, struct ocean_spectra *spec,
+			 unsigned window);
+void ocean_despike_free(struct ocean_despike *ds);
+/* Forget the previous frames, e.g. after the integration time changed */
+void ocean_despike_reset(struct ocean_despike *ds);
+int ocean_despike_set_mode(struct ocean_despike *ds, enum ocean_despike_mode mode);
+/* In standard deviations (default 5), and as an absolute intensity
+ * (default 0) */
+int ocean_despike_set_threshold(struct ocean_despike *ds, double sigmas, double floor);
+
+/* Cleans @data in place, returns the number of replaced pixels */
+int ocean_despike_apply(struct ocean_despike *ds, double *data, size_t len);
+/* Cleans the data of @spec, the count goes to its stats */
+int ocean_despike_process(struct ocean_despike *ds, struct ocean_spectra *spec);
+
+/* Clean every frame of ocean_request_spectra() before it is handed to the
+ * automatic exposure and the publisher, an accumulator fed with the frames
+ * averages the cleaned data. NULL stops. */
+int ocean_set_despike(struct ocean *ctx, struct ocean_despike *ds);
+
+
+/* Savitzky-Golay filters
+ *
+ * Smooths the data, or takes its derivative, by fitting a polynomial of
+ * @order to the @window (odd, 3 to 101) pixels around every pixel. The
+ * pixels closer to the edges than half a window are fitted by the first
+ * or the last window. Derivatives are per pixel. */
+struct ocean_savgol;
+
+/* @deriv is 0 for smoothing, 1 or 2 for the first or second derivative,
+ * @order at most 8 */
+int ocean_savgol_create(struct ocean_savgol **sg, struct ocean_spectra *spec,
+			unsigned window, unsigned order, unsigned deriv);
+void ocean_savgol_free(struct ocean_savgol *sg);
+/* The weights for the inner pixels, @len of them */
+const double *ocean_savgol_get_coefficients(struct ocean_savgol *sg, size_t *len);
+
+/* @in and @out may be the same */
+int ocean_savgol_apply(struct ocean_savgol *sg, const double *in, double *out, size_t len);
+int ocean_savgol_apply_inplace(struct ocean_savgol *sg, double *data, size_t len);
+/* Filters the data of @spec in place, its stats follow except for the
+ * saturated pixels */
+int ocean_savgol_process(struct ocean_savgol *sg, struct ocean_spectra *spec);
+
+/* Filter every frame of ocean_request_spectra() right after decoding it,
+ * after the spike rejection, NULL stops. The automatic exposure sees the
+ * filtered data, so use it with smoothing only. */
+int ocean_set_savgol(struct ocean *ctx, struct ocean_savgol *sg);
+
+
+/* Drift tracking
+ *
+ * Measures how far the frames moved along the pixels against a reference
+ * frame, by cross-correlation of the whole frame or of selected bands,
+ * interpolated to a fraction of a pixel. Few lags are correlated
+ * directly, many through an FFT. */
+struct ocean_drift;
+
+enum ocean_drift_method {
+	/* whichever is cheaper for the size and the lags */
+	OCEAN_DRIFT_AUTO = 0,
+	OCEAN_DRIFT_DIRECT,
+	OCEAN_DRIFT_FFT,
+};
+
+struct ocean_drift_result {
+	/* the frame is the reference moved by this many pixels */
+	double shift;
+	/* the same in nm, at the center of the compared pixels */
+	double shift_nm;
+	/* normalized correlation at the peak, 1 is a perfect match */
+	double correlation;
+};
+
+/* Shifts up to @max_shift pixels (at most a quarter of the frame) are
+ * found, the wavelengths come from the calibration of @reference */
+int ocean_drift_create(struct ocean_drift **drift, struct ocean_spectra *reference,
+		       unsigned max_shift);
+void ocean_drift_free(struct ocean_drift *drift);
+int ocean_drift_set_reference(struct ocean_drift *drift, struct ocean_spectra *reference);
+/* Compare only the pixels within the bands, in nm; no bands for all */
+int ocean_drift_set_bands(struct ocean_drift *drift, const double *lower,
+			  const double *upper, size_t num_bands);
+int ocean_drift_set_method(struct ocean_drift *drift, enum ocean_drift_method method);
+
+int ocean_drift_measure(struct ocean_drift *drift, const double *data, size_t len,
+			struct ocean_drift_result *result);
+int ocean_drift_update(struct ocean_drift *drift, struct ocean_spectra *spec,
+		       struct ocean_drift_result *result);
+
+
+/* Spectra pool
+ *
+ * Preallocated spectra sharing the calibration of one device, so taking
+ * frames does not allocate anything once the pool exists. */
+struct ocean_spectra_pool;
+
+enum ocean_pool_flags {
+	/* back the pool by huge pages if there are any */
+	OCEAN_POOL_HUGEPAGES = 1 << 0,
+};
+
+/* @count spectra shaped and calibrated like the device of @ctx */
+int ocean_spectra_pool_create(struct ocean_spectra_pool **pool, struct ocean *ctx,
+			      unsigned count, unsigned flags);
+/* Every acquired spectra has to be released before */
+void ocean_spectra_pool_free(struct ocean_spectra_pool *pool);
+/* Returns -EAGAIN if all of them are in use, else a spectra with one
+ * reference */
+int ocean_spectra_acquire(struct ocean_spectra_pool *pool, struct ocean_spectra **spec);
+/* One more reference to @spec, taken by a holder of one. While there is
+ * more than one the frame is shared and immutable, requesting a frame
+ * into it returns -EBUSY. */
+int ocean_spectra_ref(struct ocean_spectra *spec);
+/* Drops a reference, the last one hands @spec back to its pool.
+ * ocean_spectra_free() does the same. */
+void ocean_spectra_release(struct ocean_spectra *spec);
+unsigned ocean_spectra_pool_get_available(struct ocean_spectra_pool *pool);
+
+
+/* Frame fan-out
+ *
+ * Hands each frame to several consumers of the process without copying
+ * it: all of them get a reference to the same spectra of a pool and
+ * release it when done. Every consumer has a queue of its own depth and
+ * its own policy for when it falls behind. */
+struct ocean_fanout;
+struct ocean_consumer;
+
+enum ocean_backpressure {
+	/* the new frame is not queued, e.g. for a display */
+	OCEAN_DROP_NEWEST = 0,
+	/* the oldest queued frame makes room, e.g. for a controller */
+	OCEAN_DROP_OLDEST,
+	/* publishing waits for room, e.g. for a recorder */
+	OCEAN_BLOCK,
+};
+
+int ocean_fanout_create(struct ocean_fanout **fo);
+/* Every consumer has to be unsubscribed before */
+void ocean_fanout_free(struct ocean_fanout *fo);
+int ocean_fanout_subscribe(struct ocean_fanout *fo, struct ocean_consumer **consumer,
+			   unsigned depth, enum ocean_backpressure policy);
+/* Releases the frames still queued for @consumer, which must not wait in
+ * ocean_consumer_next() meanwhile */
+void ocean_fanout_unsubscribe(struct ocean_fanout *fo, struct ocean_consumer *consumer);
+/* Queues @spec, a spectra of a pool, for every consumer. The caller keeps
+ * its reference. */
+int ocean_fanout_publish(struct ocean_fanout *fo, struct ocean_spectra *spec);
+/* Takes a frame from @ctx into a spectra of @pool and publishes it,
+ * -EAGAIN if the pool is empty */
+int ocean_fanout_request(struct ocean_fanout *fo, struct ocean *ctx,
+			 struct ocean_spectra_pool *pool);
+
+/* The oldest queued frame, its reference is the consumer's to release.
+ * Waits up to @timeout ms, a negative @timeout forever, -EAGAIN if there
+ * is none. */
+int ocean_consumer_next(struct ocean_consumer *consumer, struct ocean_spectra **spec,
+			int timeout);
+/* Frames the consumer lost to its policy */
+uint64_t ocean_consumer_get_dropped(struct ocean_consumer *consumer);
+
+
+/* Batches of frames
+ *
+ * Collects frames in one matrix, frame after frame, 64 byte aligned, and
+ * their information column by column. */
+struct ocean_batch;
+
+/* Room for @capacity frames shaped like @spec */
+int ocean_batch_create(struct ocean_batch **batch, struct ocean_spectra *spec,
+		       size_t capacity);
+/* Exported arrays keep the data alive until they are released */
+void ocean_batch_free(struct ocean_batch *batch);
+
+/* Copies the data and information of the last frame, -ENOSPC when full */
+int ocean_batch_append(struct ocean_batch *batch, struct ocean_spectra *spec);
+/* Start over, -EBUSY as long as exported arrays are alive */
+int ocean_batch_clear(struct ocean_batch *batch);
+
+/* Number of frames in the batch */
+size_t ocean_batch_get_size(struct ocean_batch *batch);
+size_t ocean_batch_get_capacity(struct ocean_batch *batch);
+size_t ocean_batch_get_num_of_pixels(struct ocean_batch *batch);
+/* Frames x pixels, row major */
+double *ocean_batch_get_data(struct ocean_batch *batch);
+const double *ocean_batch_get_wavelength(struct ocean_batch *batch);
+uint64_t ocean_batch_get_sequence(struct ocean_batch *batch, size_t frame);
+uint64_t ocean_batch_get_timestamp(struct ocean_batch *batch, size_t frame);
+uint32_t ocean_batch_get_integration_time(struct ocean_batch *batch, size_t frame);
+/* The step of the acquisition plan which took the frame, 0 otherwise */
+uint32_t ocean_batch_get_step(struct ocean_batch *batch, size_t frame);
+
+/* Acquire @n frames back to back and append them to @batch, the next
+ * request is sent before the previous frame arrived. @spec provides the
+ * calibration and holds the last frame afterwards. */
+int ocean_request_spectra_batch(struct ocean *ctx, struct ocean_spectra *spec,
+				size_t n, struct ocean_batch *batch);
+
+
+/* Acquisition plans
+ *
+ * A sequence of steps, each one a few frames at its own settings, run in
+ * one call: the settings of a step are sent right behind the requests of
+ * the previous one, the pipeline never drains. The sequence may be
+ * repeated, two steps with and without the strobe interleave dark and
+ * light frames. */
+struct ocean_plan_step {
+	uint32_t integration_time;
+	/* the lamp on the strobe output, off for dark frames */
+	bool strobe;
+	/* each frame waits for the trigger, see ocean_set_trigger_timeout() */
+	bool external_trigger;
+	/* frames taken at these settings */
+	unsigned frames;
+};
+
+struct ocean_plan;
+
+int ocean_plan_create(struct ocean_plan **plan);
+void ocean_plan_free(struct ocean_plan *plan);
+/* Returns the number of the step, counting from 0 */
+int ocean_plan_add_step(struct ocean_plan *plan, const struct ocean_plan_step *step);
+/* Runs the sequence @count times, once by default */
+int ocean_plan_set_repeat(struct ocean_plan *plan, unsigned count);
+/* The frames of a run */
+size_t ocean_plan_get_num_of_frames(struct ocean_plan *plan);
+
+/* Appends the frames of @plan to @batch, tagged with their step, see
+ * ocean_batch_get_step(). The settings from before are restored
+ * afterwards, the automatic exposure sits the plan out. @spec provides
+ * the calibration and holds the last frame. */
+int ocean_plan_run(struct ocean *ctx, struct ocean_plan *plan, struct ocean_spectra *spec,
+		   struct ocean_batch *batch);
+
+
+/* High dynamic range
+ *
+ * Takes a frame at each of two or more integration times, back to back
+ * through an acquisition plan, and merges them per pixel into one frame
+ * in counts per ms. Every exposure below the saturation limit takes
+ * part, weighted with its integration time, so the long ones decide
+ * wherever they did not clip. A pixel clipped in every exposure comes
+ * from the shortest one. One merged frame per cycle through all the
+ * integration times, not one per longest exposure. */
+struct ocean_hdr;
+
+/* Up to 8 @times, for frames shaped like @spec */
+int ocean_hdr_create(struct ocean_hdr **hdr, struct ocean_spectra *spec,
+		     const uint32_t *times, size_t num_times);
+void ocean_hdr_free(struct ocean_hdr *hdr);
+/* Fraction of the saturation level from which an exposure is left out
+ * (default 0.95) */
+int ocean_hdr_set_limit(struct ocean_hdr *hdr, double limit);
+/* The intensity of a readout without exposure, subtracted before the
+ * frames are normalized (default 0) */
+int ocean_hdr_set_offset(struct ocean_hdr *hdr, double offset);
+/* The lamp on the strobe output during the frames (default off) */
+int ocean_hdr_set_strobe(struct ocean_hdr *hdr, bool enable);
+
+/* Merges @frames, one row per integration time in ascending order, into
+ * @out. Returns the number of pixels clipped in every exposure. */
+int ocean_hdr_merge(struct ocean_hdr *hdr, const double *frames, double saturation,
+		    double *out);
+/* Takes the frames and merges them, @spec holds the last frame */
+int ocean_hdr_request(struct ocean_hdr *hdr, struct ocean *ctx, struct ocean_spectra *spec);
+/* The last merged frame in counts per ms */
+const double *ocean_hdr_get_data(struct ocean_hdr *hdr);
+/* Pixels clipped in every exposure of the last merged frame */
+size_t ocean_hdr_get_saturated(struct ocean_hdr *hdr);
+
+
+/* Arrow C data interface
+ *
+ * See https://arrow.apache.org/docs/format/CDataInterface.html, the
+ * structures are part of the ABI and may be defined by other headers. */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/* Export the batch as a record batch (struct array) without copying:
+ * sequence (uint64), timestamp (ns, UTC), integration_time (uint32) and
+ * intensity (fixed size list of float64, one entry per pixel). Frames
+ * appended later are not part of it. */
+int ocean_batch_export_arrow(struct ocean_batch *batch, struct ArrowArray *array,
+			     struct ArrowSchema *schema);
+/* The wavelength of each pixel (float64), shared by all frames */
+int ocean_batch_export_wavelength_arrow(struct ocean_batch *batch, struct ArrowArray *array,
+					struct ArrowSchema *schema);
+
+
 /* For testing */
 int ocean_dump_status(struct ocean *self, FILE *out);
 
@@ -0,0 +1,105 @@
+/*
+ * oceand.h
+ *
+ * Wire format of the oceand control socket
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdint.h>
+
+#ifndef OCEAND_H
+#define OCEAND_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OCEAND_SOCKET "/run/oceand.sock"
+#define OCEAND_VERSION 1
+
+/*
+ * Every message is a struct oceand_header followed by @length bytes of
+ * payload, in host byte order. All structures are a multiple of 8 bytes,
+ * so the doubles following them stay aligned.
+ *
+ * Each command is answered by a message of type (command | OCEAND_REPLY),
+ * its payload starts with a struct oceand_reply. Replies are sent in the
+ * order of the commands, OCEAND_FRAMES messages may come in between.
+ */
+enum oceand_type {
+	/* reply: struct oceand_info */
+	OCEAND_HELLO = 1,
+	/* reply: struct oceand_status */
+	OCEAND_GET_STATUS,
+	/* payload: uint32_t milliseconds */
+	OCEAND_SET_INTEGRATION_TIME,
+	/* payload: uint32_t, 0 disables */
+	OCEAND_ENABLE_STROB,
+	OCEAND_ENABLE_FAN,
+	OCEAND_ENABLE_EXTERNAL_TRIGGER,
+	/* reply: double wavelength[num_of_pixels] */
+	OCEAND_GET_WAVELENGTHS,
+	/* payload: uint32_t frames per OCEAND_FRAMES message */
+	OCEAND_SUBSCRIBE,
+	OCEAND_UNSUBSCRIBE,
+
+	/* sent to subscribers: struct oceand_frames, then for every frame
+	 * a struct oceand_frame followed by double data[num_of_pixels] */
+	OCEAND_FRAMES = 0x100,
+
+	OCEAND_REPLY = 0x8000,
+};
+
+struct oceand_header {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t length;
+};
+
+struct oceand_reply {
+	/* 0 or a negative errno */
+	int32_t result;
+	uint32_t reserved;
+};
+
+struct oceand_info {
+	uint32_t version;
+	uint32_t num_of_pixels;
+	char serial[32];
+};
+
+struct oceand_status {
+	float pcb;
+	float sink;
+	uint32_t integration_time;
+	uint32_t subscribers;
+	/* frames acquired since the start */
+	uint64_t frames;
+};
+
+struct oceand_frames {
+	uint32_t count;
+	uint32_t num_of_pixels;
+	/* frames this subscriber missed so far, it did not read fast enough */
+	uint64_t dropped;
+};
+
+struct oceand_frame {
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t integration_time;
+	/* enum ocean_frame_flags */
+	uint32_t flags;
+};
+
+/* largest command the daemon accepts */
+#define OCEAND_MAX_COMMAND 64
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* OCEAND_H */
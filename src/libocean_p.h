@@ -5,34 +5,21 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 
 #ifndef LIBOCEAN_PRIV_H
 #define LIBOCEAN_PRIV_H 1
 
-#ifndef ARRAY_SIZE
-#define ARRAY_SIZE(x) (sizeof(x) / sizeof (x[0]))
-#endif
+#include "libocean_util.h"
 
 #define EP_CMD_SEND 0
 #define EP_CMD_RECV 1
 #define EP_DATA_RECV 2
 #define EP_DATA_RECV2 3
 
-#if !defined(WIN32)
-#  if __GNUC__ >= 4
-#    define api_public __attribute__((visibility("default")))
-#    define api_private __attribute__((visibility("hidden")))
-#  else
-#    define api_public
-#    define api_private
-#  endif
-#else
-#  define api_public
-#  define api_private
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,7 +28,50 @@ struct ocean {
 	libusb_context *usb;
 	libusb_device_handle *dev;
 	uint8_t ep[4];
+	/* of the commands, the data transfers follow the frame time */
 	int timeout;
+	/* held for every exchange with the device */
+	pthread_mutex_t io;
+	/* a monitor waits for the device */
+	bool monitor_waiting;
+	/* host side copy of the device settings */
+	uint32_t integration_time;
+	bool external_trigger;
+	bool strobe;
+	bool fan;
+	/* ms to wait for a trigger, 0 waits forever */
+	uint32_t trigger_timeout;
+	/* to find the device again once it was replugged */
+	uint16_t vendor;
+	uint16_t product;
+	char serial[32];
+	bool reconnect;
+	bool hotplug;
+	libusb_hotplug_callback_handle hotplug_handle;
+	/* set by the hotplug callback and failed transfers, accessed atomically */
+	bool lost;
+	bool arrived;
+	/* the next frame is the first one after a reconnect */
+	bool reconnected;
+	/* number of frames received since ocean_open() */
+	uint64_t sequence;
+	struct ocean_publisher *publisher;
+	struct ocean_exposure *exposure;
+	struct ocean_despike *despike;
+	struct ocean_savgol *savgol;
+	/* allocated by ocean_set_realtime(), see OCEAN_RT_TRANSFERS */
+	struct ocean_pending *rt_pending;
+	size_t rt_raw_size;
+	uint64_t rt_last_arrival;
+	struct ocean_realtime rt;
+	/* see ocean_set_chunked_transfer(), receive into the spectra */
+	struct ocean_pending *chunks;
+	size_t num_chunks;
+	size_t chunk_size;
+	enum ocean_corrupt_policy corrupt_policy;
+	/* the frame just received is handed out flagged */
+	bool corrupt;
+	struct ocean_integrity_stats integrity;
 };
 
 struct ocean_spectra {
@@ -54,6 +84,29 @@ struct ocean_spectra {
 	double non_lin_coef[8];
 	int poly_order_non_lin;
 	uint16_t saturation;
+	/* information about the last frame */
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t integration_time;
+	uint32_t flags;
+	/* gathered while decoding the last frame */
+	struct ocean_spectra_stats stats;
+	uint64_t *saturation_map;
+	/* false for buffers of the caller */
+	bool own_raw;
+	bool own_data;
+	/* set if it was acquired from a pool */
+	struct ocean_spectra_pool *pool;
+};
+
+/* A frame decoded while it arrives, see ocean_decode_update() */
+struct ocean_decode {
+	/* the next raw byte and pixel */
+	size_t i;
+	size_t j;
+	double sum;
+	uint64_t bits;
+	struct ocean_spectra_stats stats;
 };
 
 struct ocean_status {
@@ -0,0 +1,129 @@
+#ifndef LIBOCEAN_UTIL_H
+#define LIBOCEAN_UTIL_H 1
+
+#include <libocean.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Helpers shared by the usb and the dummy implementation. Keep this free
+ * of any libusb dependency, libocean-dummy is built without it.
+ */
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof (x[0]))
+#endif
+
+#if !defined(WIN32)
+#  if __GNUC__ >= 4
+#    define api_public __attribute__((visibility("default")))
+#    define api_private __attribute__((visibility("hidden")))
+#  else
+#    define api_public
+#    define api_private
+#  endif
+#else
+#  define api_public
+#  define api_private
+#endif
+
+struct ocean;
+struct ocean_spectra;
+struct ocean_spectra_pool;
+struct ocean_housekeeping;
+
+/* Provided by each implementation for the spectra pool: the bytes a
+ * spectra shaped like @tmpl takes, building one with the calibration of
+ * @tmpl at @mem, and the pool a spectra belongs to */
+size_t ocean_spectra_footprint(struct ocean_spectra *tmpl);
+struct ocean_spectra *ocean_spectra_place(void *mem, struct ocean_spectra *tmpl,
+					  struct ocean_spectra_pool *pool);
+struct ocean_spectra_pool *ocean_spectra_pool_of(struct ocean_spectra *spec);
+
+/* Provided by the pool: true while @spec is handed to more than one
+ * holder, it must not change any more then */
+bool ocean_spectra_shared(struct ocean_spectra *spec);
+
+/* Provided by each implementation for the monitor: query the
+ * housekeeping values, in between two frames */
+int ocean_housekeeping_poll(struct ocean *ctx, struct ocean_housekeeping *hk);
+
+/* Provided by each implementation: the detector counts of the last frame,
+ * before any correction. Returns the number of pixels written. */
+size_t ocean_spectra_get_counts(struct ocean_spectra *spec, double *counts, size_t len);
+
+/* Provided by each implementation for the spike rejection: records the
+ * number of replaced pixels in the stats of @spec */
+void ocean_spectra_set_replaced(struct ocean_spectra *spec, size_t replaced);
+/* ... and the stats of the cleaned data */
+void ocean_spectra_set_stats(struct ocean_spectra *spec, const struct ocean_spectra_stats *stats);
+
+/* The layout of a NIRQuest frame, see ocean-integrity.c */
+enum ocean_frame_error {
+	OCEAN_FRAME_INTACT = 0,
+	/* fewer bytes than a frame */
+	OCEAN_FRAME_TRUNCATED,
+	/* a sync byte is not where it belongs */
+	OCEAN_FRAME_MISALIGNED,
+};
+
+/* The bytes a frame of @num_of_pixels takes on the bus */
+size_t ocean_frame_length(size_t num_of_pixels);
+/* Checks the @done bytes received for a frame */
+enum ocean_frame_error ocean_frame_check(const uint8_t *raw, size_t done,
+					 size_t num_of_pixels);
+/* Counts a checked frame, the counters may be read from other threads */
+void ocean_integrity_count(struct ocean_integrity_stats *stats, enum ocean_frame_error err);
+void ocean_integrity_get(struct ocean_integrity_stats *stats,
+			 struct ocean_integrity_stats *copy);
+
+/* The step taking frame @frame of a run, see ocean-plan.c. Sets @index to
+ * the number of the step. */
+const struct ocean_plan_step *ocean_plan_step_of(struct ocean_plan *plan, size_t frame,
+						 unsigned *index);
+/* Tags the last frame appended to @batch */
+void ocean_batch_set_step(struct ocean_batch *batch, uint32_t step);
+
+/* The real-time profile of the acquiring thread */
+struct ocean_realtime {
+	bool active;
+	struct ocean_realtime_stats stats;
+	uint64_t latency_sum;
+	/* a copy of the stats for other threads, behind a seqlock */
+	struct ocean_realtime_stats published;
+	uint32_t seq;
+	/* resource usage of the thread when the profile was entered */
+	long minflt;
+	long majflt;
+	long nivcsw;
+};
+
+/* Pins, schedules and locks the calling thread, see ocean_set_realtime() */
+int ocean_realtime_enter(struct ocean_realtime *rt, int cpu, int priority);
+/* Counts a frame which arrived @latency ns after it could have */
+void ocean_realtime_account(struct ocean_realtime *rt, uint64_t latency);
+/* From any thread, -ENODATA until the profile was entered */
+int ocean_realtime_get(struct ocean_realtime *rt, struct ocean_realtime_stats *stats);
+
+/* nanoseconds since the epoch, used to stamp the frames */
+static inline uint64_t ocean_timestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* nanoseconds of a clock which never jumps, for intervals */
+static inline uint64_t ocean_monotonic(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif /* LIBOCEAN_UTIL_H */
@@ -0,0 +1,260 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * Welford's update per pixel. All pixels see the same number of frames,
+ * so 1/n is shared and the update runs over whole vectors; the arrays are
+ * padded to full vectors, the padding accumulates zeros. Two accumulators
+ * are merged with the pairwise update of Chan et al.
+ */
+#define ACC_ALIGN 64
+#define ACC_LANES 2
+
+typedef double v2f64 __attribute__((vector_size(ACC_LANES * sizeof(double))));
+typedef int64_t v2i64 __attribute__((vector_size(ACC_LANES * sizeof(int64_t))));
+
+struct ocean_accumulator {
+	enum ocean_accumulator_source source;
+	size_t num_of_pixels;
+	size_t padded;
+	uint64_t count;
+	double *mean;
+	double *m2;
+	double *min;
+	double *max;
+	/* the frame being added, and the variance handed out */
+	double *values;
+	double *variance;
+};
+
+static inline v2f64 acc_select(v2i64 mask, v2f64 a, v2f64 b)
+{
+	return (v2f64)(((v2i64)a & mask) | ((v2i64)b & ~mask));
+}
+
+static double *ocean_accumulator_alloc(size_t len)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, ACC_ALIGN, len * sizeof(double)))
+		return NULL;
+	return ptr;
+}
+
+api_public
+int ocean_accumulator_create(struct ocean_accumulator **accp, struct ocean_spectra *spec,
+			     enum ocean_accumulator_source source)
+{
+	struct ocean_accumulator *acc;
+	size_t num_of_pixels;
+
+	if (!accp || !spec ||
+	    (source != OCEAN_ACCUMULATE_DATA && source != OCEAN_ACCUMULATE_COUNTS))
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == 0 || num_of_pixels == (size_t)-EINVAL)
+		return -EINVAL;
+
+	acc = malloc(sizeof(*acc));
+	if (!acc)
+		return -ENOMEM;
+	memset(acc, 0, sizeof(*acc));
+
+	acc->source = source;
+	acc->num_of_pixels = num_of_pixels;
+	acc->padded = (num_of_pixels + ACC_LANES - 1) & ~(size_t)(ACC_LANES - 1);
+
+	acc->mean = ocean_accumulator_alloc(acc->padded);
+	acc->m2 = ocean_accumulator_alloc(acc->padded);
+	acc->min = ocean_accumulator_alloc(acc->padded);
+	acc->max = ocean_accumulator_alloc(acc->padded);
+	acc->values = ocean_accumulator_alloc(acc->padded);
+	acc->variance = ocean_accumulator_alloc(acc->padded);
+	if (!acc->mean || !acc->m2 || !acc->min || !acc->max ||
+	    !acc->values || !acc->variance) {
+		ocean_accumulator_free(acc);
+		return -ENOMEM;
+	}
+
+	/* the padding stays zero from here on */
+	memset(acc->values, 0, acc->padded * sizeof(double));
+	ocean_accumulator_reset(acc);
+
+	*accp = acc;
+	return 0;
+}
+
+api_public
+void ocean_accumulator_free(struct ocean_accumulator *acc)
+{
+	if (!acc)
+		return;
+
+	free(acc->variance);
+	free(acc->values);
+	free(acc->max);
+	free(acc->min);
+	free(acc->m2);
+	free(acc->mean);
+	free(acc);
+}
+
+api_public
+void ocean_accumulator_reset(struct ocean_accumulator *acc)
+{
+	size_t i;
+
+	if (!acc)
+		return;
+
+	acc->count = 0;
+	memset(acc->mean, 0, acc->padded * sizeof(double));
+	memset(acc->m2, 0, acc->padded * sizeof(double));
+	for (i = 0; i < acc->padded; i++) {
+		acc->min[i] = HUGE_VAL;
+		acc->max[i] = -HUGE_VAL;
+	}
+}
+
+/* Adds the frame in acc->values */
+static void ocean_accumulator_update(struct ocean_accumulator *acc)
+{
+	const double scale = 1.0 / ++acc->count;
+	size_t i;
+
+	for (i = 0; i < acc->padded; i += ACC_LANES) {
+		const v2f64 x = *(const v2f64 *)&acc->values[i];
+		v2f64 *mean = (v2f64 *)&acc->mean[i];
+		v2f64 *m2 = (v2f64 *)&acc->m2[i];
+		v2f64 *min = (v2f64 *)&acc->min[i];
+		v2f64 *max = (v2f64 *)&acc->max[i];
+		const v2f64 delta = x - *mean;
+
+		*mean += delta * scale;
+		*m2 += delta * (x - *mean);
+		*min = acc_select(x < *min, x, *min);
+		*max = acc_select(x > *max, x, *max);
+	}
+}
+
+api_public
+int ocean_accumulator_add_values(struct ocean_accumulator *acc, const double *values,
+				 size_t len)
+{
+	if (!acc || !values || len != acc->num_of_pixels)
+		return -EINVAL;
+
+	memcpy(acc->values, values, len * sizeof(double));
+	ocean_accumulator_update(acc);
+	return 0;
+}
+
+api_public
+int ocean_accumulator_add(struct ocean_accumulator *acc, struct ocean_spectra *spec)
+{
+	const double *data;
+
+	if (!acc || !spec || ocean_spectra_get_size(spec) != acc->num_of_pixels)
+		return -EINVAL;
+
+	if (acc->source == OCEAN_ACCUMULATE_COUNTS) {
+		if (ocean_spectra_get_counts(spec, acc->values, acc->num_of_pixels) !=
+		    acc->num_of_pixels)
+			return -ENODATA;
+	} else {
+		data = ocean_spectra_get_data(spec);
+		if (!data)
+			return -EINVAL;
+		memcpy(acc->values, data, acc->num_of_pixels * sizeof(double));
+	}
+
+	ocean_accumulator_update(acc);
+	return 0;
+}
+
+api_public
+int ocean_accumulator_merge(struct ocean_accumulator *acc, const struct ocean_accumulator *other)
+{
+	double na, nb, fb, fab;
+	size_t i;
+
+	if (!acc || !other || acc == other || acc->num_of_pixels != other->num_of_pixels)
+		return -EINVAL;
+
+	if (other->count == 0)
+		return 0;
+
+	na = acc->count;
+	nb = other->count;
+	fb = nb / (na + nb);
+	fab = na * fb;
+
+	for (i = 0; i < acc->padded; i += ACC_LANES) {
+		v2f64 *mean = (v2f64 *)&acc->mean[i];
+		v2f64 *m2 = (v2f64 *)&acc->m2[i];
+		v2f64 *min = (v2f64 *)&acc->min[i];
+		v2f64 *max = (v2f64 *)&acc->max[i];
+		const v2f64 omin = *(const v2f64 *)&other->min[i];
+		const v2f64 omax = *(const v2f64 *)&other->max[i];
+		const v2f64 delta = *(const v2f64 *)&other->mean[i] - *mean;
+
+		*mean += delta * fb;
+		*m2 += *(const v2f64 *)&other->m2[i] + delta * delta * fab;
+		*min = acc_select(omin < *min, omin, *min);
+		*max = acc_select(omax > *max, omax, *max);
+	}
+
+	acc->count += other->count;
+	return 0;
+}
+
+api_public
+uint64_t ocean_accumulator_get_count(struct ocean_accumulator *acc)
+{
+	return acc ? acc->count : 0;
+}
+
+api_public
+size_t ocean_accumulator_get_num_of_pixels(struct ocean_accumulator *acc)
+{
+	return acc ? acc->num_of_pixels : 0;
+}
+
+api_public
+const double *ocean_accumulator_get_mean(struct ocean_accumulator *acc)
+{
+	return acc ? acc->mean : NULL;
+}
+
+api_public
+const double *ocean_accumulator_get_variance(struct ocean_accumulator *acc)
+{
+	const double scale = acc && acc->count > 1 ? 1.0 / (acc->count - 1) : 0.0;
+	size_t i;
+
+	if (!acc)
+		return NULL;
+
+	for (i = 0; i < acc->padded; i++)
+		acc->variance[i] = acc->m2[i] * scale;
+
+	return acc->variance;
+}
+
+api_public
+const double *ocean_accumulator_get_min(struct ocean_accumulator *acc)
+{
+	return acc ? acc->min : NULL;
+}
+
+api_public
+const double *ocean_accumulator_get_max(struct ocean_accumulator *acc)
+{
+	return acc ? acc->max : NULL;
+}
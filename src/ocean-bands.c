@@ -0,0 +1,211 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * Pixel i covers the fractional positions [i - 0.5, i + 0.5) and the
+ * wavelengths in between. A band bound is stored as the pixel it falls into
+ * plus the covered fraction of that pixel, so the integral up to the bound
+ * is prefix[pixel] + fraction * weighted[pixel].
+ */
+struct ocean_band_bound {
+	size_t pixel;
+	double fraction;
+};
+
+struct ocean_bands {
+	size_t num_of_pixels;
+	size_t num_of_bands;
+	/* width of each pixel in nm */
+	double *width;
+	/* running sum of intensity * width, num_of_pixels + 1 entries */
+	double *prefix;
+	struct ocean_band_bound *lower;
+	struct ocean_band_bound *upper;
+	double *first;
+	double *last;
+};
+
+/* find the fractional pixel of a wavelength, the calibration is monotonic */
+static double ocean_bands_find_pixel(struct ocean_spectra *spec, size_t num_of_pixels,
+				     double wavelength)
+{
+	double lo = -0.5, hi = num_of_pixels - 0.5;
+	const bool rising = ocean_spectra_get_wavelength_at(spec, hi) >=
+			    ocean_spectra_get_wavelength_at(spec, lo);
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		const double mid = 0.5 * (lo + hi);
+		const double wl = ocean_spectra_get_wavelength_at(spec, mid);
+
+		if ((wl < wavelength) == rising)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return 0.5 * (lo + hi);
+}
+
+static struct ocean_band_bound ocean_bands_bound(size_t num_of_pixels, double pos)
+{
+	struct ocean_band_bound bound;
+	double edge = pos + 0.5;
+
+	if (edge < 0.0)
+		edge = 0.0;
+	else if (edge > num_of_pixels)
+		edge = num_of_pixels;
+
+	bound.pixel = (size_t)edge;
+	bound.fraction = edge - bound.pixel;
+
+	/* the upper edge of the last pixel */
+	if (bound.pixel == num_of_pixels) {
+		bound.pixel--;
+		bound.fraction = 1.0;
+	}
+
+	return bound;
+}
+
+api_public
+void ocean_bands_free(struct ocean_bands *bands)
+{
+	if (!bands)
+		return;
+
+	free(bands->width);
+	free(bands->prefix);
+	free(bands->lower);
+	free(bands->upper);
+	free(bands->first);
+	free(bands->last);
+	free(bands);
+}
+
+api_public
+int ocean_bands_create(struct ocean_bands **bandsp, struct ocean_spectra *spec,
+		       const double *lower, const double *upper, size_t num_bands)
+{
+	struct ocean_bands *bands;
+	size_t n, i;
+
+	if (!bandsp || !spec || !lower || !upper || !num_bands)
+		return -EINVAL;
+
+	n = ocean_spectra_get_size(spec);
+	if (n == (size_t)-EINVAL || n == 0)
+		return -EINVAL;
+
+	for (i = 0; i < num_bands; i++) {
+		if (!(lower[i] <= upper[i]))
+			return -EINVAL;
+	}
+
+	bands = malloc(sizeof(*bands));
+	if (!bands)
+		return -ENOMEM;
+	memset(bands, 0, sizeof(*bands));
+
+	bands->num_of_pixels = n;
+	bands->num_of_bands = num_bands;
+	bands->width = malloc(n * sizeof(double));
+	bands->prefix = malloc((n + 1) * sizeof(double));
+	bands->lower = malloc(num_bands * sizeof(struct ocean_band_bound));
+	bands->upper = malloc(num_bands * sizeof(struct ocean_band_bound));
+	bands->first = malloc(num_bands * sizeof(double));
+	bands->last = malloc(num_bands * sizeof(double));
+	if (!bands->width || !bands->prefix || !bands->lower ||
+	    !bands->upper || !bands->first || !bands->last) {
+		ocean_bands_free(bands);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		bands->width[i] = fabs(ocean_spectra_get_wavelength_at(spec, i + 0.5) -
+				       ocean_spectra_get_wavelength_at(spec, i - 0.5));
+	}
+
+	for (i = 0; i < num_bands; i++) {
+		double a = ocean_bands_find_pixel(spec, n, lower[i]);
+		double b = ocean_bands_find_pixel(spec, n, upper[i]);
+
+		/* falling calibrations swap the bounds */
+		if (a > b) {
+			const double t = a;
+			a = b;
+			b = t;
+		}
+
+		bands->first[i] = a;
+		bands->last[i] = b;
+		bands->lower[i] = ocean_bands_bound(n, a);
+		bands->upper[i] = ocean_bands_bound(n, b);
+	}
+
+	*bandsp = bands;
+	return 0;
+}
+
+api_public
+size_t ocean_bands_get_size(struct ocean_bands *bands)
+{
+	return bands ? bands->num_of_bands : (size_t)-EINVAL;
+}
+
+api_public
+int ocean_bands_get_bounds(struct ocean_bands *bands, size_t band,
+			   double *first, double *last)
+{
+	if (!bands || band >= bands->num_of_bands || !first || !last)
+		return -EINVAL;
+
+	*first = bands->first[band];
+	*last = bands->last[band];
+	return 0;
+}
+
+api_public
+int ocean_bands_integrate(struct ocean_bands *bands, struct ocean_spectra *spec,
+			  double *result)
+{
+	const double *data;
+	const double *width;
+	double *prefix;
+	double sum = 0.0;
+	size_t i;
+
+	if (!bands || !spec || !result)
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(spec);
+	if (!data || ocean_spectra_get_size(spec) != bands->num_of_pixels)
+		return -EINVAL;
+
+	width = bands->width;
+	prefix = bands->prefix;
+
+	prefix[0] = 0.0;
+	for (i = 0; i < bands->num_of_pixels; i++) {
+		sum += data[i] * width[i];
+		prefix[i + 1] = sum;
+	}
+
+	for (i = 0; i < bands->num_of_bands; i++) {
+		const struct ocean_band_bound *lo = &bands->lower[i];
+		const struct ocean_band_bound *hi = &bands->upper[i];
+
+		result[i] = (prefix[hi->pixel] +
+			     hi->fraction * data[hi->pixel] * width[hi->pixel]) -
+			    (prefix[lo->pixel] +
+			     lo->fraction * data[lo->pixel] * width[lo->pixel]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,431 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+#define BATCH_ALIGN 64
+
+/*
+ * Frames are stored row by row in one matrix, the information of the
+ * frames column by column. That is the layout of an Arrow record batch,
+ * the export hands out the arrays as they are.
+ *
+ * Every exported Arrow array and schema node holds a reference, the
+ * batch goes away once the owner freed it and every consumer released
+ * what it imported.
+ */
+struct ocean_batch {
+	unsigned refs;
+	/* references held by exported arrays */
+	unsigned exported;
+	size_t capacity;
+	size_t size;
+	size_t num_of_pixels;
+	double *data;
+	double *wavelength;
+	uint64_t *sequence;
+	uint64_t *timestamp;
+	uint32_t *integration_time;
+	uint32_t *step;
+};
+
+static void *ocean_batch_alloc(size_t len)
+{
+	void *ptr;
+
+	/* posix_memalign() does not like 0 */
+	if (posix_memalign(&ptr, BATCH_ALIGN, len ? len : BATCH_ALIGN))
+		return NULL;
+	return ptr;
+}
+
+static void ocean_batch_put(struct ocean_batch *batch)
+{
+	if (__atomic_sub_fetch(&batch->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	free(batch->step);
+	free(batch->integration_time);
+	free(batch->timestamp);
+	free(batch->sequence);
+	free(batch->wavelength);
+	free(batch->data);
+	free(batch);
+}
+
+static void ocean_batch_get(struct ocean_batch *batch)
+{
+	__atomic_add_fetch(&batch->refs, 1, __ATOMIC_RELAXED);
+}
+
+api_public
+int ocean_batch_create(struct ocean_batch **batchp, struct ocean_spectra *spec,
+		       size_t capacity)
+{
+	struct ocean_batch *batch;
+	size_t num_of_pixels, i;
+
+	if (!batchp || !spec || capacity == 0)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == (size_t)-EINVAL ||
+	    capacity > SIZE_MAX / sizeof(double) / (num_of_pixels ? num_of_pixels : 1))
+		return -EINVAL;
+
+	batch = malloc(sizeof(*batch));
+	if (!batch)
+		return -ENOMEM;
+	memset(batch, 0, sizeof(*batch));
+
+	batch->refs = 1;
+	batch->capacity = capacity;
+	batch->num_of_pixels = num_of_pixels;
+
+	batch->data = ocean_batch_alloc(capacity * num_of_pixels * sizeof(double));
+	batch->wavelength = ocean_batch_alloc(num_of_pixels * sizeof(double));
+	batch->sequence = ocean_batch_alloc(capacity * sizeof(uint64_t));
+	batch->timestamp = ocean_batch_alloc(capacity * sizeof(uint64_t));
+	batch->integration_time = ocean_batch_alloc(capacity * sizeof(uint32_t));
+	batch->step = ocean_batch_alloc(capacity * sizeof(uint32_t));
+	if (!batch->data || !batch->wavelength || !batch->sequence ||
+	    !batch->timestamp || !batch->integration_time || !batch->step) {
+		ocean_batch_put(batch);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < num_of_pixels; i++)
+		batch->wavelength[i] = ocean_spectra_get_wavelength(spec, i);
+
+	*batchp = batch;
+	return 0;
+}
+
+api_public
+void ocean_batch_free(struct ocean_batch *batch)
+{
+	if (!batch)
+		return;
+
+	ocean_batch_put(batch);
+}
+
+api_public
+int ocean_batch_append(struct ocean_batch *batch, struct ocean_spectra *spec)
+{
+	const double *data;
+	size_t i;
+
+	if (!batch || !spec)
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(spec);
+	if (!data || ocean_spectra_get_size(spec) != batch->num_of_pixels)
+		return -EINVAL;
+
+	if (batch->size == batch->capacity)
+		return -ENOSPC;
+
+	i = batch->size++;
+	memcpy(batch->data + i * batch->num_of_pixels, data,
+	       batch->num_of_pixels * sizeof(double));
+	batch->sequence[i] = ocean_spectra_get_sequence(spec);
+	batch->timestamp[i] = ocean_spectra_get_timestamp(spec);
+	batch->integration_time[i] = ocean_spectra_get_integration_time(spec);
+	batch->step[i] = 0;
+
+	return 0;
+}
+
+api_private
+void ocean_batch_set_step(struct ocean_batch *batch, uint32_t step)
+{
+	if (batch->size)
+		batch->step[batch->size - 1] = step;
+}
+
+api_public
+int ocean_batch_clear(struct ocean_batch *batch)
+{
+	if (!batch)
+		return -EINVAL;
+
+	/* the exported frames would be overwritten */
+	if (__atomic_load_n(&batch->exported, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+
+	batch->size = 0;
+	return 0;
+}
+
+api_public
+size_t ocean_batch_get_size(struct ocean_batch *batch)
+{
+	return batch ? batch->size : 0;
+}
+
+api_public
+size_t ocean_batch_get_capacity(struct ocean_batch *batch)
+{
+	return batch ? batch->capacity : 0;
+}
+
+api_public
+size_t ocean_batch_get_num_of_pixels(struct ocean_batch *batch)
+{
+	return batch ? batch->num_of_pixels : 0;
+}
+
+api_public
+double *ocean_batch_get_data(struct ocean_batch *batch)
+{
+	return batch ? batch->data : NULL;
+}
+
+api_public
+const double *ocean_batch_get_wavelength(struct ocean_batch *batch)
+{
+	return batch ? batch->wavelength : NULL;
+}
+
+api_public
+uint64_t ocean_batch_get_sequence(struct ocean_batch *batch, size_t frame)
+{
+	return (batch && frame < batch->size) ? batch->sequence[frame] : 0;
+}
+
+api_public
+uint64_t ocean_batch_get_timestamp(struct ocean_batch *batch, size_t frame)
+{
+	return (batch && frame < batch->size) ? batch->timestamp[frame] : 0;
+}
+
+api_public
+uint32_t ocean_batch_get_integration_time(struct ocean_batch *batch, size_t frame)
+{
+	return (batch && frame < batch->size) ? batch->integration_time[frame] : 0;
+}
+
+api_public
+uint32_t ocean_batch_get_step(struct ocean_batch *batch, size_t frame)
+{
+	return (batch && frame < batch->size) ? batch->step[frame] : 0;
+}
+
+/*
+ * Arrow C data interface
+ *
+ * Each node of the exported tree is released on its own, a consumer may
+ * move children out of their parent. So every node keeps the storage of
+ * its children and its own reference to the batch.
+ */
+#define ARROW_MAX_CHILDREN 4
+
+struct ocean_arrow_array {
+	struct ocean_batch *batch;
+	const void *buffers[2];
+	struct ArrowArray *children[ARROW_MAX_CHILDREN];
+	struct ArrowArray child[ARROW_MAX_CHILDREN];
+};
+
+struct ocean_arrow_schema {
+	struct ocean_batch *batch;
+	char format[32];
+	struct ArrowSchema *children[ARROW_MAX_CHILDREN];
+	struct ArrowSchema child[ARROW_MAX_CHILDREN];
+};
+
+static void ocean_arrow_array_release(struct ArrowArray *array)
+{
+	struct ocean_arrow_array *priv = array->private_data;
+	int64_t i;
+
+	for (i = 0; i < array->n_children; i++)
+		if (array->children[i]->release)
+			array->children[i]->release(array->children[i]);
+
+	__atomic_sub_fetch(&priv->batch->exported, 1, __ATOMIC_RELEASE);
+	ocean_batch_put(priv->batch);
+	free(priv);
+	array->release = NULL;
+}
+
+static void ocean_arrow_schema_release(struct ArrowSchema *schema)
+{
+	struct ocean_arrow_schema *priv = schema->private_data;
+	int64_t i;
+
+	for (i = 0; i < schema->n_children; i++)
+		if (schema->children[i]->release)
+			schema->children[i]->release(schema->children[i]);
+
+	ocean_batch_put(priv->batch);
+	free(priv);
+	schema->release = NULL;
+}
+
+/* An array of @length values in @values, or a nested one if @values is NULL */
+static int ocean_arrow_array_init(struct ArrowArray *array, struct ocean_batch *batch,
+				  int64_t length, const void *values, int64_t n_children)
+{
+	struct ocean_arrow_array *priv;
+	int64_t i;
+
+	priv = malloc(sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+	memset(priv, 0, sizeof(*priv));
+
+	priv->batch = batch;
+	ocean_batch_get(batch);
+	__atomic_add_fetch(&batch->exported, 1, __ATOMIC_RELAXED);
+
+	/* no validity bitmap, nothing is null */
+	priv->buffers[0] = NULL;
+	priv->buffers[1] = values;
+	for (i = 0; i < n_children; i++)
+		priv->children[i] = &priv->child[i];
+
+	memset(array, 0, sizeof(*array));
+	array->length = length;
+	array->n_buffers = values ? 2 : 1;
+	array->n_children = n_children;
+	array->buffers = priv->buffers;
+	array->children = n_children ? priv->children : NULL;
+	array->release = ocean_arrow_array_release;
+	array->private_data = priv;
+	return 0;
+}
+
+static int ocean_arrow_schema_init(struct ArrowSchema *schema, struct ocean_batch *batch,
+				   const char *format, const char *name, int64_t n_children)
+{
+	struct ocean_arrow_schema *priv;
+	int64_t i;
+
+	priv = malloc(sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+	memset(priv, 0, sizeof(*priv));
+
+	priv->batch = batch;
+	ocean_batch_get(batch);
+
+	snprintf(priv->format, sizeof(priv->format), "%s", format);
+	for (i = 0; i < n_children; i++)
+		priv->children[i] = &priv->child[i];
+
+	memset(schema, 0, sizeof(*schema));
+	schema->format = priv->format;
+	/* the names are string literals */
+	schema->name = name;
+	schema->n_children = n_children;
+	schema->children = n_children ? priv->children : NULL;
+	schema->release = ocean_arrow_schema_release;
+	schema->private_data = priv;
+	return 0;
+}
+
+/* Releases whatever was initialized of a partially exported tree */
+static void ocean_arrow_cleanup(struct ArrowArray *array, struct ArrowSchema *schema)
+{
+	if (array && array->release)
+		array->release(array);
+	if (schema && schema->release)
+		schema->release(schema);
+}
+
+api_public
+int ocean_batch_export_arrow(struct ocean_batch *batch, struct ArrowArray *array,
+			     struct ArrowSchema *schema)
+{
+	struct ArrowSchema *field;
+	struct ArrowArray *column;
+	char format[32];
+	int ret;
+
+	if (!batch || !array || !schema)
+		return -EINVAL;
+
+	/* children start out released, the cleanup skips them */
+	memset(array, 0, sizeof(*array));
+	memset(schema, 0, sizeof(*schema));
+
+	ret = ocean_arrow_array_init(array, batch, batch->size, NULL, 4);
+	if (ret < 0)
+		goto err;
+
+	ret = ocean_arrow_schema_init(schema, batch, "+s", "", 4);
+	if (ret < 0)
+		goto err;
+
+	column = array->children[0];
+	field = schema->children[0];
+	ret = ocean_arrow_array_init(column, batch, batch->size, batch->sequence, 0);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(field, batch, "L", "sequence", 0);
+	if (ret < 0)
+		goto err;
+
+	column = array->children[1];
+	field = schema->children[1];
+	ret = ocean_arrow_array_init(column, batch, batch->size, batch->timestamp, 0);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(field, batch, "tsn:UTC", "timestamp", 0);
+	if (ret < 0)
+		goto err;
+
+	column = array->children[2];
+	field = schema->children[2];
+	ret = ocean_arrow_array_init(column, batch, batch->size, batch->integration_time, 0);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(field, batch, "I", "integration_time", 0);
+	if (ret < 0)
+		goto err;
+
+	/* fixed size list of the pixels, the values are the whole matrix */
+	snprintf(format, sizeof(format), "+w:%zu", batch->num_of_pixels);
+	column = array->children[3];
+	field = schema->children[3];
+	ret = ocean_arrow_array_init(column, batch, batch->size, NULL, 1);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(field, batch, format, "intensity", 1);
+	if (ret < 0)
+		goto err;
+
+	ret = ocean_arrow_array_init(column->children[0], batch,
+				     batch->size * batch->num_of_pixels, batch->data, 0);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(field->children[0], batch, "g", "item", 0);
+	if (ret < 0)
+		goto err;
+
+	return 0;
+
+err:
+	ocean_arrow_cleanup(array, schema);
+	return ret;
+}
+
+api_public
+int ocean_batch_export_wavelength_arrow(struct ocean_batch *batch, struct ArrowArray *array,
+					struct ArrowSchema *schema)
+{
+	int ret;
+
+	if (!batch || !array || !schema)
+		return -EINVAL;
+
+	memset(array, 0, sizeof(*array));
+	memset(schema, 0, sizeof(*schema));
+
+	ret = ocean_arrow_array_init(array, batch, batch->num_of_pixels, batch->wavelength, 0);
+	if (ret == 0)
+		ret = ocean_arrow_schema_init(schema, batch, "g", "wavelength", 0);
+	if (ret < 0)
+		ocean_arrow_cleanup(array, schema);
+
+	return ret;
+}
@@ -0,0 +1,503 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * Encoded frame:
+ *
+ *   magic, flags, frame size (32 bit little endian)
+ *   one block per 128 samples: width | predictor, 16 * width bytes
+ *   the last byte of odd sized frames, verbatim
+ *
+ * Every block stores the zigzag coded residuals of either the spatial
+ * (x[i] - x[i-1]) or the temporal (x[i] - previous[i]) prediction, which
+ * ever needs less bits. The residuals are packed in 8 interleaved 16 bit
+ * lanes, so packing and unpacking are plain vector shifts.
+ */
+#define CODEC_MAGIC 0xc5
+#define CODEC_KEY_FRAME 0x01
+#define CODEC_TEMPORAL 0x80
+#define CODEC_WIDTH_MASK 0x1f
+#define CODEC_HEADER_SIZE 6
+
+#define CODEC_LANES 8
+#define CODEC_ROWS 16
+#define CODEC_BLOCK (CODEC_LANES * CODEC_ROWS)
+/* leading zeros in front of the samples, the left neighbour of pixel 0 */
+#define CODEC_PAD CODEC_LANES
+
+#define DEFAULT_KEY_INTERVAL 64
+
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef int16_t v8i16 __attribute__((vector_size(16)));
+
+struct ocean_codec {
+	size_t frame_size;
+	size_t num_samples;
+	size_t num_blocks;
+	/* samples of the current and the previous frame, CODEC_PAD in */
+	uint16_t *buf[2];
+	uint16_t *cur;
+	uint16_t *prev;
+	bool have_prev;
+};
+
+struct ocean_encoder {
+	struct ocean_codec codec;
+	unsigned key_interval;
+	unsigned since_key;
+};
+
+struct ocean_decoder {
+	struct ocean_codec codec;
+};
+
+static inline v8u16 ocean_codec_load(const uint16_t *src)
+{
+	v8u16 v;
+
+	memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+static inline void ocean_codec_store(uint8_t *dst, v8u16 v)
+{
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+	v = (v << 8) | (v >> 8);
+#endif
+	memcpy(dst, &v, sizeof(v));
+}
+
+static inline v8u16 ocean_codec_fetch(const uint8_t *src)
+{
+	v8u16 v;
+
+	memcpy(&v, src, sizeof(v));
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+	v = (v << 8) | (v >> 8);
+#endif
+	return v;
+}
+
+static inline v8u16 ocean_codec_zigzag(v8u16 v)
+{
+	return (v << 1) ^ (v8u16)((v8i16)v >> 15);
+}
+
+static inline v8u16 ocean_codec_unzigzag(v8u16 v)
+{
+	return (v >> 1) ^ -(v & 1);
+}
+
+static inline unsigned ocean_codec_width(v8u16 v)
+{
+	unsigned m = 0;
+	int i;
+
+	for (i = 0; i < CODEC_LANES; i++)
+		m |= v[i];
+
+	return m ? 32 - __builtin_clz(m) : 0;
+}
+
+static int ocean_codec_init(struct ocean_codec *codec, size_t frame_size)
+{
+	size_t len;
+	int i;
+
+	memset(codec, 0, sizeof(*codec));
+
+	codec->frame_size = frame_size;
+	codec->num_samples = frame_size / 2;
+	codec->num_blocks = (codec->num_samples + CODEC_BLOCK - 1) / CODEC_BLOCK;
+
+	len = CODEC_PAD + codec->num_blocks * CODEC_BLOCK;
+	for (i = 0; i < 2; i++) {
+		codec->buf[i] = calloc(len, sizeof(uint16_t));
+		if (!codec->buf[i])
+			return -ENOMEM;
+	}
+
+	codec->cur = codec->buf[0] + CODEC_PAD;
+	codec->prev = codec->buf[1] + CODEC_PAD;
+	return 0;
+}
+
+static void ocean_codec_release(struct ocean_codec *codec)
+{
+	free(codec->buf[0]);
+	free(codec->buf[1]);
+}
+
+static void ocean_codec_swap(struct ocean_codec *codec)
+{
+	uint16_t *tmp = codec->prev;
+
+	codec->prev = codec->cur;
+	codec->cur = tmp;
+	codec->have_prev = true;
+}
+
+/* the last block is padded with the last sample, its residuals are zero */
+static void ocean_codec_read_frame(struct ocean_codec *codec, const uint8_t *frame)
+{
+	const size_t n = codec->num_samples;
+	const size_t end = codec->num_blocks * CODEC_BLOCK;
+	uint16_t *cur = codec->cur;
+	size_t i;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(cur, frame, n * 2);
+#else
+	for (i = 0; i < n; i++)
+		cur[i] = frame[2 * i] | (frame[2 * i + 1] << 8);
+#endif
+	for (i = n; i < end; i++)
+		cur[i] = n ? cur[n - 1] : 0;
+}
+
+static void ocean_codec_write_frame(struct ocean_codec *codec, uint8_t *frame)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(frame, codec->cur, codec->num_samples * 2);
+#else
+	size_t i;
+
+	for (i = 0; i < codec->num_samples; i++) {
+		frame[2 * i] = codec->cur[i] & 0xff;
+		frame[2 * i + 1] = codec->cur[i] >> 8;
+	}
+#endif
+}
+
+static uint8_t *ocean_codec_pack(uint8_t *out, const v8u16 *in, unsigned width)
+{
+	v8u16 acc = { 0 };
+	unsigned shift = 0;
+	int r;
+
+	for (r = 0; r < CODEC_ROWS; r++) {
+		acc |= in[r] << shift;
+		shift += width;
+		if (shift >= 16) {
+			ocean_codec_store(out, acc);
+			out += sizeof(acc);
+			shift -= 16;
+			acc = shift ? in[r] >> (width - shift) : (v8u16){ 0 };
+		}
+	}
+
+	return out;
+}
+
+static void ocean_codec_unpack(v8u16 *out, const uint8_t *in, unsigned width)
+{
+	const v8u16 mask = (v8u16){ 0 } + (uint16_t)((1u << width) - 1);
+	unsigned shift = 0;
+	v8u16 word;
+	int r;
+
+	if (width == 0) {
+		memset(out, 0, CODEC_ROWS * sizeof(*out));
+		return;
+	}
+
+	word = ocean_codec_fetch(in);
+	in += sizeof(word);
+
+	for (r = 0; r < CODEC_ROWS; r++) {
+		v8u16 v = word >> shift;
+
+		shift += width;
+		if (shift > 16) {
+			word = ocean_codec_fetch(in);
+			in += sizeof(word);
+			shift -= 16;
+			v |= word << (width - shift);
+		} else if (shift == 16) {
+			if (r + 1 < CODEC_ROWS) {
+				word = ocean_codec_fetch(in);
+				in += sizeof(word);
+			}
+			shift = 0;
+		}
+
+		out[r] = v & mask;
+	}
+}
+
+static uint8_t *ocean_codec_encode_block(uint8_t *out, const uint16_t *cur,
+					 const uint16_t *prev, bool temporal)
+{
+	v8u16 spatial[CODEC_ROWS], delta[CODEC_ROWS];
+	v8u16 any_spatial = { 0 }, any_delta = { 0 };
+	unsigned ws, wt = 17;
+	int r;
+
+	for (r = 0; r < CODEC_ROWS; r++) {
+		const v8u16 x = ocean_codec_load(cur + r * CODEC_LANES);
+		const v8u16 left = ocean_codec_load(cur + r * CODEC_LANES - 1);
+
+		spatial[r] = ocean_codec_zigzag(x - left);
+		any_spatial |= spatial[r];
+	}
+	ws = ocean_codec_width(any_spatial);
+
+	if (temporal && ws > 0) {
+		for (r = 0; r < CODEC_ROWS; r++) {
+			const v8u16 x = ocean_codec_load(cur + r * CODEC_LANES);
+			const v8u16 p = ocean_codec_load(prev + r * CODEC_LANES);
+
+			delta[r] = ocean_codec_zigzag(x - p);
+			any_delta |= delta[r];
+		}
+		wt = ocean_codec_width(any_delta);
+	}
+
+	if (wt < ws) {
+		*out++ = wt | CODEC_TEMPORAL;
+		return ocean_codec_pack(out, delta, wt);
+	}
+
+	*out++ = ws;
+	return ocean_codec_pack(out, spatial, ws);
+}
+
+static void ocean_codec_decode_block(v8u16 *res, uint16_t *cur, const uint16_t *prev,
+				     bool temporal)
+{
+	uint16_t last;
+	int r, i;
+
+	for (r = 0; r < CODEC_ROWS; r++)
+		res[r] = ocean_codec_unzigzag(res[r]);
+
+	if (temporal) {
+		for (r = 0; r < CODEC_ROWS; r++) {
+			const v8u16 x = ocean_codec_load(prev + r * CODEC_LANES) + res[r];
+
+			memcpy(cur + r * CODEC_LANES, &x, sizeof(x));
+		}
+		return;
+	}
+
+	/* the running sum is serial, it is still far from being the limit */
+	last = cur[-1];
+	for (r = 0; r < CODEC_ROWS; r++) {
+		for (i = 0; i < CODEC_LANES; i++) {
+			last += res[r][i];
+			cur[r * CODEC_LANES + i] = last;
+		}
+	}
+}
+
+api_public
+int ocean_encoder_create(struct ocean_encoder **encp, size_t frame_size)
+{
+	struct ocean_encoder *enc;
+	int ret;
+
+	if (!encp || frame_size == 0 || frame_size > INT32_MAX / 2)
+		return -EINVAL;
+
+	enc = malloc(sizeof(*enc));
+	if (!enc)
+		return -ENOMEM;
+
+	ret = ocean_codec_init(&enc->codec, frame_size);
+	if (ret < 0) {
+		ocean_codec_release(&enc->codec);
+		free(enc);
+		return ret;
+	}
+
+	enc->key_interval = DEFAULT_KEY_INTERVAL;
+	enc->since_key = 0;
+
+	*encp = enc;
+	return 0;
+}
+
+api_public
+void ocean_encoder_free(struct ocean_encoder *enc)
+{
+	if (!enc)
+		return;
+
+	ocean_codec_release(&enc->codec);
+	free(enc);
+}
+
+api_public
+int ocean_encoder_set_key_interval(struct ocean_encoder *enc, unsigned interval)
+{
+	if (!enc)
+		return -EINVAL;
+
+	enc->key_interval = interval;
+	return 0;
+}
+
+api_public
+void ocean_encoder_reset(struct ocean_encoder *enc)
+{
+	if (enc)
+		enc->codec.have_prev = false;
+}
+
+api_public
+size_t ocean_encoder_get_max_size(struct ocean_encoder *enc)
+{
+	if (!enc)
+		return (size_t)-EINVAL;
+
+	return CODEC_HEADER_SIZE + enc->codec.num_blocks * (1 + 2 * CODEC_BLOCK) +
+	       (enc->codec.frame_size & 1);
+}
+
+api_public
+int ocean_encoder_encode(struct ocean_encoder *enc, const uint8_t *frame,
+			 uint8_t *out, size_t len)
+{
+	struct ocean_codec *codec;
+	uint8_t *ptr = out;
+	bool key;
+	size_t b;
+
+	if (!enc || !frame || !out)
+		return -EINVAL;
+
+	if (len < ocean_encoder_get_max_size(enc))
+		return -ENOSPC;
+
+	codec = &enc->codec;
+	key = !codec->have_prev ||
+	      (enc->key_interval && enc->since_key >= enc->key_interval);
+
+	ocean_codec_read_frame(codec, frame);
+
+	*ptr++ = CODEC_MAGIC;
+	*ptr++ = key ? CODEC_KEY_FRAME : 0;
+	*ptr++ = (codec->frame_size >>  0) & 0xff;
+	*ptr++ = (codec->frame_size >>  8) & 0xff;
+	*ptr++ = (codec->frame_size >> 16) & 0xff;
+	*ptr++ = (codec->frame_size >> 24) & 0xff;
+
+	for (b = 0; b < codec->num_blocks; b++) {
+		ptr = ocean_codec_encode_block(ptr, codec->cur + b * CODEC_BLOCK,
+					       codec->prev + b * CODEC_BLOCK, !key);
+	}
+
+	if (codec->frame_size & 1)
+		*ptr++ = frame[codec->frame_size - 1];
+
+	enc->since_key = key ? 1 : enc->since_key + 1;
+	ocean_codec_swap(codec);
+
+	return ptr - out;
+}
+
+api_public
+int ocean_decoder_create(struct ocean_decoder **decp, size_t frame_size)
+{
+	struct ocean_decoder *dec;
+	int ret;
+
+	if (!decp || frame_size == 0 || frame_size > INT32_MAX / 2)
+		return -EINVAL;
+
+	dec = malloc(sizeof(*dec));
+	if (!dec)
+		return -ENOMEM;
+
+	ret = ocean_codec_init(&dec->codec, frame_size);
+	if (ret < 0) {
+		ocean_codec_release(&dec->codec);
+		free(dec);
+		return ret;
+	}
+
+	*decp = dec;
+	return 0;
+}
+
+api_public
+void ocean_decoder_free(struct ocean_decoder *dec)
+{
+	if (!dec)
+		return;
+
+	ocean_codec_release(&dec->codec);
+	free(dec);
+}
+
+api_public
+void ocean_decoder_reset(struct ocean_decoder *dec)
+{
+	if (dec)
+		dec->codec.have_prev = false;
+}
+
+api_public
+int ocean_decoder_decode(struct ocean_decoder *dec, const uint8_t *in, size_t len,
+			 uint8_t *frame)
+{
+	v8u16 res[CODEC_ROWS];
+	struct ocean_codec *codec;
+	const uint8_t *ptr = in;
+	const uint8_t *end = in + len;
+	uint32_t frame_size;
+	bool key;
+	size_t b;
+
+	if (!dec || !in || !frame)
+		return -EINVAL;
+
+	codec = &dec->codec;
+	if (len < CODEC_HEADER_SIZE || ptr[0] != CODEC_MAGIC)
+		return -EBADMSG;
+
+	key = ptr[1] & CODEC_KEY_FRAME;
+	frame_size = ptr[2] | (ptr[3] << 8) | (ptr[4] << 16) | ((uint32_t)ptr[5] << 24);
+	if (frame_size != codec->frame_size)
+		return -EBADMSG;
+
+	/* temporal blocks need the previous frame */
+	if (!key && !codec->have_prev)
+		return -ENODATA;
+
+	ptr += CODEC_HEADER_SIZE;
+
+	for (b = 0; b < codec->num_blocks; b++) {
+		unsigned width;
+		bool temporal;
+
+		if (ptr >= end)
+			return -EBADMSG;
+
+		width = *ptr & CODEC_WIDTH_MASK;
+		temporal = *ptr & CODEC_TEMPORAL;
+		if (width > 16 || (temporal && key) ||
+		    (size_t)(end - ptr) < 1 + 2 * CODEC_LANES * width)
+			return -EBADMSG;
+
+		ocean_codec_unpack(res, ptr + 1, width);
+		ocean_codec_decode_block(res, codec->cur + b * CODEC_BLOCK,
+					 codec->prev + b * CODEC_BLOCK, temporal);
+		ptr += 1 + 2 * CODEC_LANES * width;
+	}
+
+	if (codec->frame_size & 1) {
+		if (ptr >= end)
+			return -EBADMSG;
+		frame[codec->frame_size - 1] = *ptr++;
+	}
+
+	ocean_codec_write_frame(codec, frame);
+	ocean_codec_swap(codec);
+
+	return ptr - in;
+}
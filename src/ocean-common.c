@@ -66,8 +66,13 @@ static void hexdump(uint8_t *buf, size_t len, const char *prefix)
 	}
 }
 
-extern int ocean_recv_spectra(struct ocean *self, struct ocean_spectra *spec);
+extern int ocean_recv_spectra(struct ocean *self, struct ocean_spectra *spec,
+			      unsigned int timeout);
 extern void ocean_spectra_apply_coefficents(struct ocean_spectra *spec);
+extern void ocean_decode_begin(struct ocean_decode *d);
+extern void ocean_decode_update(struct ocean_spectra *spec, struct ocean_decode *d,
+				size_t avail);
+extern void ocean_decode_end(struct ocean_spectra *spec, struct ocean_decode *d);
 
 static int ocean_query_dev_info(struct ocean *self, uint8_t what, uint8_t *buf, size_t len);
 static int ocean_query_status(struct ocean *self, struct ocean_status *status);
@@ -174,7 +179,7 @@ static int ocean_spectra_query_coefficents(struct ocean_spectra *spec, struct oc
 	return 0;
 }
 
-static int ocean_spectra_create_custom(struct ocean_spectra **spec, size_t size)
+static int ocean_spectra_create_custom(struct ocean_spectra **spec, size_t num_of_pixels)
 {
 	struct ocean_spectra *s;
 
@@ -186,21 +191,30 @@ static int ocean_spectra_create_custom(struct ocean_spectra **spec, size_t size)
 		return -ENOMEM;
 	memset(s, 0, sizeof(*s));
 
-	s->raw = malloc(s->raw_size = size);
+	/* the pixels and their sync bytes */
+	s->raw = malloc(s->raw_size = ocean_frame_length(num_of_pixels));
 	if (!s->raw) {
 		free(s);
 		return -ENOMEM;
 	}
+	s->own_raw = true;
 
-	/* FIXME: We remove on value because, we need 2 extra bytes
-	 *        to store the sync byte whitin the raw data */
-	s->data_size = (size / 2) - 1;
+	s->data_size = num_of_pixels;
 	s->data = malloc(s->data_size * sizeof(double));
 	if (!s->data) {
 		free(s->data);
 		free(s);
 		return -ENOMEM;
 	}
+	s->own_data = true;
+
+	s->saturation_map = calloc((s->data_size + 63) / 64, sizeof(uint64_t));
+	if (!s->saturation_map) {
+		free(s->data);
+		free(s->raw);
+		free(s);
+		return -ENOMEM;
+	}
 
 	*spec = s;
 	return 0;
@@ -219,8 +233,7 @@ int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ocean)
 	if (ret < 0)
 		return -EIO;
 
-	/* FIXME: The length needs to be larger because of the sync byte */
-	ret = ocean_spectra_create_custom(spec, (status.num_of_pixels * 2) + 2);
+	ret = ocean_spectra_create_custom(spec, status.num_of_pixels);
 	if (ret < 0)
 		return ret;
 
@@ -231,24 +244,142 @@ int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ocean)
 	return 0;
 }
 
+api_public
+int ocean_spectra_get_buffer_sizes(struct ocean *ocean, size_t *data_len, size_t *raw_len)
+{
+	struct ocean_status status;
+	int ret;
+
+	if (!ocean || !data_len || !raw_len)
+		return -EINVAL;
+
+	ret = ocean_query_status(ocean, &status);
+	if (ret < 0)
+		return -EIO;
+
+	/* see ocean_spectra_create() */
+	*raw_len = ocean_frame_length(status.num_of_pixels);
+	*data_len = status.num_of_pixels * sizeof(double);
+	return 0;
+}
+
+api_public
+int ocean_spectra_rebind(struct ocean_spectra *spec, double *data, size_t data_len,
+			 uint8_t *raw, size_t raw_len)
+{
+	/* pooled spectra keep the memory of the pool */
+	if (!spec || !data || spec->pool)
+		return -EINVAL;
+
+	if ((uintptr_t)data % sizeof(double) ||
+	    data_len < spec->data_size * sizeof(double) ||
+	    (raw && raw_len < spec->raw_size))
+		return -EINVAL;
+
+	if (spec->own_data)
+		free(spec->data);
+	spec->data = data;
+	spec->own_data = false;
+
+	if (raw) {
+		if (spec->own_raw)
+			free(spec->raw);
+		spec->raw = raw;
+		spec->own_raw = false;
+	}
+
+	return 0;
+}
+
+api_public
+int ocean_spectra_create_with_buffers(struct ocean_spectra **spec, struct ocean *ctx,
+				      double *data, size_t data_len,
+				      uint8_t *raw, size_t raw_len)
+{
+	struct ocean_spectra *s;
+	int ret;
+
+	if (!spec)
+		return -EINVAL;
+
+	ret = ocean_spectra_create(&s, ctx);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_spectra_rebind(s, data, data_len, raw, raw_len);
+	if (ret < 0) {
+		ocean_spectra_free(s);
+		return ret;
+	}
+
+	*spec = s;
+	return 0;
+}
+
+#define SPECTRA_ALIGN 64
+#define SPECTRA_ALIGNED(x) (((x) + SPECTRA_ALIGN - 1) & ~(size_t)(SPECTRA_ALIGN - 1))
+
+api_private
+size_t ocean_spectra_footprint(struct ocean_spectra *tmpl)
+{
+	return SPECTRA_ALIGNED(sizeof(*tmpl)) +
+	       SPECTRA_ALIGNED(tmpl->raw_size) +
+	       SPECTRA_ALIGNED(tmpl->data_size * sizeof(double)) +
+	       SPECTRA_ALIGNED((tmpl->data_size + 63) / 64 * sizeof(uint64_t));
+}
+
+api_private
+struct ocean_spectra *ocean_spectra_place(void *mem, struct ocean_spectra *tmpl,
+					  struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra *s = mem;
+	uint8_t *ptr = mem;
+
+	*s = *tmpl;
+	ptr += SPECTRA_ALIGNED(sizeof(*s));
+	s->raw = ptr;
+	ptr += SPECTRA_ALIGNED(s->raw_size);
+	s->data = (double *)ptr;
+	ptr += SPECTRA_ALIGNED(s->data_size * sizeof(double));
+	s->saturation_map = (uint64_t *)ptr;
+	s->pool = pool;
+
+	return s;
+}
+
+api_private
+struct ocean_spectra_pool *ocean_spectra_pool_of(struct ocean_spectra *spec)
+{
+	return spec->pool;
+}
+
 api_public
 void ocean_spectra_free(struct ocean_spectra *spec)
 {
 	if (!spec)
 		return;
 
+	/* the memory belongs to the pool */
+	if (spec->pool) {
+		ocean_spectra_release(spec);
+		return;
+	}
+
 	if (spec->raw) {
-		free(spec->raw);
+		if (spec->own_raw)
+			free(spec->raw);
 		spec->raw = NULL;
 		spec->raw_size = 0;
 	}
 
 	if (spec->data) {
-		free(spec->data);
+		if (spec->own_data)
+			free(spec->data);
 		spec->data = NULL;
 		spec->data_size = 0;
 	}
 
+	free(spec->saturation_map);
 	free(spec);
 	spec = NULL;
 }
@@ -265,6 +396,74 @@ double *ocean_spectra_get_data(struct ocean_spectra *spec)
 	return spec ? spec->data : NULL;
 }
 
+api_public
+uint64_t ocean_spectra_get_sequence(struct ocean_spectra *spec)
+{
+	return spec ? spec->sequence : 0;
+}
+
+api_public
+uint64_t ocean_spectra_get_timestamp(struct ocean_spectra *spec)
+{
+	return spec ? spec->timestamp : 0;
+}
+
+api_public
+uint32_t ocean_spectra_get_integration_time(struct ocean_spectra *spec)
+{
+	return spec ? spec->integration_time : 0;
+}
+
+api_public
+uint32_t ocean_spectra_get_flags(struct ocean_spectra *spec)
+{
+	return spec ? spec->flags : 0;
+}
+
+api_public
+int ocean_spectra_get_stats(struct ocean_spectra *spec, struct ocean_spectra_stats *stats)
+{
+	if (!spec || !stats)
+		return -EINVAL;
+
+	*stats = spec->stats;
+	return 0;
+}
+
+api_private
+void ocean_spectra_set_replaced(struct ocean_spectra *spec, size_t replaced)
+{
+	spec->stats.replaced = replaced;
+}
+
+api_private
+void ocean_spectra_set_stats(struct ocean_spectra *spec, const struct ocean_spectra_stats *stats)
+{
+	spec->stats = *stats;
+}
+
+api_public
+const uint64_t *ocean_spectra_get_saturation_map(struct ocean_spectra *spec)
+{
+	return spec ? spec->saturation_map : NULL;
+}
+
+api_public
+double ocean_spectra_get_saturation(struct ocean_spectra *spec)
+{
+	double value = 0.0;
+	int order;
+
+	if (!spec)
+		return 0.0;
+
+	/* the raw saturation level is scaled to 65535, then corrected */
+	for (order = spec->poly_order_non_lin; order > 0; order--)
+		value = 65535.0 * (spec->non_lin_coef[order] + value);
+
+	return 65535.0 / (spec->non_lin_coef[0] + value);
+}
+
 api_public
 size_t ocean_spectra_get_raw_size(struct ocean_spectra *spec)
 {
@@ -283,43 +482,247 @@ static void ocean_spectra_clear(struct ocean_spectra *spec)
 	memset(spec->data, 0, spec->data_size);
 }
 
+/*
+ * Commands and frames share the device, another thread must not get in
+ * between a request and its answer. The lock is recursive, a larger
+ * sequence may hold it around smaller ones.
+ */
+static void ocean_io_lock(struct ocean *self)
+{
+	pthread_mutex_lock(&self->io);
+}
+
+static void ocean_io_unlock(struct ocean *self)
+{
+	pthread_mutex_unlock(&self->io);
+}
+
+/* Frames come back to back, a waiting monitor gets the bus in between.
+ * A real-time thread would never yield to it, there the priority
+ * inheriting lock hands the bus over. */
+static void ocean_frame_lock(struct ocean *self)
+{
+	while (!self->rt.active &&
+	       __atomic_load_n(&self->monitor_waiting, __ATOMIC_ACQUIRE))
+		sched_yield();
+	ocean_io_lock(self);
+}
+
+/* Written by the hotplug callback, which runs in whichever thread handles
+ * the libusb events */
+static void ocean_set_lost(struct ocean *self, bool lost)
+{
+	__atomic_store_n(&self->lost, lost, __ATOMIC_RELEASE);
+}
+
+static bool ocean_is_lost(struct ocean *self)
+{
+	return __atomic_load_n(&self->lost, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Asynchronous transfers, for the pipelined acquisition and the real-time
+ * profile: the synchronous libusb calls allocate a transfer every time.
+ */
+#define OCEAN_PIPELINE_DEPTH 2
+
+/* The transfers of the real-time profile: the pipeline, one for single
+ * frames, one for the commands and one for their answers and the flushes */
+#define OCEAN_RT_FRAME OCEAN_PIPELINE_DEPTH
+#define OCEAN_RT_COMMAND (OCEAN_PIPELINE_DEPTH + 1)
+#define OCEAN_RT_REPLY (OCEAN_PIPELINE_DEPTH + 2)
+#define OCEAN_RT_TRANSFERS (OCEAN_PIPELINE_DEPTH + 3)
+
+struct ocean_pending {
+	struct libusb_transfer *transfer;
+	uint8_t *raw;
+	/* the integration time the frame was requested with */
+	uint32_t integration_time;
+	/* ms the frame may take, see ocean_transfer_deadline() */
+	unsigned int deadline;
+	/* monotonic ns of the request, and of its completion */
+	uint64_t requested;
+	uint64_t arrived;
+	int completed;
+};
+
+static void LIBUSB_CALL ocean_pending_done(struct libusb_transfer *transfer)
+{
+	struct ocean_pending *p = transfer->user_data;
+
+	p->arrived = ocean_monotonic();
+	p->completed = 1;
+}
+
+static int ocean_pending_wait(struct ocean *self, struct ocean_pending *p)
+{
+	/* the transfer times out at the latest */
+	while (!p->completed)
+		libusb_handle_events_completed(self->usb, &p->completed);
+
+	switch (p->transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	default:
+		fprintf(stderr, "ERR: transfer failed: %d (done %d/%d)\n",
+			p->transfer->status, p->transfer->actual_length,
+			p->transfer->length);
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+/* nothing may be in flight when the buffer goes away */
+static void ocean_pending_cancel(struct ocean *self, struct ocean_pending *p)
+{
+	if (p->completed)
+		return;
+
+	libusb_cancel_transfer(p->transfer);
+	while (!p->completed)
+		libusb_handle_events_completed(self->usb, &p->completed);
+}
+
+static void ocean_pending_release(struct ocean *self, struct ocean_pending *pending,
+				  size_t count)
+{
+	size_t k;
+
+	for (k = 0; k < count; k++) {
+		ocean_pending_cancel(self, &pending[k]);
+		libusb_free_transfer(pending[k].transfer);
+		free(pending[k].raw);
+	}
+}
+
+/* the chunks receive into the spectra of the caller */
+static void ocean_chunks_release(struct ocean *self, struct ocean_pending *chunks,
+				 size_t count)
+{
+	size_t k;
+
+	if (!chunks)
+		return;
+
+	for (k = 0; k < count; k++) {
+		ocean_pending_cancel(self, &chunks[k]);
+		chunks[k].raw = NULL;
+	}
+	ocean_pending_release(self, chunks, count);
+	free(chunks);
+}
+
+/* How long after the end of its integration time the frame was here */
+static void ocean_pending_account(struct ocean *self, struct ocean_pending *p)
+{
+	uint64_t start = p->requested, end;
+
+	if (!self->rt.active)
+		return;
+
+	/* a pipelined frame starts once the one before it is read out */
+	if (self->rt_last_arrival > start)
+		start = self->rt_last_arrival;
+	end = start + p->integration_time * 1000000ull;
+	self->rt_last_arrival = p->arrived;
+
+	ocean_realtime_account(&self->rt, p->arrived > end ? p->arrived - end : 0);
+}
+
+/*
+ * A synchronous bulk transfer through transfer @index of the real-time
+ * profile, libusb_bulk_transfer() without the allocation
+ */
+static int ocean_bulk_prepared(struct ocean *self, unsigned index, unsigned char ep,
+			       uint8_t *buf, size_t len, int *done, unsigned int timeout)
+{
+	struct ocean_pending *p = &self->rt_pending[index];
+	int ret;
+
+	libusb_fill_bulk_transfer(p->transfer, self->dev, ep, buf, len,
+				  ocean_pending_done, p, timeout);
+
+	p->completed = 0;
+	ret = libusb_submit_transfer(p->transfer);
+	if (ret < 0) {
+		p->completed = 1;
+		return ret;
+	}
+
+	ret = ocean_pending_wait(self, p);
+	*done = p->transfer->actual_length;
+	return ret;
+}
+
 static int ocean_send_command(struct ocean *self, uint8_t *cmd, size_t len)
 {
 	int done = 0;
 	int ret;
 
-	ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_SEND],
-				   cmd, len, &done, self->timeout);
+	/* a reconnect replaces the handle under the lock */
+	ocean_io_lock(self);
+	if (!self->dev)
+		ret = LIBUSB_ERROR_NO_DEVICE;
+	else if (self->rt_pending)
+		ret = ocean_bulk_prepared(self, OCEAN_RT_COMMAND, self->ep[EP_CMD_SEND],
+					  cmd, len, &done, self->timeout);
+	else
+		ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_SEND],
+					   cmd, len, &done, self->timeout);
+	ocean_io_unlock(self);
 	if (ret < 0) {
 		fprintf(stderr, "ERR: usb read failed: %d (done %d/%zu)\n",
 			ret, done, len);
+		if (ret == LIBUSB_ERROR_NO_DEVICE)
+			ocean_set_lost(self, true);
 		return ret;
 	}
 
 	return 0;
 }
 
-/*
- * WORKS partialy, sometimes reading fails
- */
-static int ocean_query_dev_info(struct ocean *self, uint8_t what, uint8_t *buf, size_t len)
+/* A command and its answer of @len bytes */
+static int ocean_transact(struct ocean *self, uint8_t *cmd, size_t cmd_len,
+			  uint8_t *buf, size_t len)
 {
-	uint8_t cmd[] = { 0x05, what };
 	int done = 0;
 	int ret;
 
-	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
-	if (ret < 0)
-		return -EIO;
+	ocean_io_lock(self);
 
-	ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_RECV],
-				   buf, len, &done, self->timeout);
+	ret = ocean_send_command(self, cmd, cmd_len);
 	if (ret < 0) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (self->rt_pending)
+		ret = ocean_bulk_prepared(self, OCEAN_RT_REPLY, self->ep[EP_CMD_RECV],
+					  buf, len, &done, self->timeout);
+	else
+		ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_RECV],
+					   buf, len, &done, self->timeout);
+	if (ret < 0)
 		fprintf(stderr, "ERR: usb read failed: %d (done %d/%zu)\n",
 			ret, done, len);
-		return ret;
-	}
-	return 0;
+out:
+	ocean_io_unlock(self);
+	return ret;
+}
+
+/*
+ * WORKS partialy, sometimes reading fails
+ */
+static int ocean_query_dev_info(struct ocean *self, uint8_t what, uint8_t *buf, size_t len)
+{
+	uint8_t cmd[] = { 0x05, what };
+
+	return ocean_transact(self, cmd, ARRAY_SIZE(cmd), buf, len);
 }
 
 static int ocean_initialize(struct ocean *self)
@@ -331,6 +734,7 @@ static int ocean_initialize(struct ocean *self)
 api_public
 int ocean_create(struct ocean **oceanp)
 {
+	pthread_mutexattr_t attr;
 	struct ocean *ctx = NULL;
 	int ret;
 
@@ -341,6 +745,13 @@ int ocean_create(struct ocean **oceanp)
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->timeout = 1000;
 
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	/* a real-time thread waiting for the bus lends its priority */
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&ctx->io, &attr);
+	pthread_mutexattr_destroy(&attr);
+
 	ret = libusb_init(&ctx->usb);
 	if (ret != 0)
 		return -ENODEV;
@@ -359,9 +770,22 @@ void ocean_free(struct ocean *self)
 
 	ocean_close(self);
 
+	if (self->rt_pending) {
+		/* the frame transfer received into the spectra of the caller */
+		self->rt_pending[OCEAN_RT_FRAME].raw = NULL;
+		ocean_pending_release(self, self->rt_pending, OCEAN_RT_TRANSFERS);
+		free(self->rt_pending);
+	}
+
+	ocean_chunks_release(self, self->chunks, self->num_chunks);
+
+	if (self->hotplug)
+		libusb_hotplug_deregister_callback(self->usb, self->hotplug_handle);
+
 	libusb_exit(self->usb);
 	self->usb = NULL;
 
+	pthread_mutex_destroy(&self->io);
 	free(self);
 	self = NULL;
 }
@@ -395,26 +819,16 @@ static void ocean_set_endpoints_for(struct ocean *self, uint16_t vendor,
 	}
 }
 
-api_public
-int ocean_open(struct ocean *self, uint16_t vendor, uint16_t product)
+/*
+ * Claims the opened device, clears the endpoints and initializes it. The
+ * same for a fresh open and a reconnect.
+ */
+static int ocean_setup(struct ocean *self, uint16_t vendor, uint16_t product)
 {
 	uint8_t desc[32] = { 0 };
 	int ret;
 	int i;
 
-	if (!self || !ocean_supports(vendor, product))
-		return -EINVAL;
-
-	ocean_close(self);
-
-	/* try to find and open the device */
-	self->dev = libusb_open_device_with_vid_pid(self->usb, vendor, product);
-	if (self->dev == NULL) {
-		fprintf(stderr, "ERR: libusb_open_device_with_vid_pid: 0x%x:0x%x "
-			"not found\n", vendor, product);
-		return -ENODEV;
-	}
-
 	/* apply the device specific endpoint settings */
 	ocean_set_endpoints_for(self, vendor, product);
 
@@ -465,6 +879,51 @@ int ocean_open(struct ocean *self, uint16_t vendor, uint16_t product)
 	return 0;
 }
 
+api_public
+int ocean_open(struct ocean *self, uint16_t vendor, uint16_t product)
+{
+	struct ocean_status status;
+	int ret;
+
+	if (!self || !ocean_supports(vendor, product))
+		return -EINVAL;
+
+	ocean_close(self);
+
+	/* try to find and open the device */
+	self->dev = libusb_open_device_with_vid_pid(self->usb, vendor, product);
+	if (self->dev == NULL) {
+		fprintf(stderr, "ERR: libusb_open_device_with_vid_pid: 0x%x:0x%x "
+			"not found\n", vendor, product);
+		return -ENODEV;
+	}
+
+	ret = ocean_setup(self, vendor, product);
+	if (ret < 0)
+		return ret;
+
+	/* start with the settings the device is using */
+	ret = ocean_query_status(self, &status);
+	if (ret < 0)
+		fprintf(stderr, "ERR: %s: unable to query status\n", __func__);
+	else {
+		self->integration_time = status.integration_time;
+		self->external_trigger = status.trigger_mode != 0;
+		self->strobe = status.lamp_enable != 0;
+		self->fan = status.fan_and_tec_state & 0x01;
+	}
+
+	self->vendor = vendor;
+	self->product = product;
+	memset(self->serial, 0, sizeof(self->serial));
+	ocean_get_serial(self, self->serial, sizeof(self->serial));
+
+	ocean_set_lost(self, false);
+	self->reconnected = false;
+	self->sequence = 0;
+	return 0;
+}
+
 api_public
 void ocean_close(struct ocean *self)
 {
@@ -491,24 +950,10 @@ int ocean_reset(struct ocean *self)
 static int ocean_query_status(struct ocean *self, struct ocean_status *status)
 {
 	uint8_t cmd[] = { 0xFE };
-	int done = 0;
-	int ret;
 
-	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
-	if (ret < 0)
-		return -EIO;
-
-	ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_RECV],
-				   (uint8_t *)status, sizeof(*status),
-				   &done, self->timeout);
-	if (ret < 0) {
-		fprintf(stderr, "ERR: usb read failed: %d (done %d/%zu)\n",
-			ret, done, sizeof(status));
-		return ret;
-	}
-
-	return 0;
-}
+	return ocean_transact(self, cmd, ARRAY_SIZE(cmd), (uint8_t *)status,
+			      sizeof(*status));
+}
 
 api_public
 int ocean_dump_status(struct ocean *self, FILE *out)
@@ -540,24 +985,11 @@ int ocean_get_serial(struct ocean *self, char *buf, size_t len)
 {
 #if 1
 	uint8_t cmd[] = { 0x08 };
-	int done = 0;
-	int ret;
 
 	if (!self || !buf || len < MIN_RET_BUF_LEN)
 		return -EINVAL;
 
-	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
-	if (ret < 0)
-		return -EIO;
-
-	ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_RECV],
-				   (uint8_t *)buf, len, &done, self->timeout);
-	if (ret < 0) {
-		fprintf(stderr, "ERR: usb read failed: %d (done %d/%zu)\n",
-			ret, done, len);
-		return ret;
-	}
-	return 0;
+	return ocean_transact(self, cmd, ARRAY_SIZE(cmd), (uint8_t *)buf, len);
 #else
 	/* FIXME: ocean_dump_all is working this call not.
 	 *        figure out why... */
@@ -570,24 +1002,15 @@ int ocean_get_temperature(struct ocean *self, float *pcb, float *sink)
 {
 	uint8_t cmd[] = { 0x6c };
 	uint8_t buf[6];
-	int done = 0;
 	int adc;
 	int ret;
 
 	if (!self || !pcb || !sink)
 		return -EINVAL;
 
-	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	ret = ocean_transact(self, cmd, ARRAY_SIZE(cmd), buf, ARRAY_SIZE(buf));
 	if (ret < 0)
-		return -EIO;
-
-	ret = libusb_bulk_transfer(self->dev, self->ep[EP_CMD_RECV],
-				   buf, ARRAY_SIZE(buf), &done, self->timeout);
-	if (ret < 0) {
-		fprintf(stderr, "ERR: usb read failed: %d (done %d/%lu)\n",
-			ret, done, ARRAY_SIZE(buf));
 		return ret;
-	}
 
 	/* FIXME: convert this properly depending on cpu */
 	adc = ((buf[2] << 8) | buf[1]);
@@ -619,6 +1042,7 @@ int ocean_set_integration_time(struct ocean *self, uint32_t time)
 	if (ret < 0)
 		return -EIO;
 
+	self->integration_time = time;
 	return 0;
 }
 
@@ -661,6 +1085,7 @@ api_public
 int ocean_enable_strob(struct ocean *self, bool enable)
 {
 	uint8_t cmd[] = { 0x03, 0x00, 0x00 };
+	int ret;
 
 	if (!self)
 		return -EINVAL;
@@ -668,13 +1093,19 @@ int ocean_enable_strob(struct ocean *self, bool enable)
 	if (enable)
 		cmd[1] = 0x01;
 
-	return ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	if (ret < 0)
+		return ret;
+
+	self->strobe = enable;
+	return 0;
 }
 
 api_public
 int ocean_enable_fan(struct ocean *self, bool enable)
 {
 	uint8_t cmd[] = { 0x70, 0x00, 0x00 };
+	int ret;
 
 	if (!self)
 		return -EINVAL;
@@ -682,13 +1113,19 @@ int ocean_enable_fan(struct ocean *self, bool enable)
 	if (enable)
 		cmd[1] = 0x01;
 
-	return ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	if (ret < 0)
+		return ret;
+
+	self->fan = enable;
+	return 0;
 }
 
 api_public
 int ocean_enable_external_trigger(struct ocean *self, bool enable)
 {
 	uint8_t cmd[] = { 0x0A, 0x00, 0x00 };
+	int ret;
 
 	if (!self)
 		return -EINVAL;
@@ -696,32 +1133,875 @@ int ocean_enable_external_trigger(struct ocean *self, bool enable)
 	if (enable)
 		cmd[1] = 0x03;
 
-	return ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	if (ret < 0)
+		return ret;
+
+	self->external_trigger = enable;
+	return 0;
 }
 
 api_public
-int ocean_request_spectra(struct ocean *self, struct ocean_spectra *spec)
+int ocean_set_trigger_timeout(struct ocean *self, uint32_t timeout)
+{
+	if (!self)
+		return -EINVAL;
+
+	self->trigger_timeout = timeout;
+	return 0;
+}
+
+/*
+ * The deadline of a data transfer follows the frame: the integration
+ * time, the readout of the detector and the time @len bytes need on the
+ * bus. A frame that is late by a fraction of its own time is lost, no
+ * matter whether that is 10 ms or 10 s.
+ */
+#define OCEAN_READOUT_SLACK 20
+/* bytes per ms, what even a busy full speed link manages */
+#define OCEAN_BUS_RATE 500
+#define OCEAN_RECV_RETRIES 2
+
+/* a high speed bulk packet, the sync bytes of the frame follow them */
+#define OCEAN_PACKET_SIZE 512
+
+/* Reading the rest of a broken frame, until the endpoint is quiet */
+#define OCEAN_FLUSH_TIMEOUT 10
+#define OCEAN_FLUSH_READS 8
+
+/* A frame failed the integrity checks, next to the libusb errors */
+#define OCEAN_ERROR_CORRUPT (-EBADMSG)
+
+/*
+ * The checks of a received frame of @done bytes at @raw. Returns
+ * OCEAN_ERROR_CORRUPT if the frame is to be dropped, a flagged one
+ * passes.
+ */
+static int ocean_verify(struct ocean *self, struct ocean_spectra *spec, const uint8_t *raw,
+			size_t done)
+{
+	enum ocean_frame_error err = ocean_frame_check(raw, done, spec->data_size);
+
+	ocean_integrity_count(&self->integrity, err);
+	if (err == OCEAN_FRAME_INTACT)
+		return 0;
+
+	if (self->corrupt_policy == OCEAN_CORRUPT_FLAG) {
+		self->corrupt = true;
+		return 0;
+	}
+
+	__atomic_add_fetch(&self->integrity.dropped, 1, __ATOMIC_RELAXED);
+	return OCEAN_ERROR_CORRUPT;
+}
+
+/*
+ * Whatever is left of a broken frame would be taken for the next one.
+ * The @len bytes of frames still coming are waited for up to @wait ms a
+ * read, then the endpoint is read until it is quiet.
+ */
+static void ocean_flush(struct ocean *self, size_t len, unsigned int wait)
+{
+	uint8_t buf[OCEAN_PACKET_SIZE];
+	unsigned int timeout;
+	int done, ret, k = 0;
+
+	__atomic_add_fetch(&self->integrity.resyncs, 1, __ATOMIC_RELAXED);
+	for (;;) {
+		done = 0;
+		timeout = len ? wait : OCEAN_FLUSH_TIMEOUT;
+		if (self->rt_pending)
+			ret = ocean_bulk_prepared(self, OCEAN_RT_REPLY, self->ep[EP_DATA_RECV],
+						  buf, sizeof(buf), &done, timeout);
+		else
+			ret = libusb_bulk_transfer(self->dev, self->ep[EP_DATA_RECV],
+						   buf, sizeof(buf), &done, timeout);
+		if (ret < 0 || done == 0)
+			break;
+
+		len = (size_t)done < len ? len - done : 0;
+		if (!len && ++k == OCEAN_FLUSH_READS)
+			break;
+	}
+}
+
+static unsigned int ocean_transfer_deadline(struct ocean *self, size_t len)
+{
+	unsigned int deadline;
+
+	/* the frame is taken once the trigger arrives */
+	if (self->external_trigger) {
+		if (self->trigger_timeout == 0)
+			return 0;
+		deadline = self->trigger_timeout;
+	} else {
+		deadline = 0;
+	}
+
+	return deadline + self->integration_time + self->integration_time / 4 +
+	       OCEAN_READOUT_SLACK + len / OCEAN_BUS_RATE;
+}
+
+/*
+ * A stalled or timed out data endpoint is cleared and one which sent a
+ * corrupt frame flushed, so the next request starts from a clean state.
+ * Returns whether it is worth trying again.
+ */
+static bool ocean_recover(struct ocean *self, int err)
+{
+	int ret;
+
+	if (err == OCEAN_ERROR_CORRUPT) {
+		ocean_flush(self, 0, 0);
+		return true;
+	}
+
+	if (err == LIBUSB_ERROR_NO_DEVICE)
+		ocean_set_lost(self, true);
+	if (err == LIBUSB_ERROR_TIMEOUT)
+		__atomic_add_fetch(&self->integrity.timeouts, 1, __ATOMIC_RELAXED);
+	if (err == LIBUSB_ERROR_PIPE)
+		__atomic_add_fetch(&self->integrity.stalls, 1, __ATOMIC_RELAXED);
+	if (err != LIBUSB_ERROR_PIPE && err != LIBUSB_ERROR_TIMEOUT)
+		return false;
+
+	/* no transfer to allocate, on linux an ioctl of usbfs */
+	ret = libusb_clear_halt(self->dev, self->ep[EP_DATA_RECV]);
+	if (ret < 0) {
+		fprintf(stderr, "ERR: libusb_clear_halt(ep: 0x%x): %d\n",
+			self->ep[EP_DATA_RECV], ret);
+		return false;
+	}
+
+	/* no trigger arrived, asking again does not change that */
+	return !(err == LIBUSB_ERROR_TIMEOUT && self->external_trigger);
+}
+
+static int LIBUSB_CALL ocean_hotplug(libusb_context *usb, libusb_device *dev,
+				     libusb_hotplug_event event, void *data)
+{
+	struct ocean *self = data;
+
+	if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+		if (self->dev && libusb_get_device(self->dev) == dev)
+			ocean_set_lost(self, true);
+	} else {
+		__atomic_store_n(&self->arrived, true, __ATOMIC_RELEASE);
+	}
+
+	/* stay registered */
+	return 0;
+}
+
+api_public
+int ocean_set_reconnect(struct ocean *self, bool enable)
+{
+	int ret;
+
+	if (!self || (enable && !self->vendor))
+		return -EINVAL;
+
+	if (self->hotplug) {
+		libusb_hotplug_deregister_callback(self->usb, self->hotplug_handle);
+		self->hotplug = false;
+	}
+
+	/* without hotplug support the loss shows up as a failed transfer,
+	 * and the device list is searched on every request */
+	if (enable && libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		ret = libusb_hotplug_register_callback(self->usb,
+				LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+				LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+				LIBUSB_HOTPLUG_NO_FLAGS, self->vendor, self->product,
+				LIBUSB_HOTPLUG_MATCH_ANY, ocean_hotplug, self,
+				&self->hotplug_handle);
+		if (ret < 0) {
+			fprintf(stderr, "ERR: libusb_hotplug_register_callback: %d\n", ret);
+			return -EIO;
+		}
+		self->hotplug = true;
+	}
+
+	self->reconnect = enable;
+	return 0;
+}
+
+/* Bring a reopened device back to the settings made through this context */
+static int ocean_restore(struct ocean *self)
+{
+	int ret;
+
+	ret = ocean_set_integration_time(self, self->integration_time);
+	if (ret == 0)
+		ret = ocean_enable_strob(self, self->strobe);
+	if (ret == 0)
+		ret = ocean_enable_fan(self, self->fan);
+	if (ret == 0)
+		ret = ocean_enable_external_trigger(self, self->external_trigger);
+
+	return ret < 0 ? -EIO : 0;
+}
+
+/*
+ * Opens the device with the serial of the lost one. Others of the same
+ * kind are left alone, a claimed one fails already in ocean_setup().
+ */
+static int ocean_reconnect(struct ocean *self)
+{
+	libusb_device **list;
+	char serial[32];
+	ssize_t n, i;
+	int ret = -ENODEV;
+
+	ocean_close(self);
+
+	n = libusb_get_device_list(self->usb, &list);
+	if (n < 0)
+		return -ENODEV;
+
+	for (i = 0; i < n && ret < 0; i++) {
+		struct libusb_device_descriptor desc;
+
+		if (libusb_get_device_descriptor(list[i], &desc) < 0 ||
+		    desc.idVendor != self->vendor || desc.idProduct != self->product)
+			continue;
+
+		if (libusb_open(list[i], &self->dev) < 0) {
+			self->dev = NULL;
+			continue;
+		}
+
+		memset(serial, 0, sizeof(serial));
+		if (ocean_setup(self, desc.idVendor, desc.idProduct) == 0 &&
+		    ocean_get_serial(self, serial, sizeof(serial)) == 0 &&
+		    memcmp(serial, self->serial, sizeof(serial)) == 0)
+			ret = 0;
+		else
+			ocean_close(self);
+	}
+	libusb_free_device_list(list, 1);
+
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_restore(self);
+	if (ret < 0) {
+		ocean_close(self);
+		return ret;
+	}
+
+	__atomic_store_n(&self->arrived, false, __ATOMIC_RELEASE);
+	ocean_set_lost(self, false);
+	self->reconnected = true;
+	return 0;
+}
+
+/*
+ * Returns -ENODEV as long as the device is gone. Under the io lock, the
+ * handle must not go away below the monitor or a command of another
+ * thread.
+ */
+static int ocean_check_connection(struct ocean *self)
+{
+	struct timeval tv = { 0, 0 };
+	int ret = 0;
+
+	ocean_io_lock(self);
+	if (!self->reconnect) {
+		ret = self->dev ? 0 : -ENODEV;
+		goto out;
+	}
+
+	/* the hotplug callback runs from here */
+	if (self->hotplug)
+		libusb_handle_events_timeout_completed(self->usb, &tv, NULL);
+
+	if (!ocean_is_lost(self))
+		goto out;
+
+	/* nothing of its kind came back yet */
+	if (self->hotplug && !__atomic_load_n(&self->arrived, __ATOMIC_ACQUIRE))
+		ret = -ENODEV;
+	else
+		ret = ocean_reconnect(self);
+out:
+	ocean_io_unlock(self);
+	return ret;
+}
+
+/* Everything that happens to a frame once its raw data arrived, @decoded
+ * if that happened already on the way. The frames of a plan are @planned,
+ * their settings are not for the automatic exposure to change. */
+static int ocean_spectra_finish(struct ocean *self, struct ocean_spectra *spec,
+				uint32_t integration_time, bool decoded, bool planned)
+{
+	int ret;
+
+	spec->timestamp = ocean_timestamp();
+	spec->sequence = self->sequence++;
+	spec->integration_time = integration_time;
+	spec->flags = 0;
+	if (self->reconnected) {
+		spec->flags |= OCEAN_FRAME_RECONNECTED;
+		self->reconnected = false;
+	}
+	if (self->corrupt) {
+		spec->flags |= OCEAN_FRAME_CORRUPT;
+		self->corrupt = false;
+	}
+
+	if (!decoded)
+		ocean_spectra_apply_coefficents(spec);
+
+	if (self->despike) {
+		ret = ocean_despike_process(self->despike, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (self->savgol) {
+		ret = ocean_savgol_process(self->savgol, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (self->exposure && !planned) {
+		ret = ocean_exposure_update(self->exposure, self, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (self->publisher) {
+		ret = ocean_publisher_publish(self->publisher, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Queues the data transfer of a frame into p->raw, then requests it.
+ * The frame @ahead, if any, is still in flight and has to pass first,
+ * the time counts from now and it may have been taken at another
+ * integration time.
+ */
+static int ocean_pending_submit(struct ocean *self, struct ocean_pending *p, size_t len,
+				const struct ocean_pending *ahead)
 {
 	uint8_t cmd[] = { 0x09 };
+	unsigned int timeout;
 	int ret;
 
+	p->deadline = ocean_transfer_deadline(self, len);
+	timeout = p->deadline;
+	/* 0 waits for the trigger forever */
+	if (ahead && timeout)
+		timeout = ahead->deadline ? timeout + ahead->deadline : 0;
+
+	libusb_fill_bulk_transfer(p->transfer, self->dev, self->ep[EP_DATA_RECV],
+				  p->raw, len, ocean_pending_done, p, timeout);
+
+	p->completed = 0;
+	ret = libusb_submit_transfer(p->transfer);
+	if (ret < 0) {
+		p->completed = 1;
+		return -EIO;
+	}
+
+	p->integration_time = self->integration_time;
+
+	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	if (ret < 0)
+		return -EIO;
+	p->requested = ocean_monotonic();
+
+	return 0;
+}
+
+/*
+ * The frame in transfers of a few packets each, all of them queued before
+ * the request. Each one is decoded as soon as it completed, while the
+ * next ones are still on the bus.
+ */
+static int ocean_recv_chunked(struct ocean *self, struct ocean_spectra *spec, size_t num)
+{
+	const unsigned int timeout = ocean_transfer_deadline(self, spec->raw_size);
+	struct ocean_pending *last = &self->chunks[num - 1];
+	uint8_t cmd[] = { 0x09 };
+	struct ocean_decode d;
+	size_t k, offset, done;
+	int ret = 0;
+
+	for (k = 0; k < num; k++) {
+		struct ocean_pending *p = &self->chunks[k];
+
+		offset = k * self->chunk_size;
+		p->raw = spec->raw + offset;
+		libusb_fill_bulk_transfer(p->transfer, self->dev, self->ep[EP_DATA_RECV],
+					  p->raw, k + 1 < num ? self->chunk_size :
+					  spec->raw_size - offset,
+					  ocean_pending_done, p, timeout);
+
+		p->completed = 0;
+		ret = libusb_submit_transfer(p->transfer);
+		if (ret < 0) {
+			p->completed = 1;
+			goto out;
+		}
+	}
+
+	last->integration_time = self->integration_time;
+	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	if (ret < 0)
+		goto out;
+	last->requested = ocean_monotonic();
+
+	ocean_decode_begin(&d);
+	for (k = 0, done = 0; k < num; k++) {
+		struct libusb_transfer *transfer = self->chunks[k].transfer;
+
+		ret = ocean_pending_wait(self, &self->chunks[k]);
+		if (ret < 0)
+			goto out;
+
+		done = k * self->chunk_size + transfer->actual_length;
+		ocean_decode_update(spec, &d, done);
+
+		/* the rest of the frame would end up in the next chunk */
+		if (transfer->actual_length != transfer->length)
+			break;
+	}
+
+	ret = ocean_verify(self, spec, spec->raw, done);
+	if (ret < 0)
+		goto out;
+	ocean_decode_end(spec, &d);
+
+	ocean_pending_account(self, last);
+out:
+	for (k = 0; k < num; k++)
+		ocean_pending_cancel(self, &self->chunks[k]);
+	return ret;
+}
+
+api_public
+int ocean_request_spectra(struct ocean *self, struct ocean_spectra *spec)
+{
+	uint8_t cmd[] = { 0x09 };
+	struct ocean_pending *p;
+	size_t chunks = 0;
+	int retry, ret;
+
 	if (!self || !spec)
 		return -EINVAL;
 
+	/* frames handed to several consumers are immutable */
+	if (ocean_spectra_shared(spec))
+		return -EBUSY;
+
+	ret = ocean_check_connection(self);
+	if (ret < 0)
+		return ret;
+
 	ocean_spectra_clear(spec);
 
-	ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+	ocean_frame_lock(self);
+	/* the real-time profile receives into the frame without allocating */
+	p = self->rt_pending ? &self->rt_pending[OCEAN_RT_FRAME] : NULL;
+	/* a spectra larger than the chunks were made for takes one transfer */
+	if (self->chunks) {
+		chunks = (spec->raw_size + self->chunk_size - 1) / self->chunk_size;
+		if (chunks > self->num_chunks)
+			chunks = 0;
+	}
+	for (retry = 0; ; retry++) {
+		if (chunks) {
+			ret = ocean_recv_chunked(self, spec, chunks);
+		} else {
+			if (p) {
+				p->raw = spec->raw;
+				ret = ocean_pending_submit(self, p, spec->raw_size, NULL);
+				if (ret < 0)
+					ocean_pending_cancel(self, p);
+			} else {
+				ret = ocean_send_command(self, cmd, ARRAY_SIZE(cmd));
+			}
+			if (ret < 0) {
+				ret = ocean_is_lost(self) ? -ENODEV : -EIO;
+				break;
+			}
+
+			if (p) {
+				ret = ocean_pending_wait(self, p);
+				if (ret == 0)
+					ret = ocean_verify(self, spec, p->raw,
+							   p->transfer->actual_length);
+				if (ret == 0)
+					ocean_pending_account(self, p);
+			} else {
+				ret = ocean_recv_spectra(self, spec,
+							 ocean_transfer_deadline(self, spec->raw_size));
+				if (ret >= 0)
+					ret = ocean_verify(self, spec, spec->raw, ret);
+			}
+		}
+		if (ret == 0)
+			break;
+
+		/* leave the endpoint clean for the next request, also when giving up */
+		if (!ocean_recover(self, ret) || retry == OCEAN_RECV_RETRIES) {
+			if (ocean_is_lost(self))
+				ret = -ENODEV;
+			else
+				ret = ret == OCEAN_ERROR_CORRUPT ? -EBADMSG : -ENODATA;
+			break;
+		}
+	}
+	ocean_io_unlock(self);
+
 	if (ret < 0)
-		return -EIO;
+		return ret;
+
+	return ocean_spectra_finish(self, spec, self->integration_time, chunks > 0, false);
+}
+
+/* The settings of a plan step, only what changed goes to the device */
+static int ocean_plan_apply(struct ocean *self, const struct ocean_plan_step *step)
+{
+	int ret = 0;
+
+	if (step->integration_time && step->integration_time != self->integration_time)
+		ret = ocean_set_integration_time(self, step->integration_time);
+	if (ret == 0 && step->strobe != self->strobe)
+		ret = ocean_enable_strob(self, step->strobe);
+	if (ret == 0 && step->external_trigger != self->external_trigger)
+		ret = ocean_enable_external_trigger(self, step->external_trigger);
+
+	return ret;
+}
+
+/*
+ * Pipelined acquisition: the data transfer of the next frame is queued
+ * and its request sent before the current frame arrived, so the device
+ * never waits for the host between two frames.
+ *
+ * @n frames with the next request always in flight. With a @plan the
+ * settings of each frame are sent before its request, the device works
+ * through the commands in order.
+ */
+static int ocean_request_pipelined(struct ocean *self, struct ocean_spectra *spec,
+				   size_t n, struct ocean_batch *batch, struct ocean_plan *plan)
+{
+	struct ocean_pending local[OCEAN_PIPELINE_DEPTH], *pending = local;
+	uint8_t *raw;
+	/* requests sent, and frames read or given up on */
+	size_t submitted = 0, received = 0, i = 0, k;
+	unsigned step;
+	int failed = 0, ret = 0;
+
+	if (!self || !spec || !batch ||
+	    ocean_batch_get_num_of_pixels(batch) != ocean_spectra_get_size(spec))
+		return -EINVAL;
+
+	if (ocean_spectra_shared(spec))
+		return -EBUSY;
+
+	if (n > ocean_batch_get_capacity(batch) - ocean_batch_get_size(batch))
+		return -ENOSPC;
+
+	ret = ocean_check_connection(self);
+	if (ret < 0)
+		return ret;
+
+	ocean_frame_lock(self);
+
+	/* the real-time profile brings its own transfers */
+	if (self->rt_pending) {
+		pending = self->rt_pending;
+		if (spec->raw_size > self->rt_raw_size) {
+			ret = -EINVAL;
+			goto out;
+		}
+	} else {
+		memset(local, 0, sizeof(local));
+		for (k = 0; k < OCEAN_PIPELINE_DEPTH; k++) {
+			pending[k].transfer = libusb_alloc_transfer(0);
+			pending[k].raw = malloc(spec->raw_size);
+			pending[k].completed = 1;
+			if (!pending[k].transfer || !pending[k].raw) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+	}
+
+	/* the frames are decoded straight from the transfer buffers */
+	raw = spec->raw;
+
+	for (i = 0; i < n; i++) {
+		struct ocean_pending *p = &pending[i % OCEAN_PIPELINE_DEPTH];
+
+		while (submitted < n && submitted < i + OCEAN_PIPELINE_DEPTH) {
+			if (plan) {
+				ret = ocean_plan_apply(self, ocean_plan_step_of(plan, submitted, &step));
+				if (ret < 0)
+					goto out;
+			}
+
+			/* the pipeline is two deep, at most one frame is ahead */
+			ret = ocean_pending_submit(self, &pending[submitted % OCEAN_PIPELINE_DEPTH],
+						   spec->raw_size, submitted > received ?
+						   &pending[(submitted - 1) % OCEAN_PIPELINE_DEPTH] :
+						   NULL);
+			if (ret < 0)
+				goto out;
+			submitted++;
+		}
+
+		ret = ocean_pending_wait(self, p);
+		received++;
+		if (ret < 0) {
+			failed = ret;
+			ret = -ENODATA;
+			goto out;
+		}
+		ret = ocean_verify(self, spec, p->raw, p->transfer->actual_length);
+		if (ret < 0) {
+			failed = ret;
+			ret = -EBADMSG;
+			goto out;
+		}
+		ocean_pending_account(self, p);
+
+		spec->raw = p->raw;
+		ret = ocean_spectra_finish(self, spec, p->integration_time, false, plan != NULL);
+		spec->raw = raw;
+		if (ret == 0)
+			ret = ocean_batch_append(batch, spec);
+		if (ret < 0)
+			goto out;
+
+		if (plan) {
+			ocean_plan_step_of(plan, i, &step);
+			ocean_batch_set_step(batch, step);
+		}
+	}
+
+out:
+	if (pending == local) {
+		ocean_pending_release(self, local, OCEAN_PIPELINE_DEPTH);
+	} else {
+		for (k = 0; k < OCEAN_PIPELINE_DEPTH; k++)
+			ocean_pending_cancel(self, &pending[k]);
+	}
+
+	/* the frame is lost, but the next request should work again */
+	if (failed)
+		ocean_recover(self, failed);
+
+	/* frames requested but not read would be taken for the next ones */
+	if (ret < 0 && submitted > received && !ocean_is_lost(self))
+		ocean_flush(self, (submitted - received) * spec->raw_size,
+			    (submitted - received) * ocean_transfer_deadline(self, spec->raw_size));
+
+	ocean_io_unlock(self);
+	return ocean_is_lost(self) ? -ENODEV : ret;
+}
+
+api_public
+int ocean_request_spectra_batch(struct ocean *self, struct ocean_spectra *spec,
+				size_t n, struct ocean_batch *batch)
+{
+	return ocean_request_pipelined(self, spec, n, batch, NULL);
+}
+
+api_public
+int ocean_plan_run(struct ocean *self, struct ocean_plan *plan, struct ocean_spectra *spec,
+		   struct ocean_batch *batch)
+{
+	struct ocean_plan_step before;
+	int ret, restored;
+
+	if (!self || !ocean_plan_get_num_of_frames(plan))
+		return -EINVAL;
+
+	before.integration_time = self->integration_time;
+	before.strobe = self->strobe;
+	before.external_trigger = self->external_trigger;
+
+	ret = ocean_request_pipelined(self, spec, ocean_plan_get_num_of_frames(plan), batch, plan);
+	if (ocean_is_lost(self))
+		return ret;
+
+	restored = ocean_plan_apply(self, &before);
+	return ret < 0 ? ret : restored;
+}
+
+api_public
+int ocean_set_publisher(struct ocean *self, struct ocean_publisher *pub)
+{
+	if (!self)
+		return -EINVAL;
+
+	self->publisher = pub;
+	return 0;
+}
+
+api_public
+int ocean_set_auto_exposure(struct ocean *self, struct ocean_exposure *exp)
+{
+	if (!self)
+		return -EINVAL;
+
+	self->exposure = exp;
+	return 0;
+}
+
+api_public
+int ocean_set_despike(struct ocean *self, struct ocean_despike *ds)
+{
+	if (!self)
+		return -EINVAL;
+
+	self->despike = ds;
+	return 0;
+}
+
+api_public
+int ocean_set_savgol(struct ocean *self, struct ocean_savgol *sg)
+{
+	if (!self)
+		return -EINVAL;
 
-	ret = ocean_recv_spectra(self, spec);
+	self->savgol = sg;
+	return 0;
+}
+
+api_public
+int ocean_set_realtime(struct ocean *self, int cpu, int priority)
+{
+	struct ocean_pending *pending = self ? self->rt_pending : NULL;
+	size_t data_len, raw_len, k;
+	int ret;
+
+	if (!self || !self->dev)
+		return -EINVAL;
+
+	/* entered again, e.g. from another thread */
+	if (pending)
+		return ocean_realtime_enter(&self->rt, cpu, priority);
+
+	ret = ocean_spectra_get_buffer_sizes(self, &data_len, &raw_len);
 	if (ret < 0)
-		return -ENODATA;
+		return ret;
 
-	ocean_spectra_apply_coefficents(spec);
+	pending = calloc(OCEAN_RT_TRANSFERS, sizeof(*pending));
+	if (!pending)
+		return -ENOMEM;
+
+	for (k = 0; k < OCEAN_RT_TRANSFERS; k++) {
+		pending[k].completed = 1;
+		pending[k].transfer = libusb_alloc_transfer(0);
+		if (!pending[k].transfer)
+			ret = -ENOMEM;
+		if (k < OCEAN_PIPELINE_DEPTH) {
+			pending[k].raw = malloc(raw_len);
+			if (!pending[k].raw)
+				ret = -ENOMEM;
+		}
+	}
+
+	/* locks the transfers just allocated, too */
+	if (ret == 0)
+		ret = ocean_realtime_enter(&self->rt, cpu, priority);
+	if (ret < 0) {
+		ocean_pending_release(self, pending, OCEAN_RT_TRANSFERS);
+		free(pending);
+		return ret;
+	}
+
+	ocean_io_lock(self);
+	self->rt_pending = pending;
+	self->rt_raw_size = raw_len;
+	ocean_io_unlock(self);
 	return 0;
 }
 
+api_public
+int ocean_set_corrupt_policy(struct ocean *self, enum ocean_corrupt_policy policy)
+{
+	if (!self || (policy != OCEAN_CORRUPT_DROP && policy != OCEAN_CORRUPT_FLAG))
+		return -EINVAL;
+
+	self->corrupt_policy = policy;
+	return 0;
+}
+
+api_public
+int ocean_get_integrity_stats(struct ocean *self, struct ocean_integrity_stats *stats)
+{
+	if (!self || !stats)
+		return -EINVAL;
+
+	ocean_integrity_get(&self->integrity, stats);
+	return 0;
+}
+
+api_public
+int ocean_set_chunked_transfer(struct ocean *self, unsigned packets)
+{
+	struct ocean_pending *chunks = NULL, *old;
+	size_t data_len, raw_len, chunk_size = 0, num = 0, k;
+	int ret = 0;
+
+	if (!self || !self->dev)
+		return -EINVAL;
+
+	if (packets) {
+		ret = ocean_spectra_get_buffer_sizes(self, &data_len, &raw_len);
+		if (ret < 0)
+			return ret;
+
+		chunk_size = (size_t)packets * OCEAN_PACKET_SIZE;
+		num = (raw_len + chunk_size - 1) / chunk_size;
+		chunks = calloc(num, sizeof(*chunks));
+		if (!chunks)
+			return -ENOMEM;
+
+		for (k = 0; k < num; k++) {
+			chunks[k].completed = 1;
+			chunks[k].transfer = libusb_alloc_transfer(0);
+			if (!chunks[k].transfer)
+				ret = -ENOMEM;
+		}
+		if (ret < 0) {
+			ocean_chunks_release(self, chunks, num);
+			return ret;
+		}
+	}
+
+	ocean_io_lock(self);
+	old = self->chunks;
+	k = self->num_chunks;
+	self->chunks = chunks;
+	self->num_chunks = num;
+	self->chunk_size = chunk_size;
+	ocean_io_unlock(self);
+
+	ocean_chunks_release(self, old, k);
+	return 0;
+}
+
+api_public
+int ocean_get_realtime_stats(struct ocean *self, struct ocean_realtime_stats *stats)
+{
+	if (!self || !stats)
+		return -EINVAL;
+
+	return ocean_realtime_get(&self->rt, stats);
+}
+
 api_public
 int ocean_stop_spectral_acquisition(struct ocean *self)
 {
@@ -734,13 +2014,46 @@ int ocean_stop_spectral_acquisition(struct ocean *self)
 }
 
 api_public
-double ocean_spectra_get_wavelength(struct ocean_spectra *spec, int pixel_number)
+double ocean_spectra_get_wavelength_at(struct ocean_spectra *spec, double pixel)
 {
 	double value = 0.0;
 	int order;
 
 	for (order = ARRAY_SIZE(spec->wl_cal_coef) - 1; order > 0; order--)
-		value = pixel_number * (spec->wl_cal_coef[order] + value);
+		value = pixel * (spec->wl_cal_coef[order] + value);
 
 	return spec->wl_cal_coef[0] + value;
 }
+
+api_public
+double ocean_spectra_get_wavelength(struct ocean_spectra *spec, int pixel_number)
+{
+	return ocean_spectra_get_wavelength_at(spec, pixel_number);
+}
+
+api_private
+int ocean_housekeeping_poll(struct ocean *self, struct ocean_housekeeping *hk)
+{
+	struct ocean_status status;
+	int ret;
+
+	/* the next frame waits until this is done */
+	__atomic_store_n(&self->monitor_waiting, true, __ATOMIC_RELEASE);
+	ocean_io_lock(self);
+	__atomic_store_n(&self->monitor_waiting, false, __ATOMIC_RELEASE);
+
+	ret = ocean_get_temperature(self, &hk->pcb, &hk->sink);
+	if (ret == 0)
+		ret = ocean_query_status(self, &status);
+
+	ocean_io_unlock(self);
+	if (ret < 0)
+		return ret;
+
+	hk->integration_time = status.integration_time;
+	hk->fan_and_tec_state = status.fan_and_tec_state;
+	hk->lamp_enable = status.lamp_enable;
+	hk->trigger_mode = status.trigger_mode;
+	hk->power_state = status.power_state;
+	return 0;
+}
@@ -0,0 +1,312 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * The window is a ring of the last frames, stored as float rows padded to
+ * a cache line. Four pixels are handled at once: the values of the window
+ * are loaded into one vector per frame and ordered by an odd-even
+ * transposition network, which needs no branches and suits the small
+ * windows used here. Only the newest frame is judged, a replaced pixel is
+ * also replaced in the ring so a spike never leaks into later frames.
+ * The median includes the newest frame, it is robust against it; the
+ * sigma clipping only looks at the frames before.
+ */
+#define DS_ALIGN 64
+#define DS_LANES 4
+#define DS_MIN_WINDOW 3
+#define DS_MAX_WINDOW 15
+
+/* scales the median absolute deviation to the standard deviation */
+#define DS_MAD_SCALE 1.4826f
+
+typedef float v4f32 __attribute__((vector_size(DS_LANES * sizeof(float))));
+typedef int32_t v4i32 __attribute__((vector_size(DS_LANES * sizeof(int32_t))));
+
+struct ocean_despike {
+	enum ocean_despike_mode mode;
+	size_t num_of_pixels;
+	size_t stride;
+	unsigned window;
+	/* frames in the ring, and the row the next one goes to */
+	unsigned filled;
+	unsigned head;
+	float sigmas;
+	float floor;
+	float *ring;
+};
+
+static inline v4f32 ds_select(v4i32 mask, v4f32 a, v4f32 b)
+{
+	return (v4f32)(((v4i32)a & mask) | ((v4i32)b & ~mask));
+}
+
+static inline v4f32 ds_abs(v4f32 x)
+{
+	return (v4f32)((v4i32)x & 0x7fffffff);
+}
+
+static inline void ds_sort(v4f32 *v, unsigned n)
+{
+	unsigned r, i;
+
+	for (r = 0; r < n; r++) {
+		for (i = r & 1; i + 1 < n; i += 2) {
+			const v4f32 lo = v[i], hi = v[i + 1];
+			const v4i32 swap = hi < lo;
+
+			v[i] = ds_select(swap, hi, lo);
+			v[i + 1] = ds_select(swap, lo, hi);
+		}
+	}
+}
+
+static inline v4f32 ds_median(const v4f32 *v, unsigned n)
+{
+	if (n & 1)
+		return v[n / 2];
+	return (v[n / 2 - 1] + v[n / 2]) * 0.5f;
+}
+
+/* median, and the median absolute deviation as a standard deviation */
+static void ds_center_median(v4f32 *v, unsigned n, v4f32 *center, v4f32 *spread)
+{
+	unsigned i;
+
+	ds_sort(v, n);
+	*center = ds_median(v, n);
+
+	for (i = 0; i < n; i++)
+		v[i] = ds_abs(v[i] - *center);
+	ds_sort(v, n);
+	*spread = ds_median(v, n) * DS_MAD_SCALE;
+}
+
+/* mean and standard deviation of the previous frames, a second time
+ * without the values outside of @sigmas standard deviations */
+static void ds_center_sigma(const v4f32 *v, unsigned n, float sigmas,
+			    v4f32 *center, v4f32 *spread)
+{
+	const v4f32 zero = { 0 }, one = zero + 1.0f;
+	v4f32 sum = zero, sq = zero, cnt = zero, mean, var, limit;
+	unsigned i, l;
+
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	mean = sum / (float)n;
+	for (i = 0; i < n; i++)
+		sq += (v[i] - mean) * (v[i] - mean);
+	var = sq / (float)(n - 1);
+	limit = var * (sigmas * sigmas);
+
+	sum = zero;
+	for (i = 0; i < n; i++) {
+		const v4f32 d = v[i] - mean;
+		const v4i32 keep = d * d <= limit;
+
+		sum += ds_select(keep, v[i], zero);
+		cnt += ds_select(keep, one, zero);
+	}
+	/* with less than two values left the first estimate stays */
+	mean = ds_select(cnt > one, sum / cnt, mean);
+
+	sq = zero;
+	for (i = 0; i < n; i++) {
+		const v4f32 d = v[i] - mean;
+		const v4i32 keep = d * d <= limit;
+
+		sq += ds_select(keep, d * d, zero);
+	}
+	var = ds_select(cnt > one, sq / (cnt - one), var);
+
+	*center = mean;
+	*spread = var;
+	for (l = 0; l < DS_LANES; l++)
+		(*spread)[l] = sqrtf((*spread)[l]);
+}
+
+api_public
+int ocean_despike_create(struct ocean_despike **dsp, struct ocean_spectra *spec,
+			 unsigned window)
+{
+	struct ocean_despike *ds;
+	size_t num_of_pixels;
+	void *ring;
+
+	if (!dsp || !spec || window < DS_MIN_WINDOW || window > DS_MAX_WINDOW)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == 0 || num_of_pixels == (size_t)-EINVAL)
+		return -EINVAL;
+
+	ds = malloc(sizeof(*ds));
+	if (!ds)
+		return -ENOMEM;
+	memset(ds, 0, sizeof(*ds));
+
+	ds->mode = OCEAN_DESPIKE_MEDIAN;
+	ds->num_of_pixels = num_of_pixels;
+	ds->stride = (num_of_pixels + DS_ALIGN / sizeof(float) - 1) &
+		     ~(DS_ALIGN / sizeof(float) - 1);
+	ds->window = window;
+	ds->sigmas = 5.0f;
+	ds->floor = 0.0f;
+
+	if (posix_memalign(&ring, DS_ALIGN, window * ds->stride * sizeof(float))) {
+		free(ds);
+		return -ENOMEM;
+	}
+	/* the padding stays zero, it is never replaced */
+	memset(ring, 0, window * ds->stride * sizeof(float));
+	ds->ring = ring;
+
+	*dsp = ds;
+	return 0;
+}
+
+api_public
+void ocean_despike_free(struct ocean_despike *ds)
+{
+	if (!ds)
+		return;
+
+	free(ds->ring);
+	free(ds);
+}
+
+api_public
+void ocean_despike_reset(struct ocean_despike *ds)
+{
+	if (!ds)
+		return;
+
+	ds->filled = 0;
+	ds->head = 0;
+}
+
+api_public
+int ocean_despike_set_mode(struct ocean_despike *ds, enum ocean_despike_mode mode)
+{
+	if (!ds || (mode != OCEAN_DESPIKE_MEDIAN && mode != OCEAN_DESPIKE_SIGMA))
+		return -EINVAL;
+
+	ds->mode = mode;
+	return 0;
+}
+
+api_public
+int ocean_despike_set_threshold(struct ocean_despike *ds, double sigmas, double floor)
+{
+	if (!ds || !(sigmas > 0.0) || !(floor >= 0.0))
+		return -EINVAL;
+
+	ds->sigmas = sigmas;
+	ds->floor = floor;
+	return 0;
+}
+
+api_public
+int ocean_despike_apply(struct ocean_despike *ds, double *data, size_t len)
+{
+	v4f32 v[DS_MAX_WINDOW], center, spread;
+	float *row;
+	size_t i, l;
+	unsigned n, j, k;
+	int replaced = 0;
+
+	if (!ds || !data || len != ds->num_of_pixels)
+		return -EINVAL;
+
+	row = &ds->ring[ds->head * ds->stride];
+	for (i = 0; i < len; i++)
+		row[i] = data[i];
+
+	if (ds->filled < ds->window)
+		ds->filled++;
+	n = ds->filled;
+
+	/* too few frames to tell a spike from the signal */
+	if (n < DS_MIN_WINDOW)
+		goto out;
+
+	for (i = 0; i < len; i += DS_LANES) {
+		v4f32 *x = (v4f32 *)&row[i];
+		v4f32 dev;
+		v4i32 spike;
+
+		if (ds->mode == OCEAN_DESPIKE_SIGMA) {
+			/* the frame is judged by the ones before it */
+			for (j = 0, k = 0; j < n; j++)
+				if (j != ds->head)
+					v[k++] = *(const v4f32 *)&ds->ring[j * ds->stride + i];
+			ds_center_sigma(v, k, ds->sigmas, &center, &spread);
+		} else {
+			for (j = 0; j < n; j++)
+				v[j] = *(const v4f32 *)&ds->ring[j * ds->stride + i];
+			ds_center_median(v, n, &center, &spread);
+		}
+
+		dev = ds_abs(*x - center);
+		spike = (dev > spread * ds->sigmas) & (dev > ds->floor);
+		if (!(spike[0] | spike[1] | spike[2] | spike[3]))
+			continue;
+
+		*x = ds_select(spike, center, *x);
+		for (l = 0; l < DS_LANES && i + l < len; l++) {
+			if (!spike[l])
+				continue;
+			data[i + l] = center[l];
+			replaced++;
+		}
+	}
+
+out:
+	ds->head = (ds->head + 1) % ds->window;
+	return replaced;
+}
+
+api_public
+int ocean_despike_process(struct ocean_despike *ds, struct ocean_spectra *spec)
+{
+	struct ocean_spectra_stats stats;
+	double *data;
+	double sum = 0.0;
+	size_t i;
+	int ret;
+
+	if (!ds || !spec || ocean_spectra_get_size(spec) != ds->num_of_pixels)
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(spec);
+	ret = ocean_despike_apply(ds, data, ds->num_of_pixels);
+	if (ret < 0)
+		return ret;
+
+	ocean_spectra_set_replaced(spec, ret);
+	if (ret == 0)
+		return 0;
+
+	/* the decoding saw the spikes, the saturated pixels stay as they were */
+	ocean_spectra_get_stats(spec, &stats);
+	stats.min = HUGE_VAL;
+	stats.max = -HUGE_VAL;
+	for (i = 0; i < ds->num_of_pixels; i++) {
+		sum += data[i];
+		if (data[i] < stats.min)
+			stats.min = data[i];
+		if (data[i] > stats.max) {
+			stats.max = data[i];
+			stats.peak = i;
+		}
+	}
+	stats.mean = sum / ds->num_of_pixels;
+	stats.replaced = ret;
+
+	ocean_spectra_set_stats(spec, &stats);
+	return ret;
+}
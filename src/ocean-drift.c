@@ -0,0 +1,464 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * The frame and the reference are freed of the mean of the selected
+ * bands and correlated over the lags -max_shift to max_shift. Only the
+ * reference is cut to the bands: as it has no mean left, a flat background
+ * of the frame adds nothing, where cutting both would pull the peak
+ * towards lag 0. Few lags are summed directly; otherwise both are zero padded
+ * to a power of two at least twice their length, so the circular
+ * correlation of the FFT equals the linear one, and the spectrum of the
+ * reference is kept. The peak is refined by a parabola through the lags
+ * next to it.
+ */
+#define DRIFT_LANES 2
+
+/* an FFT of n points costs about this many times n log2 n multiply-adds */
+#define DRIFT_FFT_COST 6
+
+typedef double v2f64 __attribute__((vector_size(DRIFT_LANES * sizeof(double))));
+
+struct ocean_drift {
+	enum ocean_drift_method method;
+	size_t num_of_pixels;
+	unsigned max_shift;
+	/* the wavelength of every pixel, to convert the shift */
+	double *wavelength;
+	/* 1 for the pixels of the selected bands, else 0 */
+	double *weight;
+	/* the reference as given, and cut to the bands without their mean */
+	double *ref_data;
+	double *reference;
+	double ref_norm;
+	/* center of the selected pixels */
+	double center;
+	/* the frame being measured, without the mean of the bands */
+	double *frame;
+	/* correlation per lag, max_shift is lag 0 */
+	double *corr;
+	/* FFT of fft_len complex points: the twiddles, bit reversal, the
+	 * conjugated spectrum of the reference and the one of the frame */
+	size_t fft_len;
+	unsigned fft_bits;
+	v2f64 *twiddle;
+	uint32_t *bitrev;
+	v2f64 *ref_fft;
+	v2f64 *work;
+};
+
+static void *drift_alloc(size_t len)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, 64, len))
+		return NULL;
+	memset(ptr, 0, len);
+	return ptr;
+}
+
+static inline v2f64 drift_load(const double *src)
+{
+	v2f64 v;
+
+	memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+/* (a + ib) * (c + id), each held as { re, im } */
+static inline v2f64 drift_cmul(v2f64 x, v2f64 w)
+{
+	const v2f64 sign = { -1.0, 1.0 };
+	const v2f64 swapped = { x[1], x[0] };
+
+	return x * w[0] + swapped * w[1] * sign;
+}
+
+static inline v2f64 drift_conj(v2f64 x)
+{
+	const v2f64 sign = { 1.0, -1.0 };
+
+	return x * sign;
+}
+
+static void drift_fft(struct ocean_drift *drift, v2f64 *z, bool inverse)
+{
+	const size_t n = drift->fft_len;
+	size_t len, half, step, i, j, k;
+	v2f64 t;
+
+	for (i = 0; i < n; i++) {
+		j = drift->bitrev[i];
+		if (j > i) {
+			t = z[i];
+			z[i] = z[j];
+			z[j] = t;
+		}
+	}
+
+	for (len = 2; len <= n; len <<= 1) {
+		half = len / 2;
+		step = n / len;
+		for (i = 0; i < n; i += len) {
+			for (k = 0; k < half; k++) {
+				v2f64 w = drift->twiddle[k * step];
+				v2f64 a, b;
+
+				if (inverse)
+					w = drift_conj(w);
+				a = z[i + k];
+				b = drift_cmul(z[i + k + half], w);
+				z[i + k] = a + b;
+				z[i + k + half] = a - b;
+			}
+		}
+	}
+}
+
+static int drift_fft_init(struct ocean_drift *drift)
+{
+	size_t n = 1, i;
+	unsigned bits = 0, b;
+
+	while (n < 2 * drift->num_of_pixels) {
+		n <<= 1;
+		bits++;
+	}
+
+	drift->fft_len = n;
+	drift->fft_bits = bits;
+	drift->twiddle = drift_alloc(n / 2 * sizeof(v2f64));
+	drift->bitrev = drift_alloc(n * sizeof(uint32_t));
+	drift->ref_fft = drift_alloc(n * sizeof(v2f64));
+	drift->work = drift_alloc(n * sizeof(v2f64));
+	if (!drift->twiddle || !drift->bitrev || !drift->ref_fft || !drift->work)
+		return -ENOMEM;
+
+	for (i = 0; i < n / 2; i++) {
+		const double phi = -2.0 * M_PI * i / n;
+
+		drift->twiddle[i] = (v2f64){ cos(phi), sin(phi) };
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t r = 0;
+
+		for (b = 0; b < bits; b++)
+			if (i & (1ul << b))
+				r |= 1u << (bits - 1 - b);
+		drift->bitrev[i] = r;
+	}
+
+	return 0;
+}
+
+/* Removes the mean of the bands from @in, only the reference is cut to
+ * the bands. Returns the norm within the bands. */
+static double drift_prepare(struct ocean_drift *drift, const double *in, double *out,
+			    bool cut)
+{
+	double sum = 0.0, cnt = 0.0, norm = 0.0, mean;
+	size_t i;
+
+	for (i = 0; i < drift->num_of_pixels; i++) {
+		sum += drift->weight[i] * in[i];
+		cnt += drift->weight[i];
+	}
+	mean = cnt > 0.0 ? sum / cnt : 0.0;
+
+	for (i = 0; i < drift->num_of_pixels; i++) {
+		const double value = in[i] - mean;
+
+		out[i] = cut ? drift->weight[i] * value : value;
+		norm += drift->weight[i] * value * value;
+	}
+
+	return sqrt(norm);
+}
+
+/* Prepares the reference, with the current bands */
+static void drift_update_reference(struct ocean_drift *drift)
+{
+	double sum = 0.0, cnt = 0.0;
+	size_t i;
+
+	drift->ref_norm = drift_prepare(drift, drift->ref_data, drift->reference, true);
+
+	for (i = 0; i < drift->num_of_pixels; i++) {
+		sum += drift->weight[i] * i;
+		cnt += drift->weight[i];
+	}
+	drift->center = cnt > 0.0 ? sum / cnt : 0.0;
+
+	if (!drift->ref_fft)
+		return;
+
+	memset(drift->ref_fft, 0, drift->fft_len * sizeof(v2f64));
+	for (i = 0; i < drift->num_of_pixels; i++)
+		drift->ref_fft[i][0] = drift->reference[i];
+	drift_fft(drift, drift->ref_fft, false);
+	for (i = 0; i < drift->fft_len; i++)
+		drift->ref_fft[i] = drift_conj(drift->ref_fft[i]);
+}
+
+static bool drift_use_fft(struct ocean_drift *drift)
+{
+	const double lags = 2.0 * drift->max_shift + 1;
+
+	switch (drift->method) {
+	case OCEAN_DRIFT_DIRECT:
+		return false;
+	case OCEAN_DRIFT_FFT:
+		return true;
+	default:
+		/* two transforms per frame against the sum over every lag */
+		return lags * drift->num_of_pixels >
+		       2.0 * DRIFT_FFT_COST * drift->fft_len * drift->fft_bits;
+	}
+}
+
+/* sum of frame[i] * reference[i - lag], two pixels at once */
+static double drift_direct(struct ocean_drift *drift, long lag)
+{
+	const size_t n = drift->num_of_pixels;
+	const size_t first = lag > 0 ? lag : 0;
+	const size_t last = lag < 0 ? n + lag : n;
+	const double *x = drift->frame, *r = drift->reference - lag;
+	v2f64 acc = { 0 };
+	double sum;
+	size_t i;
+
+	for (i = first; i + DRIFT_LANES <= last; i += DRIFT_LANES)
+		acc += drift_load(&x[i]) * drift_load(&r[i]);
+	sum = acc[0] + acc[1];
+	for (; i < last; i++)
+		sum += x[i] * r[i];
+
+	return sum;
+}
+
+static void drift_correlate(struct ocean_drift *drift)
+{
+	const long max_shift = drift->max_shift;
+	const size_t n = drift->fft_len;
+	long lag;
+	size_t i;
+
+	if (!drift_use_fft(drift)) {
+		for (lag = -max_shift; lag <= max_shift; lag++)
+			drift->corr[lag + max_shift] = drift_direct(drift, lag);
+		return;
+	}
+
+	memset(drift->work, 0, n * sizeof(v2f64));
+	for (i = 0; i < drift->num_of_pixels; i++)
+		drift->work[i][0] = drift->frame[i];
+	drift_fft(drift, drift->work, false);
+	for (i = 0; i < n; i++)
+		drift->work[i] = drift_cmul(drift->work[i], drift->ref_fft[i]);
+	drift_fft(drift, drift->work, true);
+
+	/* negative lags wrap around to the end */
+	for (lag = -max_shift; lag <= max_shift; lag++)
+		drift->corr[lag + max_shift] = drift->work[lag < 0 ? n + lag : (size_t)lag][0] / n;
+}
+
+static double drift_wavelength_at(struct ocean_drift *drift, double pos)
+{
+	const size_t n = drift->num_of_pixels;
+	size_t i;
+
+	if (pos <= 0.0)
+		i = 0;
+	else if (pos >= n - 1)
+		i = n - 2;
+	else
+		i = (size_t)pos;
+
+	return drift->wavelength[i] +
+	       (pos - i) * (drift->wavelength[i + 1] - drift->wavelength[i]);
+}
+
+api_public
+int ocean_drift_create(struct ocean_drift **driftp, struct ocean_spectra *reference,
+		       unsigned max_shift)
+{
+	struct ocean_drift *drift;
+	size_t num_of_pixels, i;
+	int ret;
+
+	if (!driftp || !reference || max_shift == 0)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(reference);
+	if (num_of_pixels == (size_t)-EINVAL || num_of_pixels < 4 ||
+	    max_shift > num_of_pixels / 4)
+		return -EINVAL;
+
+	drift = malloc(sizeof(*drift));
+	if (!drift)
+		return -ENOMEM;
+	memset(drift, 0, sizeof(*drift));
+
+	drift->method = OCEAN_DRIFT_AUTO;
+	drift->num_of_pixels = num_of_pixels;
+	drift->max_shift = max_shift;
+
+	drift->wavelength = drift_alloc(num_of_pixels * sizeof(double));
+	drift->weight = drift_alloc(num_of_pixels * sizeof(double));
+	drift->ref_data = drift_alloc(num_of_pixels * sizeof(double));
+	drift->reference = drift_alloc(num_of_pixels * sizeof(double));
+	drift->frame = drift_alloc(num_of_pixels * sizeof(double));
+	drift->corr = drift_alloc((2 * max_shift + 1) * sizeof(double));
+	if (!drift->wavelength || !drift->weight || !drift->ref_data ||
+	    !drift->reference || !drift->frame || !drift->corr) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = drift_fft_init(drift);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < num_of_pixels; i++) {
+		drift->wavelength[i] = ocean_spectra_get_wavelength(reference, i);
+		drift->weight[i] = 1.0;
+	}
+
+	ret = ocean_drift_set_reference(drift, reference);
+	if (ret < 0)
+		goto out;
+
+	*driftp = drift;
+	return 0;
+
+out:
+	ocean_drift_free(drift);
+	return ret;
+}
+
+api_public
+void ocean_drift_free(struct ocean_drift *drift)
+{
+	if (!drift)
+		return;
+
+	free(drift->work);
+	free(drift->ref_fft);
+	free(drift->bitrev);
+	free(drift->twiddle);
+	free(drift->corr);
+	free(drift->frame);
+	free(drift->reference);
+	free(drift->ref_data);
+	free(drift->weight);
+	free(drift->wavelength);
+	free(drift);
+}
+
+api_public
+int ocean_drift_set_reference(struct ocean_drift *drift, struct ocean_spectra *reference)
+{
+	const double *data;
+
+	if (!drift || !reference || ocean_spectra_get_size(reference) != drift->num_of_pixels)
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(reference);
+	if (!data)
+		return -EINVAL;
+
+	memcpy(drift->ref_data, data, drift->num_of_pixels * sizeof(double));
+	drift_update_reference(drift);
+	return 0;
+}
+
+api_public
+int ocean_drift_set_bands(struct ocean_drift *drift, const double *lower,
+			  const double *upper, size_t num_bands)
+{
+	size_t i, b;
+
+	if (!drift || (num_bands && (!lower || !upper)))
+		return -EINVAL;
+
+	for (i = 0; i < drift->num_of_pixels; i++) {
+		drift->weight[i] = num_bands ? 0.0 : 1.0;
+		for (b = 0; b < num_bands; b++) {
+			if (drift->wavelength[i] >= lower[b] && drift->wavelength[i] <= upper[b])
+				drift->weight[i] = 1.0;
+		}
+	}
+
+	drift_update_reference(drift);
+	return drift->ref_norm > 0.0 ? 0 : -ERANGE;
+}
+
+api_public
+int ocean_drift_set_method(struct ocean_drift *drift, enum ocean_drift_method method)
+{
+	if (!drift || (method != OCEAN_DRIFT_AUTO && method != OCEAN_DRIFT_DIRECT &&
+		       method != OCEAN_DRIFT_FFT))
+		return -EINVAL;
+
+	drift->method = method;
+	return 0;
+}
+
+api_public
+int ocean_drift_measure(struct ocean_drift *drift, const double *data, size_t len,
+			struct ocean_drift_result *result)
+{
+	const long max_shift = drift ? drift->max_shift : 0;
+	double norm, frac = 0.0, peak;
+	long best = 0, lag;
+
+	if (!drift || !data || !result || len != drift->num_of_pixels)
+		return -EINVAL;
+
+	norm = drift_prepare(drift, data, drift->frame, false);
+	if (norm == 0.0 || drift->ref_norm == 0.0)
+		return -ERANGE;
+
+	drift_correlate(drift);
+
+	for (lag = -max_shift; lag <= max_shift; lag++)
+		if (drift->corr[lag + max_shift] > drift->corr[best + max_shift])
+			best = lag;
+	peak = drift->corr[best + max_shift];
+
+	/* the vertex of the parabola through the peak and its neighbours */
+	if (best > -max_shift && best < max_shift) {
+		const double l = drift->corr[best + max_shift - 1];
+		const double r = drift->corr[best + max_shift + 1];
+		const double curv = l - 2.0 * peak + r;
+
+		if (curv < 0.0) {
+			frac = 0.5 * (l - r) / curv;
+			peak -= 0.25 * (l - r) * frac;
+		}
+	}
+
+	result->shift = best + frac;
+	result->shift_nm = drift_wavelength_at(drift, drift->center + result->shift) -
+			   drift_wavelength_at(drift, drift->center);
+	result->correlation = peak / (norm * drift->ref_norm);
+	return 0;
+}
+
+api_public
+int ocean_drift_update(struct ocean_drift *drift, struct ocean_spectra *spec,
+		       struct ocean_drift_result *result)
+{
+	if (!drift || !spec)
+		return -EINVAL;
+
+	return ocean_drift_measure(drift, ocean_spectra_get_data(spec),
+				   ocean_spectra_get_size(spec), result);
+}
@@ -1,30 +1,14 @@
 #include <libocean.h>
+#include <libocean-dummy.h>
 
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-#if !defined(WIN32)
-#  if __GNUC__ >= 4
-#    define api_public __attribute__((visibility("default")))
-#    define api_private __attribute__((visibility("hidden")))
-#  else
-#    define api_public
-#    define api_private
-#  endif
-#else
-#  define api_public
-#  define api_private
-#endif
-
-static const uint8_t raw1[] = {
-	0
-};
-
-static const uint8_t raw2[] = {
-	0
-};
+#include "libocean_util.h"
 
 /* SUN at a sunny spring day ;) */
 static const double spectrum1[] = {
@@ -270,6 +254,20 @@ struct ocean_spectra {
 	double *data;
 	size_t raw_size;
 	size_t data_size;
+	/* information about the last frame */
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t integration_time;
+	uint32_t flags;
+	struct ocean_spectra_stats stats;
+	uint64_t *saturation_map;
+	/* counts at which the detector clipped */
+	uint16_t saturation;
+	/* false for buffers of the caller */
+	bool own_raw;
+	bool own_data;
+	/* set if it was acquired from a pool */
+	struct ocean_spectra_pool *pool;
 };
 
 struct ocean_status {
@@ -290,8 +288,53 @@ struct ocean_status {
 
 struct ocean {
 	struct ocean_status status;
+	uint32_t trigger_timeout;
+	/* number of frames handed out since ocean_open() */
+	uint64_t sequence;
+	struct ocean_publisher *publisher;
+	struct ocean_exposure *exposure;
+	struct ocean_despike *despike;
+	struct ocean_savgol *savgol;
+	struct ocean_realtime rt;
+	/* the recording stretched over the pixels, one per frame */
+	double *scene[2];
+	double scene_max;
+	/* the simulated detector, see libocean-dummy.h */
+	struct ocean_dummy_model model;
+	bool simulate;
+	uint16_t saturation;
+	enum ocean_dummy_pacing pacing;
+	/* when the last frame was done integrating, monotonic ns */
+	uint64_t due;
+	uint64_t rng;
+	/* Box-Muller gives two values at a time */
+	double spare;
+	bool has_spare;
+	/* corrupted transfers still to come, see ocean_dummy_inject_fault() */
+	enum ocean_dummy_fault fault;
+	unsigned faults;
+	enum ocean_corrupt_policy corrupt_policy;
+	struct ocean_integrity_stats integrity;
+	/* see ocean_dummy_set_plugged(), the settings made through this
+	 * context are those of the device before it went away */
+	bool reconnect;
+	bool unplugged;
+	bool lost;
+	bool reconnected;
+	struct ocean_status settings;
 };
 
+#define OCEAN_DUMMY_MIN_PIXELS 512
+#define OCEAN_DUMMY_MAX_PIXELS 4096
+
+/* the NIRQuest sends a sync byte after every 512 pixels and at the end,
+ * see ocean_frame_length() */
+#define OCEAN_SYNC_INTERVAL 512
+#define OCEAN_SYNC_BYTE 0x69
+
+/* a corrupt frame is requested again, like on the device */
+#define OCEAN_RECV_RETRIES 2
+
 api_public
 int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ctx)
 {
@@ -305,12 +348,14 @@ int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ctx)
 		return -ENOMEM;
 	memset(s, 0, sizeof(*s));
 
-	s->raw_size = ctx->status.num_of_pixels * 2;
+	s->raw_size = ocean_frame_length(ctx->status.num_of_pixels);
 	s->raw = malloc(s->raw_size);
 	if (!s->raw) {
 		free(s);
 		return -ENOMEM;
 	}
+	s->own_raw = true;
+	s->saturation = ctx->saturation;
 
 	s->data_size = ctx->status.num_of_pixels;
 	s->data = malloc(s->data_size * sizeof(double));
@@ -319,27 +364,146 @@ int ocean_spectra_create(struct ocean_spectra **spec, struct ocean *ctx)
 		free(s);
 		return -ENOMEM;
 	}
+	s->own_data = true;
+
+	s->saturation_map = calloc((s->data_size + 63) / 64, sizeof(uint64_t));
+	if (!s->saturation_map) {
+		free(s->data);
+		free(s->raw);
+		free(s);
+		return -ENOMEM;
+	}
+
+	*spec = s;
+	return 0;
+}
+
+api_public
+int ocean_spectra_get_buffer_sizes(struct ocean *ctx, size_t *data_len, size_t *raw_len)
+{
+	if (!ctx || !data_len || !raw_len)
+		return -EINVAL;
+
+	*raw_len = ocean_frame_length(ctx->status.num_of_pixels);
+	*data_len = ctx->status.num_of_pixels * sizeof(double);
+	return 0;
+}
+
+api_public
+int ocean_spectra_rebind(struct ocean_spectra *spec, double *data, size_t data_len,
+			 uint8_t *raw, size_t raw_len)
+{
+	/* pooled spectra keep the memory of the pool */
+	if (!spec || !data || spec->pool)
+		return -EINVAL;
+
+	if ((uintptr_t)data % sizeof(double) ||
+	    data_len < spec->data_size * sizeof(double) ||
+	    (raw && raw_len < spec->raw_size))
+		return -EINVAL;
+
+	if (spec->own_data)
+		free(spec->data);
+	spec->data = data;
+	spec->own_data = false;
+
+	if (raw) {
+		if (spec->own_raw)
+			free(spec->raw);
+		spec->raw = raw;
+		spec->own_raw = false;
+	}
+
+	return 0;
+}
+
+api_public
+int ocean_spectra_create_with_buffers(struct ocean_spectra **spec, struct ocean *ctx,
+				      double *data, size_t data_len,
+				      uint8_t *raw, size_t raw_len)
+{
+	struct ocean_spectra *s;
+	int ret;
+
+	if (!spec)
+		return -EINVAL;
+
+	ret = ocean_spectra_create(&s, ctx);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_spectra_rebind(s, data, data_len, raw, raw_len);
+	if (ret < 0) {
+		ocean_spectra_free(s);
+		return ret;
+	}
 
 	*spec = s;
 	return 0;
 }
 
+#define SPECTRA_ALIGN 64
+#define SPECTRA_ALIGNED(x) (((x) + SPECTRA_ALIGN - 1) & ~(size_t)(SPECTRA_ALIGN - 1))
+
+api_private
+size_t ocean_spectra_footprint(struct ocean_spectra *tmpl)
+{
+	return SPECTRA_ALIGNED(sizeof(*tmpl)) +
+	       SPECTRA_ALIGNED(tmpl->raw_size) +
+	       SPECTRA_ALIGNED(tmpl->data_size * sizeof(double)) +
+	       SPECTRA_ALIGNED((tmpl->data_size + 63) / 64 * sizeof(uint64_t));
+}
+
+api_private
+struct ocean_spectra *ocean_spectra_place(void *mem, struct ocean_spectra *tmpl,
+					  struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra *s = mem;
+	uint8_t *ptr = mem;
+
+	*s = *tmpl;
+	ptr += SPECTRA_ALIGNED(sizeof(*s));
+	s->raw = ptr;
+	ptr += SPECTRA_ALIGNED(s->raw_size);
+	s->data = (double *)ptr;
+	ptr += SPECTRA_ALIGNED(s->data_size * sizeof(double));
+	s->saturation_map = (uint64_t *)ptr;
+	s->pool = pool;
+
+	return s;
+}
+
+api_private
+struct ocean_spectra_pool *ocean_spectra_pool_of(struct ocean_spectra *spec)
+{
+	return spec->pool;
+}
+
 api_public
 void ocean_spectra_free(struct ocean_spectra *spec)
 {
 	if (!spec)
 		return;
 
+	/* the memory belongs to the pool */
+	if (spec->pool) {
+		ocean_spectra_release(spec);
+		return;
+	}
+
 	if (spec->data) {
-		free(spec->data);
+		if (spec->own_data)
+			free(spec->data);
 		spec->data = NULL;
 	}
 
 	if (spec->raw) {
-		free(spec->raw);
+		if (spec->own_raw)
+			free(spec->raw);
 		spec->raw = NULL;
 	}
 
+	free(spec->saturation_map);
 	free(spec);
 	spec = NULL;
 }
@@ -356,6 +520,52 @@ double *ocean_spectra_get_data(struct ocean_spectra *spec)
 	return spec ? spec->data : NULL;
 }
 
+api_public
+uint64_t ocean_spectra_get_sequence(struct ocean_spectra *spec)
+{
+	return spec ? spec->sequence : 0;
+}
+
+api_public
+uint64_t ocean_spectra_get_timestamp(struct ocean_spectra *spec)
+{
+	return spec ? spec->timestamp : 0;
+}
+
+api_public
+uint32_t ocean_spectra_get_integration_time(struct ocean_spectra *spec)
+{
+	return spec ? spec->integration_time : 0;
+}
+
+api_public
+uint32_t ocean_spectra_get_flags(struct ocean_spectra *spec)
+{
+	return spec ? spec->flags : 0;
+}
+
+api_public
+int ocean_spectra_get_stats(struct ocean_spectra *spec, struct ocean_spectra_stats *stats)
+{
+	if (!spec || !stats)
+		return -EINVAL;
+
+	*stats = spec->stats;
+	return 0;
+}
+
+api_public
+const uint64_t *ocean_spectra_get_saturation_map(struct ocean_spectra *spec)
+{
+	return spec ? spec->saturation_map : NULL;
+}
+
+api_public
+double ocean_spectra_get_saturation(struct ocean_spectra *spec)
+{
+	return spec ? 65535.0 : 0.0;
+}
+
 api_public
 size_t ocean_spectra_get_raw_size(struct ocean_spectra *spec)
 {
@@ -369,22 +579,76 @@ uint8_t *ocean_spectra_get_raw_data(struct ocean_spectra *spec)
 }
 
 api_public
-double ocean_spectra_get_wavelength(struct ocean_spectra *spec, int pixel)
+double ocean_spectra_get_wavelength_at(struct ocean_spectra *spec, double pixel)
 {
 	static const double coef[] = { 8.994393E+02, 1.624139E+00, -9.097670E-05, 3.679440E-08 };
 	double value = 0.0;
 	int order;
 
+	/* the same range, whatever the number of pixels */
+	if (spec)
+		pixel *= (double)OCEAN_DUMMY_MIN_PIXELS / spec->data_size;
+
 	for (order = 3; order > 0; order--)
 		value = pixel * (coef[order] + value);
 
 	return coef[0] + value;
 }
 
+api_public
+double ocean_spectra_get_wavelength(struct ocean_spectra *spec, int pixel)
+{
+	return ocean_spectra_get_wavelength_at(spec, pixel);
+}
+
+/* @rec stretched over @len pixels, linearly interpolated */
+static void ocean_dummy_resample(double *scene, size_t len, const double *rec, size_t rec_len)
+{
+	const double step = (double)(rec_len - 1) / (len - 1);
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		const double x = i * step;
+		const size_t k = (size_t)x;
+
+		if (k + 1 >= rec_len)
+			scene[i] = rec[rec_len - 1];
+		else
+			scene[i] = rec[k] + (x - k) * (rec[k + 1] - rec[k]);
+	}
+}
+
+static int ocean_dummy_stretch(struct ocean *ctx, size_t num_of_pixels)
+{
+	double *scene;
+	size_t i;
+
+	scene = malloc(2 * num_of_pixels * sizeof(double));
+	if (!scene)
+		return -ENOMEM;
+
+	ocean_dummy_resample(scene, num_of_pixels, spectrum1, ARRAY_SIZE(spectrum1));
+	ocean_dummy_resample(scene + num_of_pixels, num_of_pixels, spectrum2,
+			     ARRAY_SIZE(spectrum2));
+
+	free(ctx->scene[0]);
+	ctx->scene[0] = scene;
+	ctx->scene[1] = scene + num_of_pixels;
+
+	ctx->scene_max = 0.0;
+	for (i = 0; i < num_of_pixels; i++)
+		if (scene[i] > ctx->scene_max)
+			ctx->scene_max = scene[i];
+
+	ctx->status.num_of_pixels = num_of_pixels;
+	return 0;
+}
+
 api_public
 int ocean_create(struct ocean **oceanp)
 {
 	struct ocean *ctx = NULL;
+	int ret;
 
 	ctx = malloc(sizeof(*ctx));
 	if (!ctx)
@@ -392,10 +656,18 @@ int ocean_create(struct ocean **oceanp)
 
 	memset(ctx, 0, sizeof(*ctx));
 
-	ctx->status.num_of_pixels     = 0x200;
 	ctx->status.integration_time  = 0x64;
 	ctx->status.fan_and_tec_state = 0x18;
 
+	ret = ocean_dummy_stretch(ctx, 0x200);
+	if (ret < 0) {
+		free(ctx);
+		return ret;
+	}
+
+	ocean_dummy_model_init(&ctx->model);
+	ctx->saturation = 0xffff;
+
 	*oceanp = ctx;
 	return 0;
 }
@@ -406,16 +678,30 @@ void ocean_free(struct ocean *ctx)
 	if (!ctx)
 		return;
 
+	free(ctx->scene[0]);
 	free(ctx);
 	ctx = NULL;
 }
 
+/* restarts the noise, the same seed gives the same frames again */
+static void ocean_dummy_seed(struct ocean *ctx)
+{
+	ctx->rng = ((uint64_t)ctx->model.seed << 32) | 0x9e3779b9;
+	ctx->has_spare = false;
+}
+
 api_public
 int ocean_open(struct ocean *ctx, uint16_t vendor, uint16_t product)
 {
 	if (!ctx)
 		return -EINVAL;
 
+	ctx->sequence = 0;
+	ctx->due = 0;
+	ctx->lost = false;
+	ctx->reconnected = false;
+	ocean_dummy_seed(ctx);
+
 	// TODO: implement read-out from CSV files
 	return 0;
 }
@@ -537,30 +823,450 @@ int ocean_enable_external_trigger(struct ocean *ctx, bool enable)
 	return 0;
 }
 
+api_public
+int ocean_set_trigger_timeout(struct ocean *ctx, uint32_t timeout)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->trigger_timeout = timeout;
+	return 0;
+}
+
+/* the frames of the dummy arrive at once */
+api_public
+int ocean_set_chunked_transfer(struct ocean *ctx, unsigned packets)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	return 0;
+}
+
+api_public
+int ocean_set_corrupt_policy(struct ocean *ctx, enum ocean_corrupt_policy policy)
+{
+	if (!ctx || (policy != OCEAN_CORRUPT_DROP && policy != OCEAN_CORRUPT_FLAG))
+		return -EINVAL;
+
+	ctx->corrupt_policy = policy;
+	return 0;
+}
+
+api_public
+int ocean_get_integrity_stats(struct ocean *ctx, struct ocean_integrity_stats *stats)
+{
+	if (!ctx || !stats)
+		return -EINVAL;
+
+	ocean_integrity_get(&ctx->integrity, stats);
+	return 0;
+}
+
+/* the dummy only goes away through ocean_dummy_set_plugged() */
+api_public
+int ocean_set_reconnect(struct ocean *ctx, bool enable)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->reconnect = enable;
+	return 0;
+}
+
+/* Like the usb backend: -ENODEV until the device is back, then it gets
+ * the settings again */
+static int ocean_dummy_check_connection(struct ocean *ctx)
+{
+	if (!ctx->lost)
+		return 0;
+	if (!ctx->reconnect || ctx->unplugged)
+		return -ENODEV;
+
+	ctx->status.integration_time = ctx->settings.integration_time;
+	ctx->status.lamp_enable = ctx->settings.lamp_enable;
+	ctx->status.trigger_mode = ctx->settings.trigger_mode;
+	ctx->status.fan_and_tec_state = ctx->settings.fan_and_tec_state;
+	ctx->lost = false;
+	ctx->reconnected = true;
+	return 0;
+}
+
+/* xorshift64*, uniform in (0, 1] */
+static double ocean_dummy_uniform(struct ocean *ctx)
+{
+	ctx->rng ^= ctx->rng >> 12;
+	ctx->rng ^= ctx->rng << 25;
+	ctx->rng ^= ctx->rng >> 27;
+	return ((ctx->rng * 0x2545f4914f6cdd1dull) >> 11) * 0x1p-53 + 0x1p-53;
+}
+
+/* standard normal, Box-Muller */
+static double ocean_dummy_gauss(struct ocean *ctx)
+{
+	double r, phi;
+
+	if (ctx->has_spare) {
+		ctx->has_spare = false;
+		return ctx->spare;
+	}
+
+	r = sqrt(-2.0 * log(ocean_dummy_uniform(ctx)));
+	phi = 2.0 * M_PI * ocean_dummy_uniform(ctx);
+
+	ctx->spare = r * sin(phi);
+	ctx->has_spare = true;
+	return r * cos(phi);
+}
+
+/*
+ * Waits until the frame is done integrating: right after the previous one
+ * if that was picked up in time, else the detector starts on the request.
+ * Returns when the frame was due.
+ */
+static uint64_t ocean_dummy_pace(struct ocean *ctx, uint64_t start, uint32_t integration_time)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	if (ctx->pacing != OCEAN_DUMMY_PACED)
+		return start;
+
+	if (ctx->due < start)
+		ctx->due = start;
+	ctx->due += integration_time * 1000000ull;
+
+	while ((now = ocean_monotonic()) < ctx->due) {
+		ts.tv_sec = (ctx->due - now) / 1000000000ull;
+		ts.tv_nsec = (ctx->due - now) % 1000000000ull;
+		nanosleep(&ts, NULL);
+	}
+
+	return ctx->due;
+}
+
+/* Writes the counts of the next frame into the raw data, the way the
+ * NIRQuest sends them */
+static void ocean_dummy_render(struct ocean *ctx, struct ocean_spectra *spec,
+			       uint32_t integration_time)
+{
+	const struct ocean_dummy_model *m = &ctx->model;
+	const double *scene = ctx->scene[ctx->status.spectral_data_counter % 2 ? 0 : 1];
+	const double scale = m->signal_rate * integration_time / ctx->scene_max;
+	const double dark = m->dark_rate * integration_time;
+	const double read_var = m->read_noise * m->read_noise;
+	uint8_t *raw = spec->raw;
+	size_t i;
+
+	if (ctx->simulate)
+		scene = ctx->scene[0];
+
+	for (i = 0; i < spec->data_size; i++) {
+		double value = scene[i];
+		unsigned val;
+
+		if (ctx->simulate) {
+			const double signal = value * scale + dark;
+			const double var = read_var + (m->gain > 0.0 ? signal / m->gain : 0.0);
+
+			value = m->offset + signal;
+			if (var > 0.0)
+				value += sqrt(var) * ocean_dummy_gauss(ctx);
+		}
+
+		if (value < 0.0)
+			value = 0.0;
+		if (value > ctx->saturation)
+			value = ctx->saturation;
+
+		val = (unsigned)(value + 0.5) ^ 0x8000;
+		*raw++ = val & 0xff;
+		*raw++ = val >> 8;
+		if ((i + 1) % OCEAN_SYNC_INTERVAL == 0)
+			*raw++ = OCEAN_SYNC_BYTE;
+	}
+	if (spec->data_size % OCEAN_SYNC_INTERVAL)
+		*raw++ = OCEAN_SYNC_BYTE;
+}
+
+/* Spoils the frame just rendered if asked to. Returns the number of bytes
+ * received. */
+static size_t ocean_dummy_transfer(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	if (!ctx->faults)
+		return spec->raw_size;
+	ctx->faults--;
+
+	if (ctx->fault == OCEAN_DUMMY_SHORT_FRAME)
+		return spec->raw_size / 2;
+
+	/* a byte lost on the bus, everything behind it moves up */
+	memmove(spec->raw, spec->raw + 1, spec->raw_size - 1);
+	spec->raw[spec->raw_size - 1] = 0;
+	return spec->raw_size;
+}
+
+/* The checks of the device, see ocean_verify(). Returns whether the frame
+ * is handed out. */
+static bool ocean_dummy_verify(struct ocean *ctx, struct ocean_spectra *spec, size_t done)
+{
+	enum ocean_frame_error err = ocean_frame_check(spec->raw, done, spec->data_size);
+
+	ocean_integrity_count(&ctx->integrity, err);
+	if (err == OCEAN_FRAME_INTACT)
+		return true;
+
+	if (ctx->corrupt_policy == OCEAN_CORRUPT_FLAG) {
+		spec->flags |= OCEAN_FRAME_CORRUPT;
+		return true;
+	}
+
+	__atomic_add_fetch(&ctx->integrity.dropped, 1, __ATOMIC_RELAXED);
+	return false;
+}
+
+/* The decoding of the NIRQuest, without the non-linearity correction */
+static void ocean_spectra_decode(struct ocean_spectra *spec)
+{
+	const double scale = 65535.0 / spec->saturation;
+	/* the last value is not handed out, see ocean_spectra_get_size() */
+	const size_t len = spec->data_size - 1;
+	struct ocean_spectra_stats stats = {
+		.min = HUGE_VAL,
+		.max = -HUGE_VAL,
+	};
+	double sum = 0.0;
+	size_t i = 0, j;
+
+	memset(spec->saturation_map, 0, (spec->data_size + 63) / 64 * sizeof(uint64_t));
+	for (j = 0; j < spec->data_size; j++) {
+		const uint16_t val = ((spec->raw[i + 1] << 8) | spec->raw[i]) ^ 0x8000;
+		const double value = val * scale;
+
+		spec->data[j] = value;
+		if (j < len) {
+			sum += value;
+			if (value < stats.min)
+				stats.min = value;
+			if (value > stats.max) {
+				stats.max = value;
+				stats.peak = j;
+			}
+			if (val >= spec->saturation) {
+				spec->saturation_map[j / 64] |= 1ull << (j % 64);
+				stats.saturated++;
+			}
+		}
+
+		i += 2;
+		if ((j + 1) % OCEAN_SYNC_INTERVAL == 0)
+			i++;
+	}
+
+	stats.mean = sum / len;
+	spec->stats = stats;
+}
+
 api_public
 int ocean_request_spectra(struct ocean *ctx, struct ocean_spectra *spec)
 {
-	const double *data;
-	const uint8_t *raw;
+	const uint64_t start = ocean_monotonic();
+	uint64_t due;
+	int retry, ret;
+
+	if (!ctx || !spec || spec->data_size != ctx->status.num_of_pixels)
+		return -EINVAL;
+
+	/* frames handed to several consumers are immutable */
+	if (ocean_spectra_shared(spec))
+		return -EBUSY;
+
+	ret = ocean_dummy_check_connection(ctx);
+	if (ret < 0)
+		return ret;
+
+	spec->flags = 0;
+	for (retry = 0; ; retry++) {
+		due = ocean_dummy_pace(ctx, start, ctx->status.integration_time);
+		ocean_dummy_render(ctx, spec, ctx->status.integration_time);
+		ctx->status.spectral_data_counter++;
+		if (ocean_dummy_verify(ctx, spec, ocean_dummy_transfer(ctx, spec)))
+			break;
+
+		/* the rest of the frame is flushed */
+		__atomic_add_fetch(&ctx->integrity.resyncs, 1, __ATOMIC_RELAXED);
+		if (retry == OCEAN_RECV_RETRIES)
+			return -EBADMSG;
+	}
+	spec->saturation = ctx->saturation;
+	ocean_spectra_decode(spec);
+
+	spec->timestamp = ocean_timestamp();
+	spec->sequence = ctx->sequence++;
+	spec->integration_time = ctx->status.integration_time;
+	if (ctx->reconnected) {
+		spec->flags |= OCEAN_FRAME_RECONNECTED;
+		ctx->reconnected = false;
+	}
+
+	/* unthrottled there is no integration time to wait for, the frame is
+	 * due at once */
+	ocean_realtime_account(&ctx->rt, ocean_monotonic() - due);
+
+	if (ctx->despike) {
+		ret = ocean_despike_process(ctx->despike, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (ctx->savgol) {
+		ret = ocean_savgol_process(ctx->savgol, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (ctx->exposure) {
+		ret = ocean_exposure_update(ctx->exposure, ctx, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (ctx->publisher)
+		return ocean_publisher_publish(ctx->publisher, spec);
+
+	return 0;
+}
+
+api_public
+int ocean_request_spectra_batch(struct ocean *ctx, struct ocean_spectra *spec,
+				size_t n, struct ocean_batch *batch)
+{
+	size_t i;
+	int ret;
+
+	if (!ctx || !spec || !batch ||
+	    ocean_batch_get_num_of_pixels(batch) != ocean_spectra_get_size(spec))
+		return -EINVAL;
+
+	if (n > ocean_batch_get_capacity(batch) - ocean_batch_get_size(batch))
+		return -ENOSPC;
+
+	for (i = 0; i < n; i++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_batch_append(batch, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
 
-	if (!ctx || !spec)
+/* nothing to pipeline, the settings are plain fields */
+api_public
+int ocean_plan_run(struct ocean *ctx, struct ocean_plan *plan, struct ocean_spectra *spec,
+		   struct ocean_batch *batch)
+{
+	const struct ocean_status before = ctx ? ctx->status : (struct ocean_status){ 0 };
+	const struct ocean_plan_step *step;
+	struct ocean_exposure *exposure;
+	size_t n, i;
+	unsigned k, applied = UINT_MAX;
+	int ret = 0;
+
+	n = ocean_plan_get_num_of_frames(plan);
+	if (!ctx || !spec || !batch || !n ||
+	    ocean_batch_get_num_of_pixels(batch) != ocean_spectra_get_size(spec))
 		return -EINVAL;
 
-	if (ctx->status.spectral_data_counter % 2) {
-		raw = raw1;
-		data = spectrum1;
-	} else {
-		raw = raw2;
-		data = spectrum2;
+	if (n > ocean_batch_get_capacity(batch) - ocean_batch_get_size(batch))
+		return -ENOSPC;
+
+	/* the plan decides the settings, not the automatic exposure */
+	exposure = ctx->exposure;
+	ctx->exposure = NULL;
+	for (i = 0; i < n && ret == 0; i++) {
+		/* like the device, the settings are sent once per step */
+		step = ocean_plan_step_of(plan, i, &k);
+		if (k != applied) {
+			ocean_set_integration_time(ctx, step->integration_time);
+			ocean_enable_strob(ctx, step->strobe);
+			ocean_enable_external_trigger(ctx, step->external_trigger);
+			applied = k;
+		}
+
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_batch_append(batch, spec);
+		if (ret == 0)
+			ocean_batch_set_step(batch, k);
 	}
 
-	memcpy(spec->raw, raw, spec->raw_size * sizeof(*raw));
-	memcpy(spec->data, data, spec->data_size * sizeof(*data));
+	ctx->exposure = exposure;
+	ctx->status.integration_time = before.integration_time;
+	ctx->status.lamp_enable = before.lamp_enable;
+	ctx->status.trigger_mode = before.trigger_mode;
+	return ret;
+}
 
-	ctx->status.spectral_data_counter++;
+api_public
+int ocean_set_publisher(struct ocean *ctx, struct ocean_publisher *pub)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->publisher = pub;
 	return 0;
 }
 
+api_public
+int ocean_set_auto_exposure(struct ocean *ctx, struct ocean_exposure *exp)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->exposure = exp;
+	return 0;
+}
+
+api_public
+int ocean_set_despike(struct ocean *ctx, struct ocean_despike *ds)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->despike = ds;
+	return 0;
+}
+
+api_public
+int ocean_set_savgol(struct ocean *ctx, struct ocean_savgol *sg)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	ctx->savgol = sg;
+	return 0;
+}
+
+api_public
+int ocean_set_realtime(struct ocean *ctx, int cpu, int priority)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	return ocean_realtime_enter(&ctx->rt, cpu, priority);
+}
+
+api_public
+int ocean_get_realtime_stats(struct ocean *ctx, struct ocean_realtime_stats *stats)
+{
+	if (!ctx || !stats)
+		return -EINVAL;
+
+	return ocean_realtime_get(&ctx->rt, stats);
+}
+
 api_public
 int ocean_stop_spectral_acquisition(struct ocean *ctx)
 {
@@ -580,3 +1286,146 @@ int ocean_get_num_of_pixel(struct ocean *ctx, uint32_t *num_of_pixel)
 	*num_of_pixel = (uint32_t)ctx->status.num_of_pixels;
 	return 0;
 }
+
+api_public
+void ocean_dummy_model_init(struct ocean_dummy_model *model)
+{
+	if (!model)
+		return;
+
+	/* the recorded sun at 100 ms */
+	model->signal_rate = 450.0;
+	model->dark_rate = 2.0;
+	model->offset = 800.0;
+	model->read_noise = 12.0;
+	model->gain = 10.0;
+	model->saturation = 0xffff;
+	model->seed = 1;
+}
+
+api_public
+int ocean_dummy_set_model(struct ocean *ctx, const struct ocean_dummy_model *model)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	if (!model) {
+		ctx->simulate = false;
+		ctx->saturation = 0xffff;
+		return 0;
+	}
+
+	if (model->signal_rate < 0.0 || model->dark_rate < 0.0 || model->read_noise < 0.0 ||
+	    model->gain < 0.0 || !model->saturation)
+		return -EINVAL;
+
+	ctx->model = *model;
+	ctx->simulate = true;
+	ctx->saturation = model->saturation;
+	ocean_dummy_seed(ctx);
+	return 0;
+}
+
+api_public
+int ocean_dummy_set_num_of_pixels(struct ocean *ctx, uint32_t num_of_pixels)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	if (num_of_pixels < OCEAN_DUMMY_MIN_PIXELS || num_of_pixels > OCEAN_DUMMY_MAX_PIXELS)
+		return -ERANGE;
+
+	return ocean_dummy_stretch(ctx, num_of_pixels);
+}
+
+api_public
+int ocean_dummy_set_pacing(struct ocean *ctx, enum ocean_dummy_pacing pacing)
+{
+	if (!ctx || (pacing != OCEAN_DUMMY_UNTHROTTLED && pacing != OCEAN_DUMMY_PACED))
+		return -EINVAL;
+
+	ctx->pacing = pacing;
+	ctx->due = 0;
+	return 0;
+}
+
+api_public
+int ocean_dummy_inject_fault(struct ocean *ctx, enum ocean_dummy_fault fault, unsigned count)
+{
+	if (!ctx || (fault != OCEAN_DUMMY_SHORT_FRAME && fault != OCEAN_DUMMY_BAD_SYNC))
+		return -EINVAL;
+
+	ctx->fault = fault;
+	ctx->faults = count;
+	return 0;
+}
+
+api_public
+int ocean_dummy_set_plugged(struct ocean *ctx, bool plugged)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	if (!plugged && !ctx->unplugged) {
+		ctx->settings = ctx->status;
+		ctx->lost = true;
+	} else if (plugged && ctx->unplugged) {
+		/* a fresh device, at its power on settings */
+		ctx->status.integration_time = 0x64;
+		ctx->status.lamp_enable = 0;
+		ctx->status.trigger_mode = 0;
+		ctx->status.fan_and_tec_state = 0x18;
+	}
+
+	ctx->unplugged = !plugged;
+	return 0;
+}
+
+api_private
+int ocean_housekeeping_poll(struct ocean *ctx, struct ocean_housekeeping *hk)
+{
+	int ret;
+
+	ret = ocean_get_temperature(ctx, &hk->pcb, &hk->sink);
+	if (ret < 0)
+		return ret;
+
+	hk->integration_time = ctx->status.integration_time;
+	hk->fan_and_tec_state = ctx->status.fan_and_tec_state;
+	hk->lamp_enable = ctx->status.lamp_enable;
+	hk->trigger_mode = ctx->status.trigger_mode;
+	hk->power_state = ctx->status.power_state;
+	return 0;
+}
+
+api_private
+void ocean_spectra_set_replaced(struct ocean_spectra *spec, size_t replaced)
+{
+	spec->stats.replaced = replaced;
+}
+
+api_private
+void ocean_spectra_set_stats(struct ocean_spectra *spec, const struct ocean_spectra_stats *stats)
+{
+	spec->stats = *stats;
+}
+
+/* the dummy knows no corrections, but the data is scaled to the saturation */
+api_private
+size_t ocean_spectra_get_counts(struct ocean_spectra *spec, double *counts, size_t len)
+{
+	size_t i = 0, j;
+
+	if (len > spec->data_size)
+		len = spec->data_size;
+
+	for (j = 0; j < len; j++) {
+		counts[j] = ((spec->raw[i + 1] << 8) | spec->raw[i]) ^ 0x8000;
+
+		i += 2;
+		if ((j + 1) % OCEAN_SYNC_INTERVAL == 0)
+			i++;
+	}
+
+	return len;
+}
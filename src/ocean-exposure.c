@@ -0,0 +1,228 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * The level of a frame is a high percentile of its intensities, read from
+ * a histogram over [0, saturation], so a few hot pixels or a single line
+ * do not drive the exposure. The counts grow linearly with the integration
+ * time on top of the dark offset: the first step scales the time
+ * proportionally, later steps fit offset and slope through the last two
+ * unsaturated frames (secant), which lands within the tolerance after two
+ * or three frames.
+ */
+#define EXPOSURE_BINS 1024
+/* largest factor a single step may change the integration time by */
+#define EXPOSURE_MAX_STEP 16.0
+/* back off this much from a saturated frame, the level is unknown */
+#define EXPOSURE_SATURATED_STEP 0.25
+
+struct ocean_exposure {
+	double target;
+	double percentile;
+	double tolerance;
+	uint32_t min;
+	uint32_t max;
+	/* last unsaturated frame */
+	bool has_last;
+	uint32_t last_time;
+	double last_level;
+	unsigned histogram[EXPOSURE_BINS];
+};
+
+api_public
+int ocean_exposure_create(struct ocean_exposure **expp)
+{
+	struct ocean_exposure *exp;
+
+	if (!expp)
+		return -EINVAL;
+
+	exp = malloc(sizeof(*exp));
+	if (!exp)
+		return -ENOMEM;
+	memset(exp, 0, sizeof(*exp));
+
+	exp->target = 0.75;
+	exp->percentile = 0.98;
+	exp->tolerance = 0.05;
+	exp->min = 1;
+	exp->max = 10000;
+
+	*expp = exp;
+	return 0;
+}
+
+api_public
+void ocean_exposure_free(struct ocean_exposure *exp)
+{
+	free(exp);
+}
+
+api_public
+int ocean_exposure_set_target(struct ocean_exposure *exp, double target)
+{
+	if (!exp || !(target > 0.0 && target < 1.0))
+		return -EINVAL;
+
+	exp->target = target;
+	return 0;
+}
+
+api_public
+int ocean_exposure_set_percentile(struct ocean_exposure *exp, double percentile)
+{
+	if (!exp || !(percentile >= 0.0 && percentile <= 1.0))
+		return -EINVAL;
+
+	exp->percentile = percentile;
+	return 0;
+}
+
+api_public
+int ocean_exposure_set_limits(struct ocean_exposure *exp, uint32_t min, uint32_t max)
+{
+	if (!exp || min == 0 || min > max)
+		return -EINVAL;
+
+	exp->min = min;
+	exp->max = max;
+	return 0;
+}
+
+api_public
+int ocean_exposure_set_hysteresis(struct ocean_exposure *exp, double tolerance)
+{
+	if (!exp || !(tolerance >= 0.0 && tolerance < 1.0))
+		return -EINVAL;
+
+	exp->tolerance = tolerance;
+	return 0;
+}
+
+api_public
+void ocean_exposure_reset(struct ocean_exposure *exp)
+{
+	if (exp)
+		exp->has_last = false;
+}
+
+/* Returns the percentile of @data, or a negative value if it is saturated */
+static double ocean_exposure_level(struct ocean_exposure *exp, const double *data,
+				   size_t len, double saturation)
+{
+	const double scale = EXPOSURE_BINS / saturation;
+	size_t i, rank, sum;
+	unsigned bin;
+
+	memset(exp->histogram, 0, sizeof(exp->histogram));
+	for (i = 0; i < len; i++) {
+		const double pos = data[i] * scale;
+
+		if (pos <= 0.0)
+			bin = 0;
+		else if (pos >= EXPOSURE_BINS - 1)
+			bin = EXPOSURE_BINS - 1;
+		else
+			bin = (unsigned)pos;
+		exp->histogram[bin]++;
+	}
+
+	/* the (1 - percentile) brightest pixels lie above the level */
+	rank = (size_t)((1.0 - exp->percentile) * len);
+	if (rank >= len)
+		rank = len - 1;
+	for (bin = EXPOSURE_BINS, sum = 0; bin-- > 0;) {
+		if (sum + exp->histogram[bin] > rank)
+			break;
+		sum += exp->histogram[bin];
+	}
+
+	if (bin == EXPOSURE_BINS - 1)
+		return -1.0;
+
+	/* interpolate within the bin, its pixels spread evenly */
+	return (bin + 1 - (rank - sum + 0.5) / exp->histogram[bin]) / scale;
+}
+
+api_public
+uint32_t ocean_exposure_next(struct ocean_exposure *exp, const double *data, size_t len,
+			     double saturation, uint32_t integration_time)
+{
+	const double time = integration_time;
+	double level, target, next = time;
+
+	if (!exp || !data || len == 0 || !(saturation > 0.0) || integration_time == 0)
+		return integration_time;
+
+	target = exp->target * saturation;
+	level = ocean_exposure_level(exp, data, len, saturation);
+
+	if (level < 0.0) {
+		next = time * EXPOSURE_SATURATED_STEP;
+	} else if (fabs(level - target) > exp->tolerance * target) {
+		bool secant = false;
+
+		if (exp->has_last && exp->last_time != integration_time) {
+			const double slope = (level - exp->last_level) / (time - exp->last_time);
+			const double offset = level - slope * time;
+
+			/* the light may have changed meanwhile, only trust a
+			 * fit that looks like a detector */
+			if (slope > 0.0 && offset < target && offset > -0.5 * saturation) {
+				next = time + (target - level) / slope;
+				secant = true;
+			}
+		}
+
+		if (!secant)
+			next = level > 0.0 ? time * target / level : time * EXPOSURE_MAX_STEP;
+
+		if (next > time * EXPOSURE_MAX_STEP)
+			next = time * EXPOSURE_MAX_STEP;
+		else if (next < time / EXPOSURE_MAX_STEP)
+			next = time / EXPOSURE_MAX_STEP;
+	}
+
+	if (level >= 0.0) {
+		exp->has_last = true;
+		exp->last_time = integration_time;
+		exp->last_level = level;
+	}
+
+	next = round(next);
+	if (next < exp->min)
+		return exp->min;
+	if (next > exp->max)
+		return exp->max;
+	return (uint32_t)next;
+}
+
+api_public
+int ocean_exposure_update(struct ocean_exposure *exp, struct ocean *ctx,
+			  struct ocean_spectra *spec)
+{
+	uint32_t time, next;
+	int ret;
+
+	if (!exp || !ctx || !spec)
+		return -EINVAL;
+
+	/* the time the frame was taken with, not the one set meanwhile */
+	time = ocean_spectra_get_integration_time(spec);
+	next = ocean_exposure_next(exp, ocean_spectra_get_data(spec),
+				   ocean_spectra_get_size(spec),
+				   ocean_spectra_get_saturation(spec), time);
+	if (next == time)
+		return 0;
+
+	ret = ocean_set_integration_time(ctx, next);
+	if (ret < 0)
+		return ret;
+
+	return 1;
+}
@@ -0,0 +1,266 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * The registry is a list of consumers, each one with a ring of frames
+ * behind its own lock, so a slow consumer only ever holds up the
+ * publisher if it asked for it (OCEAN_BLOCK). Queuing a frame takes a
+ * reference of the pooled spectra, nothing is copied. Frames dropped to
+ * make room are released outside the lock, that may hand them back to
+ * the pool.
+ */
+struct ocean_consumer {
+	struct ocean_consumer *next;
+	pthread_mutex_t lock;
+	/* a frame was queued or taken */
+	pthread_cond_t cond;
+	enum ocean_backpressure policy;
+	unsigned depth;
+	struct ocean_spectra **queue;
+	unsigned head;
+	unsigned len;
+	/* set while unsubscribing, a blocked publisher gives up on it */
+	bool closing;
+	uint64_t dropped;
+};
+
+struct ocean_fanout {
+	/* held while publishing, and to change the list */
+	pthread_mutex_t lock;
+	struct ocean_consumer *consumers;
+};
+
+api_public
+int ocean_fanout_create(struct ocean_fanout **fop)
+{
+	struct ocean_fanout *fo;
+
+	if (!fop)
+		return -EINVAL;
+
+	fo = malloc(sizeof(*fo));
+	if (!fo)
+		return -ENOMEM;
+	memset(fo, 0, sizeof(*fo));
+
+	pthread_mutex_init(&fo->lock, NULL);
+
+	*fop = fo;
+	return 0;
+}
+
+api_public
+void ocean_fanout_free(struct ocean_fanout *fo)
+{
+	if (!fo)
+		return;
+
+	pthread_mutex_destroy(&fo->lock);
+	free(fo);
+}
+
+api_public
+int ocean_fanout_subscribe(struct ocean_fanout *fo, struct ocean_consumer **consumer,
+			   unsigned depth, enum ocean_backpressure policy)
+{
+	struct ocean_consumer *c;
+	pthread_condattr_t attr;
+
+	if (!fo || !consumer || depth == 0 ||
+	    (policy != OCEAN_DROP_NEWEST && policy != OCEAN_DROP_OLDEST && policy != OCEAN_BLOCK))
+		return -EINVAL;
+
+	c = malloc(sizeof(*c));
+	if (!c)
+		return -ENOMEM;
+	memset(c, 0, sizeof(*c));
+
+	c->queue = malloc(depth * sizeof(*c->queue));
+	if (!c->queue) {
+		free(c);
+		return -ENOMEM;
+	}
+	c->depth = depth;
+	c->policy = policy;
+
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&c->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_mutex_lock(&fo->lock);
+	c->next = fo->consumers;
+	fo->consumers = c;
+	pthread_mutex_unlock(&fo->lock);
+
+	*consumer = c;
+	return 0;
+}
+
+api_public
+void ocean_fanout_unsubscribe(struct ocean_fanout *fo, struct ocean_consumer *consumer)
+{
+	struct ocean_consumer **pos;
+
+	if (!fo || !consumer)
+		return;
+
+	/* first wake a publisher waiting for room, it holds the registry */
+	pthread_mutex_lock(&consumer->lock);
+	consumer->closing = true;
+	pthread_cond_broadcast(&consumer->cond);
+	pthread_mutex_unlock(&consumer->lock);
+
+	pthread_mutex_lock(&fo->lock);
+	for (pos = &fo->consumers; *pos; pos = &(*pos)->next) {
+		if (*pos == consumer) {
+			*pos = consumer->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&fo->lock);
+
+	for (; consumer->len; consumer->len--) {
+		ocean_spectra_release(consumer->queue[consumer->head]);
+		consumer->head = (consumer->head + 1) % consumer->depth;
+	}
+
+	pthread_cond_destroy(&consumer->cond);
+	pthread_mutex_destroy(&consumer->lock);
+	free(consumer->queue);
+	free(consumer);
+}
+
+static void ocean_consumer_push(struct ocean_consumer *c, struct ocean_spectra *spec)
+{
+	struct ocean_spectra *dropped = NULL;
+
+	pthread_mutex_lock(&c->lock);
+	if (c->policy == OCEAN_BLOCK)
+		while (c->len == c->depth && !c->closing)
+			pthread_cond_wait(&c->cond, &c->lock);
+
+	if (c->closing)
+		goto out;
+
+	if (c->len == c->depth) {
+		c->dropped++;
+		if (c->policy != OCEAN_DROP_OLDEST)
+			goto out;
+
+		dropped = c->queue[c->head];
+		c->head = (c->head + 1) % c->depth;
+		c->len--;
+	}
+
+	ocean_spectra_ref(spec);
+	c->queue[(c->head + c->len) % c->depth] = spec;
+	c->len++;
+	pthread_cond_broadcast(&c->cond);
+out:
+	pthread_mutex_unlock(&c->lock);
+
+	ocean_spectra_release(dropped);
+}
+
+api_public
+int ocean_fanout_publish(struct ocean_fanout *fo, struct ocean_spectra *spec)
+{
+	struct ocean_consumer *c;
+
+	/* only pooled spectra can be shared */
+	if (!fo || !spec || !ocean_spectra_pool_of(spec))
+		return -EINVAL;
+
+	pthread_mutex_lock(&fo->lock);
+	for (c = fo->consumers; c; c = c->next)
+		ocean_consumer_push(c, spec);
+	pthread_mutex_unlock(&fo->lock);
+
+	return 0;
+}
+
+api_public
+int ocean_fanout_request(struct ocean_fanout *fo, struct ocean *ctx,
+			 struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra *spec;
+	int ret;
+
+	if (!fo || !ctx || !pool)
+		return -EINVAL;
+
+	ret = ocean_spectra_acquire(pool, &spec);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret == 0)
+		ret = ocean_fanout_publish(fo, spec);
+
+	ocean_spectra_release(spec);
+	return ret;
+}
+
+api_public
+int ocean_consumer_next(struct ocean_consumer *consumer, struct ocean_spectra **spec,
+			int timeout)
+{
+	struct timespec deadline;
+	int ret = -EAGAIN;
+
+	if (!consumer || !spec)
+		return -EINVAL;
+
+	if (timeout > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&consumer->lock);
+	while (!consumer->len && timeout != 0 && !consumer->closing) {
+		if (timeout < 0)
+			pthread_cond_wait(&consumer->cond, &consumer->lock);
+		else if (pthread_cond_timedwait(&consumer->cond, &consumer->lock,
+						&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	if (consumer->len) {
+		*spec = consumer->queue[consumer->head];
+		consumer->head = (consumer->head + 1) % consumer->depth;
+		consumer->len--;
+		/* room for a blocked publisher */
+		pthread_cond_broadcast(&consumer->cond);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&consumer->lock);
+
+	return ret;
+}
+
+api_public
+uint64_t ocean_consumer_get_dropped(struct ocean_consumer *consumer)
+{
+	uint64_t dropped;
+
+	if (!consumer)
+		return 0;
+
+	pthread_mutex_lock(&consumer->lock);
+	dropped = consumer->dropped;
+	pthread_mutex_unlock(&consumer->lock);
+
+	return dropped;
+}
@@ -0,0 +1,267 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * With the offset removed an exposure measures rate * time, the weighted
+ * mean of the rates with the integration time as weight is the sum of the
+ * signals over the sum of the times. Shot noise grows with the square
+ * root of the signal, so the long exposures get the most weight. Clipped
+ * exposures drop out by a mask instead of a branch. The merge takes a
+ * vector of pixels at a time through all the rows, the sums stay in
+ * registers and are divided after the last row: one pass over the output
+ * and no weight array.
+ */
+#define HDR_MAX_TIMES 8
+#define HDR_LANES 2
+
+typedef double v2f64 __attribute__((vector_size(HDR_LANES * sizeof(double))));
+typedef int64_t v2i64 __attribute__((vector_size(HDR_LANES * sizeof(int64_t))));
+
+struct ocean_hdr {
+	size_t num_of_pixels;
+	size_t num_times;
+	/* ascending, the order of the frames in the batch */
+	uint32_t times[HDR_MAX_TIMES];
+	double limit;
+	double offset;
+	bool strobe;
+	struct ocean_plan *plan;
+	struct ocean_batch *batch;
+	double *data;
+	size_t saturated;
+};
+
+static inline v2f64 hdr_load(const double *src)
+{
+	v2f64 v;
+
+	memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+static inline v2f64 hdr_select(v2i64 mask, v2f64 a, v2f64 b)
+{
+	return (v2f64)(((v2i64)a & mask) | ((v2i64)b & ~mask));
+}
+
+static int ocean_hdr_plan(struct ocean_hdr *hdr)
+{
+	struct ocean_plan_step step = { .frames = 1, .strobe = hdr->strobe };
+	struct ocean_plan *plan;
+	size_t k;
+	int ret;
+
+	ret = ocean_plan_create(&plan);
+	for (k = 0; k < hdr->num_times && ret >= 0; k++) {
+		step.integration_time = hdr->times[k];
+		ret = ocean_plan_add_step(plan, &step);
+	}
+	if (ret < 0) {
+		ocean_plan_free(plan);
+		return ret;
+	}
+
+	ocean_plan_free(hdr->plan);
+	hdr->plan = plan;
+	return 0;
+}
+
+api_public
+int ocean_hdr_create(struct ocean_hdr **hdrp, struct ocean_spectra *spec,
+		     const uint32_t *times, size_t num_times)
+{
+	struct ocean_hdr *hdr;
+	size_t num_of_pixels, i, k;
+	uint32_t time;
+	int ret;
+
+	if (!hdrp || !spec || !times || num_times < 2 || num_times > HDR_MAX_TIMES)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == (size_t)-EINVAL)
+		return -EINVAL;
+
+	for (i = 0; i < num_times; i++)
+		if (!times[i])
+			return -EINVAL;
+
+	hdr = malloc(sizeof(*hdr));
+	if (!hdr)
+		return -ENOMEM;
+	memset(hdr, 0, sizeof(*hdr));
+
+	hdr->num_of_pixels = num_of_pixels;
+	hdr->num_times = num_times;
+	hdr->limit = 0.95;
+
+	/* insertion sort, there are only a few */
+	for (i = 0; i < num_times; i++) {
+		time = times[i];
+		for (k = i; k > 0 && hdr->times[k - 1] > time; k--)
+			hdr->times[k] = hdr->times[k - 1];
+		hdr->times[k] = time;
+	}
+
+	hdr->data = malloc(num_of_pixels * sizeof(double));
+	if (!hdr->data) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	ret = ocean_batch_create(&hdr->batch, spec, num_times);
+	if (ret == 0)
+		ret = ocean_hdr_plan(hdr);
+	if (ret < 0)
+		goto err;
+
+	*hdrp = hdr;
+	return 0;
+
+err:
+	ocean_hdr_free(hdr);
+	return ret;
+}
+
+api_public
+void ocean_hdr_free(struct ocean_hdr *hdr)
+{
+	if (!hdr)
+		return;
+
+	ocean_plan_free(hdr->plan);
+	ocean_batch_free(hdr->batch);
+	free(hdr->data);
+	free(hdr);
+}
+
+api_public
+int ocean_hdr_set_limit(struct ocean_hdr *hdr, double limit)
+{
+	if (!hdr || !(limit > 0.0 && limit <= 1.0))
+		return -EINVAL;
+
+	hdr->limit = limit;
+	return 0;
+}
+
+api_public
+int ocean_hdr_set_offset(struct ocean_hdr *hdr, double offset)
+{
+	if (!hdr)
+		return -EINVAL;
+
+	hdr->offset = offset;
+	return 0;
+}
+
+api_public
+int ocean_hdr_set_strobe(struct ocean_hdr *hdr, bool enable)
+{
+	if (!hdr)
+		return -EINVAL;
+
+	hdr->strobe = enable;
+	return ocean_hdr_plan(hdr);
+}
+
+/* The pixels past the last full vector */
+static size_t ocean_hdr_merge_tail(struct ocean_hdr *hdr, const double *frames, double clip,
+				   double *out, size_t i)
+{
+	const size_t n = hdr->num_of_pixels;
+	double sum, weight, valid;
+	size_t k, saturated = 0;
+
+	for (; i < n; i++) {
+		sum = 0.0;
+		weight = 0.0;
+		for (k = 0; k < hdr->num_times; k++) {
+			valid = frames[k * n + i] < clip;
+			sum += valid * (frames[k * n + i] - hdr->offset);
+			weight += valid * hdr->times[k];
+		}
+
+		saturated += weight == 0.0;
+		out[i] = weight > 0.0 ? sum / weight : (frames[i] - hdr->offset) / hdr->times[0];
+	}
+
+	return saturated;
+}
+
+api_public
+int ocean_hdr_merge(struct ocean_hdr *hdr, const double *frames, double saturation,
+		    double *out)
+{
+	v2f64 x, time, sum, weight, merged, shortest;
+	v2i64 valid, clipped;
+	double clip, offset;
+	size_t n, i, k, saturated = 0;
+
+	if (!hdr || !frames || !out)
+		return -EINVAL;
+
+	n = hdr->num_of_pixels;
+	clip = hdr->limit * saturation;
+	offset = hdr->offset;
+
+	for (i = 0; i + HDR_LANES <= n; i += HDR_LANES) {
+		sum = (v2f64){ 0.0, 0.0 };
+		weight = (v2f64){ 0.0, 0.0 };
+		for (k = 0; k < hdr->num_times; k++) {
+			x = hdr_load(frames + k * n + i);
+			time = (v2f64){ hdr->times[k], hdr->times[k] };
+			valid = x < clip;
+			sum += (v2f64)(valid & (v2i64)(x - offset));
+			weight += (v2f64)(valid & (v2i64)time);
+		}
+
+		/* clipped everywhere, the shortest exposure is the closest */
+		shortest = (hdr_load(frames + i) - offset) / hdr->times[0];
+		clipped = weight == 0.0;
+		merged = hdr_select(clipped, shortest, sum / weight);
+		memcpy(out + i, &merged, sizeof(merged));
+		saturated -= clipped[0] + clipped[1];
+	}
+
+	return saturated + ocean_hdr_merge_tail(hdr, frames, clip, out, i);
+}
+
+api_public
+int ocean_hdr_request(struct ocean_hdr *hdr, struct ocean *ctx, struct ocean_spectra *spec)
+{
+	int ret;
+
+	if (!hdr || !ctx || !spec || ocean_spectra_get_size(spec) != hdr->num_of_pixels)
+		return -EINVAL;
+
+	ret = ocean_batch_clear(hdr->batch);
+	if (ret == 0)
+		ret = ocean_plan_run(ctx, hdr->plan, spec, hdr->batch);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_hdr_merge(hdr, ocean_batch_get_data(hdr->batch),
+			      ocean_spectra_get_saturation(spec), hdr->data);
+	if (ret < 0)
+		return ret;
+
+	hdr->saturated = ret;
+	return 0;
+}
+
+api_public
+const double *ocean_hdr_get_data(struct ocean_hdr *hdr)
+{
+	return hdr ? hdr->data : NULL;
+}
+
+api_public
+size_t ocean_hdr_get_saturated(struct ocean_hdr *hdr)
+{
+	return hdr ? hdr->saturated : 0;
+}
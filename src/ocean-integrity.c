@@ -0,0 +1,67 @@
+#include <libocean.h>
+
+#include <errno.h>
+
+#include "libocean_util.h"
+
+/*
+ * The NIRQuest sends two bytes per pixel and a sync byte after every 512
+ * pixels, the last one ends the frame. A frame which lost or gained a
+ * byte shows at the next sync byte: every pixel behind it would be
+ * garbage, so the frame is not decoded at all.
+ */
+#define OCEAN_SYNC_INTERVAL 512
+#define OCEAN_SYNC_BYTE 0x69
+
+api_private
+size_t ocean_frame_length(size_t num_of_pixels)
+{
+	return num_of_pixels * 2 +
+	       (num_of_pixels + OCEAN_SYNC_INTERVAL - 1) / OCEAN_SYNC_INTERVAL;
+}
+
+api_private
+enum ocean_frame_error ocean_frame_check(const uint8_t *raw, size_t done,
+					 size_t num_of_pixels)
+{
+	size_t j, i;
+
+	for (j = OCEAN_SYNC_INTERVAL; j < num_of_pixels + OCEAN_SYNC_INTERVAL;
+	     j += OCEAN_SYNC_INTERVAL) {
+		/* the last sync byte follows the last pixel */
+		if (j > num_of_pixels)
+			j = num_of_pixels;
+		i = j * 2 + (j - 1) / OCEAN_SYNC_INTERVAL;
+
+		if (i >= done)
+			return OCEAN_FRAME_TRUNCATED;
+		if (raw[i] != OCEAN_SYNC_BYTE)
+			return OCEAN_FRAME_MISALIGNED;
+	}
+
+	return done > ocean_frame_length(num_of_pixels) ? OCEAN_FRAME_MISALIGNED :
+							  OCEAN_FRAME_INTACT;
+}
+
+api_private
+void ocean_integrity_count(struct ocean_integrity_stats *stats, enum ocean_frame_error err)
+{
+	__atomic_add_fetch(&stats->frames, 1, __ATOMIC_RELAXED);
+	if (err == OCEAN_FRAME_TRUNCATED)
+		__atomic_add_fetch(&stats->short_frames, 1, __ATOMIC_RELAXED);
+	else if (err == OCEAN_FRAME_MISALIGNED)
+		__atomic_add_fetch(&stats->bad_sync, 1, __ATOMIC_RELAXED);
+}
+
+api_private
+void ocean_integrity_get(struct ocean_integrity_stats *stats,
+			 struct ocean_integrity_stats *copy)
+{
+	copy->frames = __atomic_load_n(&stats->frames, __ATOMIC_RELAXED);
+	copy->short_frames = __atomic_load_n(&stats->short_frames, __ATOMIC_RELAXED);
+	copy->bad_sync = __atomic_load_n(&stats->bad_sync, __ATOMIC_RELAXED);
+	copy->timeouts = __atomic_load_n(&stats->timeouts, __ATOMIC_RELAXED);
+	copy->stalls = __atomic_load_n(&stats->stalls, __ATOMIC_RELAXED);
+	copy->resyncs = __atomic_load_n(&stats->resyncs, __ATOMIC_RELAXED);
+	copy->dropped = __atomic_load_n(&stats->dropped, __ATOMIC_RELAXED);
+}
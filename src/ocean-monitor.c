@@ -0,0 +1,165 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * The monitor thread polls the housekeeping values of the device between
+ * frames and publishes them through a seqlock: readers copy the values
+ * and retry if the sequence changed meanwhile, they never wait for the
+ * device or for the thread.
+ */
+struct ocean_monitor {
+	struct ocean *ctx;
+	unsigned interval;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stop;
+	/* odd while the values are written */
+	uint32_t seq;
+	struct ocean_housekeeping values;
+};
+
+static void ocean_monitor_publish(struct ocean_monitor *mon,
+				  const struct ocean_housekeeping *hk)
+{
+	const uint32_t seq = mon->seq;
+
+	__atomic_store_n(&mon->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	mon->values = *hk;
+
+	__atomic_store_n(&mon->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void ocean_monitor_advance(struct timespec *ts, unsigned ms)
+{
+	struct timespec now;
+
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+
+	/* a poll took longer than the interval, do not try to catch up */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ts->tv_sec < now.tv_sec ||
+	    (ts->tv_sec == now.tv_sec && ts->tv_nsec < now.tv_nsec))
+		*ts = now;
+}
+
+static void *ocean_monitor_run(void *arg)
+{
+	struct ocean_monitor *mon = arg;
+	struct ocean_housekeeping hk;
+	struct timespec deadline;
+	uint64_t updates = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	pthread_mutex_lock(&mon->lock);
+	while (!mon->stop) {
+		pthread_mutex_unlock(&mon->lock);
+
+		memset(&hk, 0, sizeof(hk));
+		if (ocean_housekeeping_poll(mon->ctx, &hk) == 0) {
+			hk.timestamp = ocean_timestamp();
+			hk.updates = ++updates;
+			ocean_monitor_publish(mon, &hk);
+		}
+
+		ocean_monitor_advance(&deadline, mon->interval);
+
+		pthread_mutex_lock(&mon->lock);
+		while (!mon->stop &&
+		       pthread_cond_timedwait(&mon->cond, &mon->lock, &deadline) != ETIMEDOUT)
+			;
+	}
+	pthread_mutex_unlock(&mon->lock);
+
+	return NULL;
+}
+
+api_public
+int ocean_monitor_create(struct ocean_monitor **monp, struct ocean *ctx, unsigned interval)
+{
+	struct ocean_monitor *mon;
+	pthread_condattr_t attr;
+	int ret;
+
+	if (!monp || !ctx || interval == 0)
+		return -EINVAL;
+
+	mon = malloc(sizeof(*mon));
+	if (!mon)
+		return -ENOMEM;
+	memset(mon, 0, sizeof(*mon));
+
+	mon->ctx = ctx;
+	mon->interval = interval;
+
+	pthread_mutex_init(&mon->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mon->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ret = pthread_create(&mon->thread, NULL, ocean_monitor_run, mon);
+	if (ret) {
+		pthread_cond_destroy(&mon->cond);
+		pthread_mutex_destroy(&mon->lock);
+		free(mon);
+		return -ret;
+	}
+
+	*monp = mon;
+	return 0;
+}
+
+api_public
+void ocean_monitor_free(struct ocean_monitor *mon)
+{
+	if (!mon)
+		return;
+
+	pthread_mutex_lock(&mon->lock);
+	mon->stop = true;
+	pthread_cond_signal(&mon->cond);
+	pthread_mutex_unlock(&mon->lock);
+
+	pthread_join(mon->thread, NULL);
+
+	pthread_cond_destroy(&mon->cond);
+	pthread_mutex_destroy(&mon->lock);
+	free(mon);
+}
+
+api_public
+int ocean_monitor_get(struct ocean_monitor *mon, struct ocean_housekeeping *hk)
+{
+	uint32_t seq;
+
+	if (!mon || !hk)
+		return -EINVAL;
+
+	for (;;) {
+		seq = __atomic_load_n(&mon->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		*hk = mon->values;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&mon->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	return hk->updates ? 0 : -EAGAIN;
+}
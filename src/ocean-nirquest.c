@@ -1,5 +1,7 @@
 #include "libocean_p.h"
 
+#include <math.h>
+
 static inline unsigned flip(unsigned x, unsigned bit)
 {
 	return x ^ (1 << bit);
@@ -16,40 +18,140 @@ static inline double ocean_spectra_correct_intensity(struct ocean_spectra *spec,
 	return intensity / (spec->non_lin_coef[0] + value);
 }
 
+/*
+ * Decodes the raw data and gathers the statistics of the frame on the way,
+ * so nobody has to walk the data again just to find out whether it is any
+ * good. The frame may be decoded in pieces while it arrives, each call of
+ * ocean_decode_update() takes the pixels which are complete by then.
+ */
 api_private
-void ocean_spectra_apply_coefficents(struct ocean_spectra *spec)
+void ocean_decode_begin(struct ocean_decode *d)
+{
+	memset(d, 0, sizeof(*d));
+	d->stats.min = HUGE_VAL;
+	d->stats.max = -HUGE_VAL;
+}
+
+api_private
+void ocean_decode_update(struct ocean_spectra *spec, struct ocean_decode *d, size_t avail)
 {
 	const double saturation = (65535.0f / spec->saturation);
-	size_t i = 0, j = 0;
+	/* the last value is not handed out, see ocean_spectra_get_size() */
+	const size_t len = spec->data_size - 1;
+	struct ocean_spectra_stats stats = d->stats;
+	double sum = d->sum;
+	uint64_t bits = d->bits;
+	size_t i = d->i, j = d->j;
+
+	if (avail > spec->raw_size)
+		avail = spec->raw_size;
 
-	while ((j < spec->data_size) && (i+1 < spec->raw_size)) {
+	while ((j < spec->data_size) && (i+1 < avail)) {
 		const uint16_t val = flip((spec->raw[i+1] << 8) | spec->raw[i], 15);
-		spec->data[j++] = ocean_spectra_correct_intensity(spec, val * saturation);
+		const double value = ocean_spectra_correct_intensity(spec, val * saturation);
+
+		spec->data[j] = value;
+		if (j < len) {
+			const uint64_t clipped = val >= spec->saturation;
+
+			sum += value;
+			if (value < stats.min)
+				stats.min = value;
+			if (value > stats.max) {
+				stats.max = value;
+				stats.peak = j;
+			}
+			stats.saturated += clipped;
+			bits |= clipped << (j % 64);
+			if ((j % 64) == 63) {
+				spec->saturation_map[j / 64] = bits;
+				bits = 0;
+			}
+		}
+
+		j++;
 		i+=2;
 		/* every 15th packets (each package has 512bytes),
-		 * we have a sync byte, skip it */
-		if ((j % 512) == 0) {
-			printf("Skipping byte %zu/%zu = 0x%x\n",
-				i, spec->raw_size, spec->raw[i]);
+		 * we have a sync byte, skip it. It was checked already, see
+		 * ocean_frame_check() */
+		if ((j % 512) == 0)
 			i++;
-		}
 	}
+
+	d->stats = stats;
+	d->sum = sum;
+	d->bits = bits;
+	d->i = i;
+	d->j = j;
+}
+
+api_private
+void ocean_decode_end(struct ocean_spectra *spec, struct ocean_decode *d)
+{
+	const size_t len = spec->data_size - 1;
+	size_t i, j = d->j;
+
+	/* the partial last word, and whatever was not received */
+	if (j > len)
+		j = len;
+	if (j % 64)
+		spec->saturation_map[j / 64] = d->bits;
+	for (i = (j + 63) / 64; i < (len + 63) / 64; i++)
+		spec->saturation_map[i] = 0;
+
+	if (j) {
+		d->stats.mean = d->sum / j;
+	} else {
+		d->stats.min = 0.0;
+		d->stats.max = 0.0;
+	}
+	spec->stats = d->stats;
+}
+
+api_private
+void ocean_spectra_apply_coefficents(struct ocean_spectra *spec)
+{
+	struct ocean_decode d;
+
+	ocean_decode_begin(&d);
+	ocean_decode_update(spec, &d, spec->raw_size);
+	ocean_decode_end(spec, &d);
+}
+
+api_private
+size_t ocean_spectra_get_counts(struct ocean_spectra *spec, double *counts, size_t len)
+{
+	size_t i = 0, j = 0;
+
+	while ((j < len) && (j < spec->data_size) && (i+1 < spec->raw_size)) {
+		counts[j] = flip((spec->raw[i+1] << 8) | spec->raw[i], 15);
+
+		j++;
+		i+=2;
+		/* the sync byte, see ocean_spectra_apply_coefficents() */
+		if ((j % 512) == 0)
+			i++;
+	}
+
+	return j;
 }
 
+/* Returns the number of bytes received */
 api_private
-int ocean_recv_spectra(struct ocean *self, struct ocean_spectra *spec)
+int ocean_recv_spectra(struct ocean *self, struct ocean_spectra *spec,
+		       unsigned int timeout)
 {
 	int done = 0;
 	int ret;
 
 	ret = libusb_bulk_transfer(self->dev, self->ep[EP_DATA_RECV],
 				   spec->raw, spec->raw_size, &done,
-				   self->timeout);
+				   timeout);
 	if (ret < 0) {
 		printf("ERR: libusb_bulk_transfer read failed: %d (done %d/%zu)\n",
 			ret, done, spec->raw_size);
 		return ret;
 	}
 
-	return 0;
+	return done;
 }
@@ -0,0 +1,315 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+#define CENTROID_MAX_RADIUS 16
+
+struct ocean_peak_finder {
+	unsigned half_width;
+	double prominence;
+	double threshold;
+	bool has_threshold;
+	bool absorption;
+	enum ocean_peak_refinement refine;
+};
+
+/* A local maximum of the smoothed data which did not drop far enough
+ * (by the prominence) yet to be reported */
+struct ocean_peak_candidate {
+	size_t pos;
+	double height;
+	/* lowest value between the last reported peak and this one */
+	double left;
+	/* smoothed neighbours, used by the refinement */
+	double prev;
+	double next;
+};
+
+api_public
+int ocean_peak_finder_create(struct ocean_peak_finder **finder)
+{
+	struct ocean_peak_finder *f;
+
+	if (!finder)
+		return -EINVAL;
+
+	f = malloc(sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+	memset(f, 0, sizeof(*f));
+
+	f->half_width = 2;
+	f->refine = OCEAN_PEAK_REFINE_PARABOLIC;
+
+	*finder = f;
+	return 0;
+}
+
+api_public
+void ocean_peak_finder_free(struct ocean_peak_finder *finder)
+{
+	free(finder);
+}
+
+api_public
+int ocean_peak_finder_set_smoothing(struct ocean_peak_finder *finder, unsigned half_width)
+{
+	if (!finder)
+		return -EINVAL;
+
+	finder->half_width = half_width;
+	return 0;
+}
+
+api_public
+int ocean_peak_finder_set_prominence(struct ocean_peak_finder *finder, double prominence)
+{
+	if (!finder || !(prominence >= 0.0))
+		return -EINVAL;
+
+	finder->prominence = prominence;
+	return 0;
+}
+
+api_public
+int ocean_peak_finder_set_threshold(struct ocean_peak_finder *finder, double threshold)
+{
+	if (!finder)
+		return -EINVAL;
+
+	finder->threshold = threshold;
+	finder->has_threshold = true;
+	return 0;
+}
+
+api_public
+int ocean_peak_finder_set_refinement(struct ocean_peak_finder *finder, enum ocean_peak_refinement refine)
+{
+	if (!finder)
+		return -EINVAL;
+
+	switch (refine) {
+	case OCEAN_PEAK_REFINE_NONE:
+	case OCEAN_PEAK_REFINE_CENTROID:
+	case OCEAN_PEAK_REFINE_PARABOLIC:
+	case OCEAN_PEAK_REFINE_GAUSSIAN:
+		finder->refine = refine;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+api_public
+int ocean_peak_finder_set_absorption(struct ocean_peak_finder *finder, bool absorption)
+{
+	if (!finder)
+		return -EINVAL;
+
+	finder->absorption = absorption;
+	return 0;
+}
+
+/* sample with replicated edges, flipped for absorption lines */
+static inline double ocean_peak_sample(const double *data, size_t n, long i, double sign)
+{
+	if (i < 0)
+		i = 0;
+	else if (i >= (long)n)
+		i = n - 1;
+
+	return sign * data[i];
+}
+
+static double ocean_peak_parabolic(const struct ocean_peak_candidate *c)
+{
+	const double denom = c->prev - 2.0 * c->height + c->next;
+
+	if (denom >= 0.0)
+		return 0.0;
+
+	return 0.5 * (c->prev - c->next) / denom;
+}
+
+static double ocean_peak_gaussian(const struct ocean_peak_candidate *c, double base)
+{
+	const double a = c->prev - base;
+	const double b = c->height - base;
+	const double d = c->next - base;
+	double denom;
+
+	/* the logarithm needs positive values, fall back otherwise */
+	if (a <= 0.0 || b <= 0.0 || d <= 0.0)
+		return ocean_peak_parabolic(c);
+
+	denom = log(a) - 2.0 * log(b) + log(d);
+	if (denom >= 0.0)
+		return ocean_peak_parabolic(c);
+
+	return 0.5 * (log(a) - log(d)) / denom;
+}
+
+/* the centroid covers the line down to where its flanks stop falling */
+static double ocean_peak_centroid(const struct ocean_peak_candidate *c, double base,
+				  const double *data, size_t n, double sign)
+{
+	const long pos = c->pos;
+	double sum = 0.0, moment = 0.0;
+	long lo = pos, hi = pos, k;
+
+	while (lo > 0 && pos - lo < CENTROID_MAX_RADIUS &&
+	       sign * data[lo - 1] < sign * data[lo])
+		lo--;
+
+	while (hi + 1 < (long)n && hi - pos < CENTROID_MAX_RADIUS &&
+	       sign * data[hi + 1] < sign * data[hi])
+		hi++;
+
+	for (k = lo; k <= hi; k++) {
+		const double w = sign * data[k] - base;
+
+		if (w <= 0.0)
+			continue;
+
+		sum += w;
+		moment += w * (k - pos);
+	}
+
+	return sum > 0.0 ? moment / sum : 0.0;
+}
+
+static void ocean_peak_report(struct ocean_peak_finder *finder, struct ocean_spectra *spec,
+			      const double *data, size_t n, double sign,
+			      const struct ocean_peak_candidate *c, double right,
+			      struct ocean_peak *peak)
+{
+	/* the right base is still falling, fit the shape above the lower one */
+	const double base = fmin(c->left, right);
+	double offset = 0.0;
+
+	switch (finder->refine) {
+	case OCEAN_PEAK_REFINE_NONE:
+		break;
+	case OCEAN_PEAK_REFINE_CENTROID:
+		offset = ocean_peak_centroid(c, base, data, n, sign);
+		break;
+	case OCEAN_PEAK_REFINE_PARABOLIC:
+		offset = ocean_peak_parabolic(c);
+		break;
+	case OCEAN_PEAK_REFINE_GAUSSIAN:
+		offset = ocean_peak_gaussian(c, base);
+		break;
+	}
+
+	/* the maximum sits on a sample, anything further away is noise */
+	if (offset > 0.5)
+		offset = 0.5;
+	else if (offset < -0.5)
+		offset = -0.5;
+
+	peak->pixel = c->pos + offset;
+	peak->wavelength = ocean_spectra_get_wavelength_at(spec, peak->pixel);
+	peak->height = sign * c->height;
+	peak->prominence = c->height - fmax(c->left, right);
+}
+
+/*
+ * A peak is reported as soon as the data dropped by the prominence below
+ * it, higher maxima showing up earlier replace the candidate. The right
+ * base of the last reported peak keeps being tracked until the next higher
+ * maximum, so its prominence is updated in place. This needs only the
+ * current window of the running sum and no extra memory.
+ */
+api_public
+int ocean_peak_finder_run(struct ocean_peak_finder *finder, struct ocean_spectra *spec,
+			  struct ocean_peak *peaks, size_t max_peaks)
+{
+	struct ocean_peak_candidate cand = { 0 };
+	struct ocean_peak *open = NULL;
+	double open_height = 0.0, open_left = 0.0, open_right = 0.0;
+	double floor_min = HUGE_VAL, run_min = HUGE_VAL;
+	double sign, width, sum, prev, cur, next;
+	bool pending = false;
+	const double *data;
+	size_t n, i, count = 0;
+	long h, j;
+
+	if (!finder || !spec || (!peaks && max_peaks))
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(spec);
+	n = ocean_spectra_get_size(spec);
+	if (!data || n == (size_t)-EINVAL)
+		return -EINVAL;
+
+	if (n < 3)
+		return 0;
+
+	sign = finder->absorption ? -1.0 : 1.0;
+	h = finder->half_width;
+	width = 2 * h + 1;
+
+	for (sum = 0.0, j = -h; j <= h; j++)
+		sum += ocean_peak_sample(data, n, j, sign);
+
+	cur = sum / width;
+	prev = cur;
+
+	for (i = 0; i < n; i++) {
+		sum += ocean_peak_sample(data, n, (long)i + h + 1, sign) -
+		       ocean_peak_sample(data, n, (long)i - h, sign);
+		next = sum / width;
+
+		if (i + 1 < n && cur > prev && next <= cur) {
+			/* the last peak found a higher neighbour */
+			if (open && cur > open_height)
+				open = NULL;
+
+			if (!pending || cur > cand.height) {
+				cand.left = pending ? fmin(cand.left, run_min) : floor_min;
+				cand.pos = i;
+				cand.height = cur;
+				cand.prev = prev;
+				cand.next = next;
+				run_min = cur;
+				pending = true;
+			}
+		}
+
+		if (open) {
+			open_right = fmin(open_right, cur);
+			open->prominence = open_height - fmax(open_left, open_right);
+		}
+
+		if (pending)
+			run_min = fmin(run_min, cur);
+		else
+			floor_min = fmin(floor_min, cur);
+
+		if (pending && cur <= cand.height - finder->prominence) {
+			if (cand.height - cand.left >= finder->prominence &&
+			    (!finder->has_threshold || cand.height >= sign * finder->threshold) &&
+			    count < max_peaks) {
+				open = &peaks[count++];
+				ocean_peak_report(finder, spec, data, n, sign,
+						  &cand, run_min, open);
+				open_height = cand.height;
+				open_left = cand.left;
+				open_right = run_min;
+				floor_min = run_min;
+			} else {
+				floor_min = fmin(cand.left, run_min);
+			}
+			pending = false;
+		}
+
+		prev = cur;
+		cur = next;
+	}
+
+	return count;
+}
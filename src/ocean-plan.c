@@ -0,0 +1,101 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * Only the description of the sequence, the backends run it: the device
+ * one has to interleave the commands with its pipeline.
+ */
+struct ocean_plan {
+	struct ocean_plan_step *steps;
+	unsigned num_steps;
+	unsigned allocated;
+	unsigned repeat;
+	/* frames of one pass through the steps */
+	size_t frames;
+};
+
+api_public
+int ocean_plan_create(struct ocean_plan **planp)
+{
+	struct ocean_plan *plan;
+
+	if (!planp)
+		return -EINVAL;
+
+	plan = malloc(sizeof(*plan));
+	if (!plan)
+		return -ENOMEM;
+	memset(plan, 0, sizeof(*plan));
+
+	plan->repeat = 1;
+
+	*planp = plan;
+	return 0;
+}
+
+api_public
+void ocean_plan_free(struct ocean_plan *plan)
+{
+	if (!plan)
+		return;
+
+	free(plan->steps);
+	free(plan);
+}
+
+api_public
+int ocean_plan_add_step(struct ocean_plan *plan, const struct ocean_plan_step *step)
+{
+	struct ocean_plan_step *steps;
+
+	if (!plan || !step || !step->integration_time || !step->frames)
+		return -EINVAL;
+
+	if (plan->num_steps == plan->allocated) {
+		const unsigned allocated = plan->allocated ? plan->allocated * 2 : 4;
+
+		steps = realloc(plan->steps, allocated * sizeof(*steps));
+		if (!steps)
+			return -ENOMEM;
+		plan->steps = steps;
+		plan->allocated = allocated;
+	}
+
+	plan->steps[plan->num_steps] = *step;
+	plan->frames += step->frames;
+	return plan->num_steps++;
+}
+
+api_public
+int ocean_plan_set_repeat(struct ocean_plan *plan, unsigned count)
+{
+	if (!plan || !count)
+		return -EINVAL;
+
+	plan->repeat = count;
+	return 0;
+}
+
+api_public
+size_t ocean_plan_get_num_of_frames(struct ocean_plan *plan)
+{
+	return plan ? plan->frames * plan->repeat : 0;
+}
+
+api_private
+const struct ocean_plan_step *ocean_plan_step_of(struct ocean_plan *plan, size_t frame,
+						 unsigned *index)
+{
+	unsigned k;
+
+	frame %= plan->frames;
+	for (k = 0; frame >= plan->steps[k].frames; k++)
+		frame -= plan->steps[k].frames;
+
+	*index = k;
+	return &plan->steps[k];
+}
@@ -0,0 +1,232 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "libocean_util.h"
+
+/*
+ * All spectra of a pool live in one mapping, each one as a block of the
+ * container followed by its raw, data and saturation buffers, 64 byte
+ * aligned. The calibration is queried once and copied into every block,
+ * acquiring and releasing only moves pointers on a stack. Each block has
+ * a reference count, the block goes back on the stack with the last one.
+ */
+#define POOL_HUGEPAGE (2 * 1024 * 1024)
+
+struct ocean_spectra_pool {
+	void *arena;
+	size_t size;
+	size_t stride;
+	unsigned count;
+	/* references of each block, 0 while on the stack */
+	uint32_t *refs;
+	/* stack of the free spectra */
+	unsigned top;
+	struct ocean_spectra **free;
+	/* acquire and release may happen on different threads */
+	bool lock;
+};
+
+static void ocean_pool_lock(struct ocean_spectra_pool *pool)
+{
+	while (__atomic_test_and_set(&pool->lock, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void ocean_pool_unlock(struct ocean_spectra_pool *pool)
+{
+	__atomic_clear(&pool->lock, __ATOMIC_RELEASE);
+}
+
+/* Prefaulted, so the first frame does not pay for it either */
+static void *ocean_pool_map(size_t *size, bool hugepages)
+{
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS
+#ifdef MAP_POPULATE
+		| MAP_POPULATE
+#endif
+		;
+	void *ptr;
+
+#ifdef MAP_HUGETLB
+	if (hugepages) {
+		const size_t len = (*size + POOL_HUGEPAGE - 1) & ~(size_t)(POOL_HUGEPAGE - 1);
+
+		ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED) {
+			*size = len;
+			return ptr;
+		}
+	}
+#endif
+
+	ptr = mmap(NULL, *size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	/* no huge pages reserved, transparent ones may still do */
+	if (hugepages)
+		madvise(ptr, *size, MADV_HUGEPAGE);
+#endif
+	return ptr;
+}
+
+api_public
+int ocean_spectra_pool_create(struct ocean_spectra_pool **poolp, struct ocean *ctx,
+			      unsigned count, unsigned flags)
+{
+	struct ocean_spectra_pool *pool;
+	struct ocean_spectra *tmpl = NULL;
+	size_t stride;
+	unsigned i;
+	int ret;
+
+	if (!poolp || !ctx || count == 0)
+		return -EINVAL;
+
+	/* shape and calibration of the device, once for all of them */
+	ret = ocean_spectra_create(&tmpl, ctx);
+	if (ret < 0)
+		return ret;
+
+	stride = ocean_spectra_footprint(tmpl);
+	if (count > SIZE_MAX / stride) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	pool = malloc(sizeof(*pool));
+	if (!pool) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(pool, 0, sizeof(*pool));
+
+	pool->count = count;
+	pool->stride = stride;
+	pool->size = count * stride;
+	pool->free = malloc(count * sizeof(*pool->free));
+	pool->refs = calloc(count, sizeof(*pool->refs));
+	pool->arena = ocean_pool_map(&pool->size, flags & OCEAN_POOL_HUGEPAGES);
+	if (!pool->free || !pool->refs || !pool->arena) {
+		ocean_spectra_pool_free(pool);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* handed out from the start of the arena */
+	for (i = 0; i < count; i++)
+		pool->free[count - 1 - i] = ocean_spectra_place(
+			(uint8_t *)pool->arena + i * stride, tmpl, pool);
+	pool->top = count;
+
+	*poolp = pool;
+out:
+	ocean_spectra_free(tmpl);
+	return ret;
+}
+
+api_public
+void ocean_spectra_pool_free(struct ocean_spectra_pool *pool)
+{
+	if (!pool)
+		return;
+
+	if (pool->arena)
+		munmap(pool->arena, pool->size);
+	free(pool->refs);
+	free(pool->free);
+	free(pool);
+}
+
+static uint32_t *ocean_pool_refs(struct ocean_spectra_pool *pool, struct ocean_spectra *spec)
+{
+	return &pool->refs[((uint8_t *)spec - (uint8_t *)pool->arena) / pool->stride];
+}
+
+api_public
+int ocean_spectra_acquire(struct ocean_spectra_pool *pool, struct ocean_spectra **spec)
+{
+	int ret = 0;
+
+	if (!pool || !spec)
+		return -EINVAL;
+
+	ocean_pool_lock(pool);
+	if (pool->top) {
+		*spec = pool->free[--pool->top];
+		__atomic_store_n(ocean_pool_refs(pool, *spec), 1, __ATOMIC_RELAXED);
+	} else {
+		ret = -EAGAIN;
+	}
+	ocean_pool_unlock(pool);
+
+	return ret;
+}
+
+api_public
+int ocean_spectra_ref(struct ocean_spectra *spec)
+{
+	struct ocean_spectra_pool *pool;
+
+	pool = spec ? ocean_spectra_pool_of(spec) : NULL;
+	if (!pool)
+		return -EINVAL;
+
+	/* only the holder of a reference may take another one */
+	__atomic_add_fetch(ocean_pool_refs(pool, spec), 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+api_public
+void ocean_spectra_release(struct ocean_spectra *spec)
+{
+	struct ocean_spectra_pool *pool;
+	uint32_t *refs, old;
+
+	pool = spec ? ocean_spectra_pool_of(spec) : NULL;
+	if (!pool)
+		return;
+
+	/* released once too often, keep it off the stack */
+	refs = ocean_pool_refs(pool, spec);
+	old = __atomic_load_n(refs, __ATOMIC_RELAXED);
+	do {
+		if (old == 0)
+			return;
+	} while (!__atomic_compare_exchange_n(refs, &old, old - 1, true,
+					      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	if (old > 1)
+		return;
+
+	ocean_pool_lock(pool);
+	if (pool->top < pool->count)
+		pool->free[pool->top++] = spec;
+	ocean_pool_unlock(pool);
+}
+
+api_private
+bool ocean_spectra_shared(struct ocean_spectra *spec)
+{
+	struct ocean_spectra_pool *pool = ocean_spectra_pool_of(spec);
+
+	return pool && __atomic_load_n(ocean_pool_refs(pool, spec), __ATOMIC_ACQUIRE) > 1;
+}
+
+api_public
+unsigned ocean_spectra_pool_get_available(struct ocean_spectra_pool *pool)
+{
+	unsigned top;
+
+	if (!pool)
+		return 0;
+
+	ocean_pool_lock(pool);
+	top = pool->top;
+	ocean_pool_unlock(pool);
+
+	return top;
+}
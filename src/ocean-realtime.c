@@ -0,0 +1,166 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <libocean.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "libocean_util.h"
+
+/*
+ * Everything a thread needs to never wait for the kernel while taking
+ * frames: a CPU of its own, a priority above the rest of the box and
+ * memory which is resident before it is first used. The memory is locked
+ * for the whole process, current and future mappings, and freed memory
+ * stays with malloc, so a buffer allocated later is faulted in once and
+ * kept. The stats are handed to other threads through a seqlock, the
+ * acquiring thread never waits for a reader.
+ */
+
+/* the stack a request needs at most, faulted in up front */
+#define RT_STACK_PREFAULT (256 * 1024)
+#define RT_PAGE_SIZE 4096
+
+static void __attribute__((noinline)) ocean_realtime_prefault_stack(void)
+{
+	volatile uint8_t stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += RT_PAGE_SIZE)
+		stack[i] = 0;
+}
+
+static void ocean_realtime_publish(struct ocean_realtime *rt)
+{
+	const uint32_t seq = rt->seq;
+
+	__atomic_store_n(&rt->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rt->published = rt->stats;
+
+	__atomic_store_n(&rt->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+api_private
+int ocean_realtime_get(struct ocean_realtime *rt, struct ocean_realtime_stats *stats)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&rt->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		*stats = rt->published;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rt->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	return __atomic_load_n(&rt->active, __ATOMIC_ACQUIRE) ? 0 : -ENODATA;
+}
+
+#if defined(__linux__)
+api_private
+int ocean_realtime_enter(struct ocean_realtime *rt, int cpu, int priority)
+{
+	struct sched_param param = { .sched_priority = priority };
+	struct rusage usage;
+	cpu_set_t set;
+	int ret;
+
+	if (cpu < -1 || cpu >= CPU_SETSIZE || priority < 0 ||
+	    (priority && (priority < sched_get_priority_min(SCHED_FIFO) ||
+			  priority > sched_get_priority_max(SCHED_FIFO))))
+		return -EINVAL;
+
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (ret)
+			return -ret;
+	}
+
+	if (priority) {
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret)
+			return -ret;
+	}
+
+#ifdef __GLIBC__
+	/* never give memory back, never map single allocations */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		return -errno;
+
+	ocean_realtime_prefault_stack();
+	/* the pages behind the clocks are not locked, read them once */
+	ocean_monotonic();
+	ocean_timestamp();
+
+	memset(&rt->stats, 0, sizeof(rt->stats));
+	rt->latency_sum = 0;
+
+	if (getrusage(RUSAGE_THREAD, &usage))
+		return -errno;
+	rt->minflt = usage.ru_minflt;
+	rt->majflt = usage.ru_majflt;
+	rt->nivcsw = usage.ru_nivcsw;
+
+	ocean_realtime_publish(rt);
+	__atomic_store_n(&rt->active, true, __ATOMIC_RELEASE);
+	return 0;
+}
+
+api_private
+void ocean_realtime_account(struct ocean_realtime *rt, uint64_t latency)
+{
+	struct ocean_realtime_stats *stats = &rt->stats;
+	struct rusage usage;
+
+	if (!rt->active)
+		return;
+
+	if (stats->frames == 0 || latency < stats->latency_min)
+		stats->latency_min = latency;
+	if (latency > stats->latency_max)
+		stats->latency_max = latency;
+	rt->latency_sum += latency;
+	stats->frames++;
+	stats->latency_mean = rt->latency_sum / stats->frames;
+
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		stats->minor_faults = usage.ru_minflt - rt->minflt;
+		stats->major_faults = usage.ru_majflt - rt->majflt;
+		stats->preemptions = usage.ru_nivcsw - rt->nivcsw;
+	}
+
+	ocean_realtime_publish(rt);
+}
+#else
+api_private
+int ocean_realtime_enter(struct ocean_realtime *rt, int cpu, int priority)
+{
+	return -ENOTSUP;
+}
+
+api_private
+void ocean_realtime_account(struct ocean_realtime *rt, uint64_t latency)
+{
+}
+#endif
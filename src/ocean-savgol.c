@@ -0,0 +1,311 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "libocean_util.h"
+
+/*
+ * A Savitzky-Golay filter is a convolution: the least squares polynomial
+ * through the window, or its derivative, evaluated at one point is a
+ * weighted sum of the values. The weights are computed once for every
+ * point of the window; the center ones filter the inner pixels, the
+ * others the pixels closer to the edges than half a window, which are
+ * fitted by the first or the last window instead. The positions are
+ * scaled to [-1, 1] to keep the normal equations well conditioned.
+ */
+#define SG_LANES 2
+#define SG_MAX_WINDOW 101
+#define SG_MAX_ORDER 8
+
+typedef double v2f64 __attribute__((vector_size(SG_LANES * sizeof(double))));
+
+struct ocean_savgol {
+	size_t num_of_pixels;
+	unsigned window;
+	unsigned half;
+	/* window x window, row p evaluates the fit at point p of the window */
+	double *coef;
+	/* copy of the input for in place filtering */
+	double *scratch;
+};
+
+static inline v2f64 sg_load(const double *src)
+{
+	v2f64 v;
+
+	memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+static inline void sg_store(double *dst, v2f64 v)
+{
+	memcpy(dst, &v, sizeof(v));
+}
+
+/* Solves a * x = b by elimination with partial pivoting, a is destroyed */
+static int sg_solve(double *a, double *b, unsigned n)
+{
+	unsigned i, j, k, p;
+	double f, t;
+
+	for (i = 0; i < n; i++) {
+		p = i;
+		for (j = i + 1; j < n; j++)
+			if (fabs(a[j * n + i]) > fabs(a[p * n + i]))
+				p = j;
+		if (a[p * n + i] == 0.0)
+			return -EDOM;
+		if (p != i) {
+			for (k = 0; k < n; k++) {
+				t = a[i * n + k];
+				a[i * n + k] = a[p * n + k];
+				a[p * n + k] = t;
+			}
+			t = b[i];
+			b[i] = b[p];
+			b[p] = t;
+		}
+		for (j = i + 1; j < n; j++) {
+			f = a[j * n + i] / a[i * n + i];
+			for (k = i; k < n; k++)
+				a[j * n + k] -= f * a[i * n + k];
+			b[j] -= f * b[i];
+		}
+	}
+
+	for (i = n; i-- > 0; ) {
+		for (k = i + 1; k < n; k++)
+			b[i] -= a[i * n + k] * b[k];
+		b[i] /= a[i * n + i];
+	}
+
+	return 0;
+}
+
+static int sg_coefficients(struct ocean_savgol *sg, unsigned order, unsigned deriv)
+{
+	const unsigned m = order + 1;
+	const double scale = 1.0 / sg->half;
+	double vander[SG_MAX_WINDOW][SG_MAX_ORDER + 1];
+	double gram[(SG_MAX_ORDER + 1) * (SG_MAX_ORDER + 1)];
+	double a[(SG_MAX_ORDER + 1) * (SG_MAX_ORDER + 1)];
+	double x[SG_MAX_ORDER + 1];
+	double tau, f;
+	unsigned p, k, i, j;
+	int ret;
+
+	for (k = 0; k < sg->window; k++) {
+		tau = ((double)k - sg->half) * scale;
+		vander[k][0] = 1.0;
+		for (j = 1; j < m; j++)
+			vander[k][j] = vander[k][j - 1] * tau;
+	}
+
+	for (i = 0; i < m; i++) {
+		for (j = 0; j < m; j++) {
+			gram[i * m + j] = 0.0;
+			for (k = 0; k < sg->window; k++)
+				gram[i * m + j] += vander[k][i] * vander[k][j];
+		}
+	}
+
+	for (p = 0; p < sg->window; p++) {
+		/* the deriv-th derivative of tau^j at point p */
+		for (j = 0; j < m; j++) {
+			if (j < deriv) {
+				x[j] = 0.0;
+				continue;
+			}
+			f = 1.0;
+			for (i = 0; i < deriv; i++)
+				f *= j - i;
+			x[j] = f * vander[p][j - deriv];
+		}
+
+		memcpy(a, gram, m * m * sizeof(double));
+		ret = sg_solve(a, x, m);
+		if (ret < 0)
+			return ret;
+
+		/* back from [-1, 1] to pixels */
+		f = 1.0;
+		for (i = 0; i < deriv; i++)
+			f *= scale;
+
+		for (k = 0; k < sg->window; k++) {
+			double c = 0.0;
+
+			for (j = 0; j < m; j++)
+				c += vander[k][j] * x[j];
+			sg->coef[p * sg->window + k] = c * f;
+		}
+	}
+
+	return 0;
+}
+
+api_public
+int ocean_savgol_create(struct ocean_savgol **sgp, struct ocean_spectra *spec,
+			unsigned window, unsigned order, unsigned deriv)
+{
+	struct ocean_savgol *sg;
+	size_t num_of_pixels;
+	int ret;
+
+	if (!sgp || !spec || window < 3 || window > SG_MAX_WINDOW || !(window & 1) ||
+	    order >= window || order > SG_MAX_ORDER || deriv > order)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == (size_t)-EINVAL || num_of_pixels < window)
+		return -EINVAL;
+
+	sg = malloc(sizeof(*sg));
+	if (!sg)
+		return -ENOMEM;
+	memset(sg, 0, sizeof(*sg));
+
+	sg->num_of_pixels = num_of_pixels;
+	sg->window = window;
+	sg->half = window / 2;
+
+	sg->coef = malloc(window * window * sizeof(double));
+	sg->scratch = malloc(num_of_pixels * sizeof(double));
+	if (!sg->coef || !sg->scratch) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = sg_coefficients(sg, order, deriv);
+	if (ret < 0)
+		goto out;
+
+	*sgp = sg;
+	return 0;
+
+out:
+	ocean_savgol_free(sg);
+	return ret;
+}
+
+api_public
+void ocean_savgol_free(struct ocean_savgol *sg)
+{
+	if (!sg)
+		return;
+
+	free(sg->scratch);
+	free(sg->coef);
+	free(sg);
+}
+
+api_public
+const double *ocean_savgol_get_coefficients(struct ocean_savgol *sg, size_t *len)
+{
+	if (!sg)
+		return NULL;
+
+	if (len)
+		*len = sg->window;
+	return &sg->coef[sg->half * sg->window];
+}
+
+static double sg_point(const double *coef, const double *in, unsigned window)
+{
+	double sum = 0.0;
+	unsigned k;
+
+	for (k = 0; k < window; k++)
+		sum += coef[k] * in[k];
+	return sum;
+}
+
+api_public
+int ocean_savgol_apply(struct ocean_savgol *sg, const double *in, double *out, size_t len)
+{
+	const unsigned window = sg ? sg->window : 0;
+	const double *center;
+	size_t i, last;
+	unsigned k;
+
+	if (!sg || !in || !out || len != sg->num_of_pixels)
+		return -EINVAL;
+
+	if (in == out)
+		return ocean_savgol_apply_inplace(sg, out, len);
+
+	/* the edges, fitted by the first and the last window */
+	last = len - window;
+	for (i = 0; i < sg->half; i++) {
+		out[i] = sg_point(&sg->coef[i * window], in, window);
+		out[last + window - 1 - i] =
+			sg_point(&sg->coef[(window - 1 - i) * window], &in[last], window);
+	}
+
+	/* two vectors of outputs per pass, the inputs are loaded unaligned */
+	center = &sg->coef[sg->half * window];
+	for (i = sg->half; i + 2 * SG_LANES <= len - sg->half; i += 2 * SG_LANES) {
+		const double *src = &in[i - sg->half];
+		v2f64 a = { 0 }, b = { 0 };
+
+		for (k = 0; k < window; k++) {
+			a += center[k] * sg_load(&src[k]);
+			b += center[k] * sg_load(&src[k + SG_LANES]);
+		}
+		sg_store(&out[i], a);
+		sg_store(&out[i + SG_LANES], b);
+	}
+	for (; i < len - sg->half; i++)
+		out[i] = sg_point(center, &in[i - sg->half], window);
+
+	return 0;
+}
+
+api_public
+int ocean_savgol_apply_inplace(struct ocean_savgol *sg, double *data, size_t len)
+{
+	if (!sg || !data || len != sg->num_of_pixels)
+		return -EINVAL;
+
+	memcpy(sg->scratch, data, len * sizeof(double));
+	return ocean_savgol_apply(sg, sg->scratch, data, len);
+}
+
+api_public
+int ocean_savgol_process(struct ocean_savgol *sg, struct ocean_spectra *spec)
+{
+	struct ocean_spectra_stats stats;
+	double *data;
+	double sum = 0.0;
+	size_t i;
+	int ret;
+
+	if (!sg || !spec || ocean_spectra_get_size(spec) != sg->num_of_pixels)
+		return -EINVAL;
+
+	data = ocean_spectra_get_data(spec);
+	ret = ocean_savgol_apply_inplace(sg, data, sg->num_of_pixels);
+	if (ret < 0)
+		return ret;
+
+	/* the stats describe the filtered data, the saturated pixels are
+	 * those of the detector */
+	ocean_spectra_get_stats(spec, &stats);
+	stats.min = HUGE_VAL;
+	stats.max = -HUGE_VAL;
+	for (i = 0; i < sg->num_of_pixels; i++) {
+		sum += data[i];
+		if (data[i] < stats.min)
+			stats.min = data[i];
+		if (data[i] > stats.max) {
+			stats.max = data[i];
+			stats.peak = i;
+		}
+	}
+	stats.mean = sum / sg->num_of_pixels;
+
+	ocean_spectra_set_stats(spec, &stats);
+	return ret;
+}
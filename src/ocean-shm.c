@@ -0,0 +1,416 @@
+#include <libocean.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "libocean_util.h"
+
+/*
+ * Layout of the shared memory, every part starts on a cache line:
+ *
+ *   header
+ *   wavelength of each pixel
+ *   slots: slot header, data of each pixel
+ *
+ * The publisher increments the sequence counter of a slot before and after
+ * writing it, a reader knows the slot is stable while the counter is even
+ * and did not change. The header counts the published frames, slot
+ * (head % slots) is the next one to be written.
+ */
+#define SHM_MAGIC 0x4e45434f
+#define SHM_VERSION 1
+#define SHM_ALIGN 64
+
+#define SHM_ALIGNED(x) (((x) + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1))
+
+struct ocean_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_of_pixels;
+	uint32_t slots;
+	uint64_t slot_offset;
+	uint64_t slot_size;
+	/* number of published frames */
+	uint64_t head;
+	/* futex word, bumped with every frame */
+	uint32_t wake;
+	uint32_t reserved;
+};
+
+struct ocean_shm_slot {
+	uint64_t seq;
+	/* number of the frame in the ring, to detect overruns */
+	uint64_t generation;
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t integration_time;
+	uint32_t flags;
+};
+
+struct ocean_publisher {
+	char name[NAME_MAX];
+	struct ocean_shm_header *header;
+	size_t size;
+	uint8_t *slots;
+};
+
+struct ocean_subscriber {
+	const struct ocean_shm_header *header;
+	size_t size;
+	const uint8_t *slots;
+	/* generation of the next frame to read */
+	uint64_t next;
+};
+
+static size_t ocean_shm_header_size(void)
+{
+	return SHM_ALIGNED(sizeof(struct ocean_shm_header));
+}
+
+static size_t ocean_shm_slot_header_size(void)
+{
+	return SHM_ALIGNED(sizeof(struct ocean_shm_slot));
+}
+
+static int ocean_shm_name(char *buf, size_t len, const char *name)
+{
+	int ret;
+
+	if (!name || !*name)
+		return -EINVAL;
+
+	ret = snprintf(buf, len, "%s%s", name[0] == '/' ? "" : "/", name);
+	if (ret < 0 || (size_t)ret >= len)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+static void ocean_shm_wake(struct ocean_shm_header *header)
+{
+	__atomic_add_fetch(&header->wake, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	syscall(SYS_futex, &header->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static void ocean_shm_sleep(const struct ocean_shm_header *header, uint32_t wake, int timeout)
+{
+	struct timespec ts = {
+		.tv_sec = timeout / 1000,
+		.tv_nsec = (timeout % 1000) * 1000000,
+	};
+
+#ifdef __linux__
+	syscall(SYS_futex, &header->wake, FUTEX_WAIT, wake,
+		timeout < 0 ? NULL : &ts, NULL, 0);
+#else
+	/* no way to sleep on the counter, poll it */
+	if (timeout < 0 || timeout > 1) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 1000000;
+	}
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static int64_t ocean_shm_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+api_public
+int ocean_publisher_create(struct ocean_publisher **pubp, const char *name,
+			   struct ocean_spectra *spec, unsigned slots)
+{
+	struct ocean_shm_header *header;
+	struct ocean_publisher *pub;
+	size_t num_of_pixels, i;
+	double *wavelength;
+	void *mem;
+	int fd, ret;
+
+	if (!pubp || !spec || slots == 0)
+		return -EINVAL;
+
+	num_of_pixels = ocean_spectra_get_size(spec);
+	if (num_of_pixels == (size_t)-EINVAL || num_of_pixels > UINT32_MAX)
+		return -EINVAL;
+
+	pub = malloc(sizeof(*pub));
+	if (!pub)
+		return -ENOMEM;
+	memset(pub, 0, sizeof(*pub));
+
+	ret = ocean_shm_name(pub->name, sizeof(pub->name), name);
+	if (ret < 0)
+		goto err_free;
+
+	/* start over, subscribers of a previous publisher keep the old ring */
+	shm_unlink(pub->name);
+	fd = shm_open(pub->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		fprintf(stderr, "ERR: shm_open(%s): %s\n", pub->name, strerror(errno));
+		goto err_free;
+	}
+
+	pub->size = ocean_shm_header_size() + SHM_ALIGNED(num_of_pixels * sizeof(double)) +
+		    slots * (ocean_shm_slot_header_size() +
+			     SHM_ALIGNED(num_of_pixels * sizeof(double)));
+
+	if (ftruncate(fd, pub->size) < 0) {
+		ret = -errno;
+		close(fd);
+		goto err_unlink;
+	}
+
+	mem = mmap(NULL, pub->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		ret = -errno;
+		goto err_unlink;
+	}
+
+	header = mem;
+	header->version = SHM_VERSION;
+	header->num_of_pixels = num_of_pixels;
+	header->slots = slots;
+	header->slot_offset = ocean_shm_header_size() +
+			      SHM_ALIGNED(num_of_pixels * sizeof(double));
+	header->slot_size = ocean_shm_slot_header_size() +
+			    SHM_ALIGNED(num_of_pixels * sizeof(double));
+
+	wavelength = (double *)((uint8_t *)mem + ocean_shm_header_size());
+	for (i = 0; i < num_of_pixels; i++)
+		wavelength[i] = ocean_spectra_get_wavelength(spec, i);
+
+	/* subscribers check the magic, set it once everything is in place */
+	__atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+	pub->header = header;
+	pub->slots = (uint8_t *)mem + header->slot_offset;
+
+	*pubp = pub;
+	return 0;
+
+err_unlink:
+	shm_unlink(pub->name);
+err_free:
+	free(pub);
+	return ret;
+}
+
+api_public
+void ocean_publisher_free(struct ocean_publisher *pub)
+{
+	if (!pub)
+		return;
+
+	munmap(pub->header, pub->size);
+	shm_unlink(pub->name);
+	free(pub);
+}
+
+api_public
+int ocean_publisher_publish(struct ocean_publisher *pub, struct ocean_spectra *spec)
+{
+	struct ocean_shm_header *header;
+	struct ocean_shm_slot *slot;
+	const double *data;
+	uint64_t gen, seq;
+
+	if (!pub || !spec)
+		return -EINVAL;
+
+	header = pub->header;
+	data = ocean_spectra_get_data(spec);
+	if (!data || ocean_spectra_get_size(spec) != header->num_of_pixels)
+		return -EINVAL;
+
+	gen = header->head;
+	slot = (struct ocean_shm_slot *)(pub->slots + (gen % header->slots) * header->slot_size);
+
+	seq = slot->seq;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->generation = gen;
+	slot->sequence = ocean_spectra_get_sequence(spec);
+	slot->timestamp = ocean_spectra_get_timestamp(spec);
+	slot->integration_time = ocean_spectra_get_integration_time(spec);
+	slot->flags = ocean_spectra_get_flags(spec);
+	memcpy((uint8_t *)slot + ocean_shm_slot_header_size(), data,
+	       header->num_of_pixels * sizeof(double));
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->head, gen + 1, __ATOMIC_SEQ_CST);
+
+	ocean_shm_wake(header);
+	return 0;
+}
+
+api_public
+int ocean_subscriber_open(struct ocean_subscriber **subp, const char *name)
+{
+	const struct ocean_shm_header *header;
+	struct ocean_subscriber *sub;
+	char path[NAME_MAX];
+	struct stat st;
+	void *mem;
+	int fd, ret;
+
+	if (!subp)
+		return -EINVAL;
+
+	ret = ocean_shm_name(path, sizeof(path), name);
+	if (ret < 0)
+		return ret;
+
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < ocean_shm_header_size()) {
+		close(fd);
+		return -EBADMSG;
+	}
+
+	mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return -errno;
+
+	header = mem;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+	    header->version != SHM_VERSION ||
+	    header->slot_offset + header->slots * header->slot_size > (uint64_t)st.st_size) {
+		munmap(mem, st.st_size);
+		return -EBADMSG;
+	}
+
+	sub = malloc(sizeof(*sub));
+	if (!sub) {
+		munmap(mem, st.st_size);
+		return -ENOMEM;
+	}
+
+	sub->header = header;
+	sub->size = st.st_size;
+	sub->slots = (const uint8_t *)mem + header->slot_offset;
+	/* only frames published from now on */
+	sub->next = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+	*subp = sub;
+	return 0;
+}
+
+api_public
+void ocean_subscriber_close(struct ocean_subscriber *sub)
+{
+	if (!sub)
+		return;
+
+	munmap((void *)sub->header, sub->size);
+	free(sub);
+}
+
+api_public
+int ocean_subscriber_next(struct ocean_subscriber *sub, struct ocean_shm_frame *frame,
+			  int timeout)
+{
+	const struct ocean_shm_header *header;
+	const int64_t deadline = ocean_shm_now_ms() + timeout;
+	uint64_t lost = 0;
+
+	if (!sub || !frame)
+		return -EINVAL;
+
+	header = sub->header;
+
+	for (;;) {
+		const struct ocean_shm_slot *slot;
+		const uint32_t wake = __atomic_load_n(&header->wake, __ATOMIC_SEQ_CST);
+		const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_SEQ_CST);
+		uint64_t token;
+
+		if (sub->next >= head) {
+			const int64_t left = deadline - ocean_shm_now_ms();
+
+			if (timeout == 0 || (timeout > 0 && left <= 0))
+				return -EAGAIN;
+
+			ocean_shm_sleep(header, wake, timeout < 0 ? -1 : left);
+			continue;
+		}
+
+		/*
+		 * The reader fell behind, skip to the oldest slot. The publisher
+		 * may be writing it already, the sequence counter tells.
+		 */
+		if (head - sub->next > header->slots) {
+			lost += head - sub->next - header->slots;
+			sub->next = head - header->slots;
+		}
+
+		slot = (const struct ocean_shm_slot *)(sub->slots +
+			(sub->next % header->slots) * header->slot_size);
+
+		token = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if ((token & 1) || slot->generation != sub->next) {
+			lost++;
+			sub->next++;
+			continue;
+		}
+
+		frame->sequence = slot->sequence;
+		frame->timestamp = slot->timestamp;
+		frame->integration_time = slot->integration_time;
+		frame->flags = slot->flags;
+		frame->num_of_pixels = header->num_of_pixels;
+		frame->data = (const double *)((const uint8_t *)slot +
+					       ocean_shm_slot_header_size());
+		frame->wavelength = (const double *)((const uint8_t *)header +
+						     ocean_shm_header_size());
+		frame->slot = slot;
+		frame->token = token;
+
+		/* the information has to be from the same frame, too */
+		if (!ocean_subscriber_valid(sub, frame)) {
+			lost++;
+			sub->next++;
+			continue;
+		}
+
+		frame->lost = lost;
+		sub->next++;
+		return 0;
+	}
+}
+
+api_public
+bool ocean_subscriber_valid(struct ocean_subscriber *sub, const struct ocean_shm_frame *frame)
+{
+	const struct ocean_shm_slot *slot;
+
+	if (!sub || !frame || !frame->slot)
+		return false;
+
+	slot = frame->slot;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == frame->token;
+}
@@ -0,0 +1,150 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#define NUM_OF_PIXELS 2048
+#define PEAK_SPACING 4.0
+#define PEAK_SIGMA 0.8
+#define ITERATIONS 20000
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Fill the spectra with a comb of gaussian lines on a noisy baseline,
+ * returns the number of lines and their true positions.
+ */
+static size_t make_lines(struct ocean_spectra *spec, double *pos, size_t max)
+{
+	double *data = ocean_spectra_get_data(spec);
+	size_t len = ocean_spectra_get_size(spec);
+	unsigned seed = 42;
+	size_t i, k, num = 0;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = 1000.0 + ((seed >> 16) % 11) - 5.0;
+	}
+
+	for (k = 0; k < max; k++) {
+		const double p = 3.0 + k * PEAK_SPACING + 0.1 * (k % 7);
+		const double amp = 2000.0 + 500.0 * (k % 5);
+
+		if (p + 3.0 >= len)
+			break;
+
+		for (i = 0; i < len; i++) {
+			const double x = (i - p) / PEAK_SIGMA;
+			data[i] += amp * exp(-0.5 * x * x);
+		}
+		pos[num++] = p;
+	}
+
+	return num;
+}
+
+static int bench_peaks(struct ocean *ctx, enum ocean_peak_refinement refine,
+		       const char *name, double max_error)
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean_peak_finder *finder = NULL;
+	struct ocean_peak peaks[1024];
+	double pos[1024];
+	double start, elapsed, worst = 0.0;
+	size_t num, i;
+	int ret, found = 0;
+
+	ret = ocean_spectra_create(&spec, ctx);
+	if (ret < 0) {
+		printf("ocean_spectra_create: %d\n", ret);
+		return ret;
+	}
+
+	ret = ocean_peak_finder_create(&finder);
+	if (ret < 0) {
+		printf("ocean_peak_finder_create: %d\n", ret);
+		goto cleanup;
+	}
+
+	ocean_peak_finder_set_smoothing(finder, 0);
+	ocean_peak_finder_set_prominence(finder, 500.0);
+	ocean_peak_finder_set_threshold(finder, 1500.0);
+	ocean_peak_finder_set_refinement(finder, refine);
+
+	num = make_lines(spec, pos, 1024);
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++)
+		found = ocean_peak_finder_run(finder, spec, peaks, 1024);
+	elapsed = now() - start;
+
+	if (found != (int)num) {
+		printf("%s: found %d peaks, expected %zu\n", name, found, num);
+		ret = -EINVAL;
+		goto cleanup;
+	}
+
+	for (i = 0; i < num; i++) {
+		const double err = fabs(peaks[i].pixel - pos[i]);
+
+		if (err > worst)
+			worst = err;
+	}
+
+	printf("%-10s %4zu peaks/frame, %8.2f us/frame, %6.1f Mpeaks/s, "
+	       "max error %.3f px\n", name, num, elapsed * 1e6 / ITERATIONS,
+	       num * ITERATIONS / elapsed * 1e-6, worst);
+
+	if (worst > max_error) {
+		printf("%s: error above %.3f px\n", name, max_error);
+		ret = -EINVAL;
+	}
+
+cleanup:
+	ocean_peak_finder_free(finder);
+	ocean_spectra_free(spec);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = ocean_create(&ctx);
+	if (ret < 0) {
+		printf("ocean_create: %d\n", ret);
+		return 1;
+	}
+
+	/* several hundred lines a frame, a cost per peak rather than per call */
+	ret = ocean_open(ctx, 0x2457, 0x1026);
+	if (ret == 0)
+		ret = ocean_dummy_set_num_of_pixels(ctx, NUM_OF_PIXELS);
+	if (ret < 0) {
+		printf("setup: %d\n", ret);
+		goto out;
+	}
+
+	/* the lines are only ~2 pixel wide, so the centroid picks up the
+	 * flanks of the neighbours */
+	ret = bench_peaks(ctx, OCEAN_PEAK_REFINE_NONE, "none", 0.5);
+	if (ret == 0)
+		ret = bench_peaks(ctx, OCEAN_PEAK_REFINE_CENTROID, "centroid", 0.25);
+	if (ret == 0)
+		ret = bench_peaks(ctx, OCEAN_PEAK_REFINE_PARABOLIC, "parabolic", 0.15);
+	if (ret == 0)
+		ret = bench_peaks(ctx, OCEAN_PEAK_REFINE_GAUSSIAN, "gaussian", 0.05);
+
+out:
+	ocean_free(ctx);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#include "fixture.h"
+
+int fixture_setup(struct ocean **ctx, struct ocean_spectra **spec)
+{
+	int ret;
+
+	*ctx = NULL;
+	if (spec)
+		*spec = NULL;
+
+	ret = ocean_create(ctx);
+	if (ret == 0)
+		ret = ocean_open(*ctx, 0x2457, 0x1026);
+	if (ret == 0 && spec)
+		ret = ocean_spectra_create(spec, *ctx);
+	if (ret < 0)
+		printf("setup: %d\n", ret);
+
+	return ret;
+}
+
+void fixture_teardown(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+}
@@ -0,0 +1,12 @@
+#ifndef TESTS_FIXTURE_H
+#define TESTS_FIXTURE_H 1
+
+#include "libocean.h"
+
+/* Opens the (dummy) spectrometer and, unless @spec is NULL, creates a
+ * spectra of it. A failure is printed, fixture_teardown() cleans up
+ * either way. */
+int fixture_setup(struct ocean **ctx, struct ocean_spectra **spec);
+void fixture_teardown(struct ocean *ctx, struct ocean_spectra *spec);
+
+#endif /* TESTS_FIXTURE_H */
@@ -2,6 +2,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <unistd.h>
 
 #ifndef ARRAY_SIZE
@@ -221,9 +222,245 @@ out:
 	return ret;
 }
 
+/**
+ * Compare the band integrals against a sum over each band
+ */
+static int test_bands(struct ocean *usb)
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean_bands *bands = NULL;
+	double lower[200], upper[200], result[200];
+	double first, last, wl0, wl1, *buf;
+	size_t len, i, j;
+	int ret;
+
+	ret = ocean_spectra_create(&spec, usb);
+	if (ret < 0) {
+		printf("ocean_spectra_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_request_spectra(usb, spec);
+	if (ret < 0) {
+		printf("ocean_request_spectra: %d\n", ret);
+		goto cleanup;
+	}
+
+	buf = ocean_spectra_get_data(spec);
+	len = ocean_spectra_get_size(spec);
+	wl0 = ocean_spectra_get_wavelength(spec, 0);
+	wl1 = ocean_spectra_get_wavelength(spec, len - 1);
+
+	/* overlapping bands of different width, the last one is partially
+	 * outside of the detector */
+	for (i = 0; i < ARRAY_SIZE(lower); i++) {
+		lower[i] = wl0 + (wl1 - wl0) * i / ARRAY_SIZE(lower);
+		upper[i] = lower[i] + 0.37 * (1 + i % 13);
+	}
+	upper[ARRAY_SIZE(upper) - 1] = wl1 + 100.0;
+
+	ret = ocean_bands_create(&bands, spec, lower, upper, ARRAY_SIZE(lower));
+	if (ret < 0) {
+		printf("ocean_bands_create: %d\n", ret);
+		goto cleanup;
+	}
+
+	ret = ocean_bands_integrate(bands, spec, result);
+	if (ret < 0) {
+		printf("ocean_bands_integrate: %d\n", ret);
+		goto cleanup;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(lower); i++) {
+		double sum = 0.0;
+
+		ocean_bands_get_bounds(bands, i, &first, &last);
+		for (j = 0; j < len; j++) {
+			double lo = j - 0.5 > first ? j - 0.5 : first;
+			double hi = j + 0.5 < last ? j + 0.5 : last;
+
+			if (hi <= lo)
+				continue;
+			sum += (hi - lo) * buf[j] *
+				(ocean_spectra_get_wavelength_at(spec, j + 0.5) -
+				 ocean_spectra_get_wavelength_at(spec, j - 0.5));
+		}
+
+		if (fabs(sum - result[i]) > 1e-9 * fabs(sum) + 1e-9) {
+			printf("band %zu [%.2f, %.2f nm]: %e != %e\n",
+				i, lower[i], upper[i], result[i], sum);
+			ret = -EINVAL;
+		}
+	}
+	printf("Bands: %zu, first %e, last %e\n", ARRAY_SIZE(lower),
+		result[0], result[ARRAY_SIZE(lower) - 1]);
+
+cleanup:
+	ocean_bands_free(bands);
+	ocean_spectra_free(spec);
+out:
+	return ret;
+}
+
+/**
+ * The statistics gathered while decoding have to match the data
+ */
+static int test_stats(struct ocean *usb)
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean_spectra_stats stats;
+	const uint64_t *map;
+	double *buf, min, max, sum, saturation;
+	size_t len, i, saturated, peak;
+	int ret, frame;
+
+	ret = ocean_spectra_create(&spec, usb);
+	if (ret < 0) {
+		printf("ocean_spectra_create: %d\n", ret);
+		goto out;
+	}
+
+	for (frame = 0; frame < 2; frame++) {
+		ret = ocean_request_spectra(usb, spec);
+		if (ret < 0) {
+			printf("ocean_request_spectra: %d\n", ret);
+			goto cleanup;
+		}
+
+		ret = ocean_spectra_get_stats(spec, &stats);
+		if (ret < 0) {
+			printf("ocean_spectra_get_stats: %d\n", ret);
+			goto cleanup;
+		}
+
+		buf = ocean_spectra_get_data(spec);
+		len = ocean_spectra_get_size(spec);
+		map = ocean_spectra_get_saturation_map(spec);
+		saturation = ocean_spectra_get_saturation(spec);
+
+		min = max = buf[0];
+		sum = 0.0;
+		saturated = peak = 0;
+		for (i = 0; i < len; i++) {
+			const bool clipped = (map[i / 64] >> (i % 64)) & 1;
+
+			sum += buf[i];
+			if (buf[i] < min)
+				min = buf[i];
+			if (buf[i] > max) {
+				max = buf[i];
+				peak = i;
+			}
+			saturated += clipped;
+
+			/* the device compares the raw counts */
+			if (clipped && buf[i] < 0.99 * saturation) {
+				printf("pixel %zu: %e marked saturated\n", i, buf[i]);
+				ret = -EINVAL;
+			}
+		}
+
+		if (stats.min != min || stats.max != max || stats.peak != peak ||
+		    stats.saturated != saturated ||
+		    fabs(stats.mean - sum / len) > 1e-9 * fabs(stats.mean)) {
+			printf("stats: min %e/%e max %e/%e peak %zu/%zu saturated %zu/%zu\n",
+				stats.min, min, stats.max, max, stats.peak, peak,
+				stats.saturated, saturated);
+			ret = -EINVAL;
+		}
+		printf("Stats: min %e, max %e at %zu, mean %e, %zu saturated\n",
+			stats.min, stats.max, stats.peak, stats.mean, stats.saturated);
+	}
+
+cleanup:
+	ocean_spectra_free(spec);
+out:
+	return ret;
+}
+
+/**
+ * The frames end up in the buffers of the caller, nothing is copied
+ */
+static int test_buffers(struct ocean *usb)
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean_spectra_stats stats;
+	size_t data_len, raw_len, len, j;
+	double *data[2] = { NULL, NULL };
+	uint8_t *raw = NULL;
+	int ret, i;
+
+	ret = ocean_spectra_get_buffer_sizes(usb, &data_len, &raw_len);
+	if (ret < 0) {
+		printf("ocean_spectra_get_buffer_sizes: %d\n", ret);
+		goto out;
+	}
+
+	if (posix_memalign((void **)&data[0], 64, data_len) ||
+	    posix_memalign((void **)&data[1], 64, data_len) ||
+	    !(raw = malloc(raw_len))) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (ocean_spectra_create_with_buffers(&spec, usb, data[0], data_len - 1,
+					      NULL, 0) != -EINVAL) {
+		printf("accepted a short buffer\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = ocean_spectra_create_with_buffers(&spec, usb, data[0], data_len, raw, raw_len);
+	if (ret < 0) {
+		printf("ocean_spectra_create_with_buffers: %d\n", ret);
+		goto out;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (i)
+			ocean_spectra_rebind(spec, data[1], data_len, NULL, 0);
+
+		len = ocean_spectra_get_size(spec);
+		for (j = 0; j < len; j++)
+			data[i][j] = NAN;
+
+		ret = ocean_request_spectra(usb, spec);
+		if (ret == 0)
+			ret = ocean_spectra_get_stats(spec, &stats);
+		if (ret < 0) {
+			printf("ocean_request_spectra: %d\n", ret);
+			goto out;
+		}
+
+		if (ocean_spectra_get_data(spec) != data[i] ||
+		    ocean_spectra_get_raw_data(spec) != raw ||
+		    data[i][stats.peak] != stats.max) {
+			printf("frame %d not decoded into the buffer\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+		for (j = 0; j < len; j++) {
+			if (isnan(data[i][j])) {
+				printf("frame %d: pixel %zu not written\n", i, j);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
+out:
+	/* the buffers are ours, free() leaves them alone */
+	ocean_spectra_free(spec);
+	free(raw);
+	free(data[1]);
+	free(data[0]);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	struct ocean *usb = NULL;
+	int failed = 0;
 	int ret;
 
 	ret = ocean_create(&usb);
@@ -242,8 +479,11 @@ int main(int argc, char *argv[])
 //	test_enable(usb);
 //	test_spectra_dump(usb);
 	test_spectra_csv(usb);
+	failed |= test_bands(usb) < 0;
+	failed |= test_stats(usb) < 0;
+	failed |= test_buffers(usb) < 0;
 
 out:
 	ocean_free(usb);
-	return 0;
+	return failed;
 }
@@ -0,0 +1,175 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define NUM_FRAMES 1000
+
+static unsigned seed = 7;
+
+static double noise(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 16) % 2001) / 1000.0 - 1.0;
+}
+
+static int check(struct ocean_accumulator *acc, double **frames, size_t n, size_t len)
+{
+	const double *mean = ocean_accumulator_get_mean(acc);
+	const double *variance = ocean_accumulator_get_variance(acc);
+	const double *min = ocean_accumulator_get_min(acc);
+	const double *max = ocean_accumulator_get_max(acc);
+	size_t i, f;
+
+	if (ocean_accumulator_get_count(acc) != n)
+		return -EINVAL;
+
+	/* two passes, the textbook way */
+	for (i = 0; i < len; i++) {
+		double m = 0.0, v = 0.0, lo = HUGE_VAL, hi = -HUGE_VAL;
+
+		for (f = 0; f < n; f++) {
+			m += frames[f][i];
+			lo = fmin(lo, frames[f][i]);
+			hi = fmax(hi, frames[f][i]);
+		}
+		m /= n;
+		for (f = 0; f < n; f++)
+			v += (frames[f][i] - m) * (frames[f][i] - m);
+		v /= n - 1;
+
+		if (fabs(mean[i] - m) > 1e-9 * fabs(m) || fabs(variance[i] - v) > 1e-9 * v ||
+		    min[i] != lo || max[i] != hi) {
+			printf("pixel %zu: mean %f/%f variance %f/%f\n", i, mean[i], m,
+				variance[i], v);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Against two passes over the stored frames, in one go and split in two
+ * merged halves
+ */
+static int test_welford(struct ocean_spectra *spec)
+{
+	struct ocean_accumulator *acc = NULL, *half[2] = { NULL, NULL };
+	const size_t len = ocean_spectra_get_size(spec);
+	static double *frames[NUM_FRAMES];
+	size_t i, f;
+	int ret;
+
+	ret = ocean_accumulator_create(&acc, spec, OCEAN_ACCUMULATE_DATA);
+	if (ret == 0)
+		ret = ocean_accumulator_create(&half[0], spec, OCEAN_ACCUMULATE_DATA);
+	if (ret == 0)
+		ret = ocean_accumulator_create(&half[1], spec, OCEAN_ACCUMULATE_DATA);
+	if (ret < 0)
+		goto out;
+
+	for (f = 0; f < NUM_FRAMES; f++) {
+		frames[f] = malloc(len * sizeof(double));
+		if (!frames[f]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		/* a large offset, the naive sum of squares loses it */
+		for (i = 0; i < len; i++)
+			frames[f][i] = 1e6 + i + (1.0 + i % 7) * noise();
+
+		ocean_accumulator_add_values(acc, frames[f], len);
+		ocean_accumulator_add_values(half[f % 3 == 0], frames[f], len);
+	}
+
+	ret = check(acc, frames, NUM_FRAMES, len);
+	if (ret < 0) {
+		printf("accumulated\n");
+		goto out;
+	}
+
+	ret = ocean_accumulator_merge(half[0], half[1]);
+	if (ret == 0)
+		ret = check(half[0], frames, NUM_FRAMES, len);
+	if (ret < 0) {
+		printf("merged\n");
+		goto out;
+	}
+
+	if (ocean_accumulator_add_values(acc, frames[0], len - 1) != -EINVAL)
+		ret = -EINVAL;
+
+out:
+	for (f = 0; f < NUM_FRAMES; f++)
+		free(frames[f]);
+	ocean_accumulator_free(half[1]);
+	ocean_accumulator_free(half[0]);
+	ocean_accumulator_free(acc);
+	return ret;
+}
+
+/**
+ * Straight from the frames of the device, the dummy alternates two
+ */
+static int test_frames(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_accumulator *acc = NULL;
+	double first[4096], second[4096];
+	const double *mean, *variance;
+	size_t len = ocean_spectra_get_size(spec), i;
+	int ret, f;
+
+	ret = ocean_accumulator_create(&acc, spec, OCEAN_ACCUMULATE_COUNTS);
+	if (ret < 0)
+		return ret;
+
+	for (f = 0; f < 10 && ret == 0; f++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_accumulator_add(acc, spec);
+		if (f < 2)
+			memcpy(f ? second : first, ocean_spectra_get_data(spec),
+			       len * sizeof(double));
+	}
+	if (ret < 0)
+		goto out;
+
+	mean = ocean_accumulator_get_mean(acc);
+	variance = ocean_accumulator_get_variance(acc);
+	for (i = 0; i < len; i++) {
+		const double m = (first[i] + second[i]) / 2;
+		const double v = (first[i] - m) * (first[i] - m) * 10 / 9;
+
+		if (fabs(mean[i] - m) > 1e-9 * m || fabs(variance[i] - v) > 1e-6 * (v + 1)) {
+			printf("pixel %zu: mean %f/%f\n", i, mean[i], m);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+out:
+	ocean_accumulator_free(acc);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_welford(spec);
+	if (ret == 0)
+		ret = test_frames(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+#include "libocean.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define CAPACITY 8
+#define NUM_FRAMES 5
+
+static const char *const names[] = {
+	"sequence", "timestamp", "integration_time", "intensity",
+};
+
+static const char *const formats[] = {
+	"L", "tsn:UTC", "I", NULL,
+};
+
+/**
+ * Check the exported tree the way a consumer would walk it
+ */
+static int check_export(struct ocean_batch *batch, struct ArrowArray *array,
+			struct ArrowSchema *schema)
+{
+	const size_t num_of_pixels = ocean_batch_get_num_of_pixels(batch);
+	const struct ArrowArray *values;
+	char format[32];
+	int i;
+
+	if (strcmp(schema->format, "+s") || schema->n_children != 4 ||
+	    array->n_children != 4 || array->length != NUM_FRAMES ||
+	    array->n_buffers != 1 || array->buffers[0]) {
+		printf("struct: %s, %lld children\n", schema->format,
+			(long long)schema->n_children);
+		return -EINVAL;
+	}
+
+	snprintf(format, sizeof(format), "+w:%zu", num_of_pixels);
+	for (i = 0; i < 4; i++) {
+		const struct ArrowSchema *field = schema->children[i];
+		const struct ArrowArray *column = array->children[i];
+
+		if (strcmp(field->name, names[i]) ||
+		    strcmp(field->format, formats[i] ? formats[i] : format) ||
+		    column->length != NUM_FRAMES || column->null_count ||
+		    !column->release || !field->release) {
+			printf("column %d: %s %s\n", i, field->name, field->format);
+			return -EINVAL;
+		}
+	}
+
+	for (i = 0; i < NUM_FRAMES; i++) {
+		const uint64_t *sequence = array->children[0]->buffers[1];
+		const uint64_t *timestamp = array->children[1]->buffers[1];
+		const uint32_t *integration_time = array->children[2]->buffers[1];
+
+		if (sequence[i] != ocean_batch_get_sequence(batch, i) ||
+		    sequence[i] != (uint64_t)i ||
+		    timestamp[i] != ocean_batch_get_timestamp(batch, i) ||
+		    integration_time[i] != 100) {
+			printf("frame %d: sequence %llu\n", i, (unsigned long long)sequence[i]);
+			return -EINVAL;
+		}
+	}
+
+	/* zero copy, the values are the matrix of the batch */
+	values = array->children[3]->children[0];
+	if (strcmp(schema->children[3]->children[0]->format, "g") ||
+	    values->length != (int64_t)(NUM_FRAMES * num_of_pixels) ||
+	    values->buffers[1] != ocean_batch_get_data(batch) ||
+	    (uintptr_t)values->buffers[1] % 64) {
+		printf("intensity: %lld values\n", (long long)values->length);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_export(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_batch *batch = NULL;
+	struct ArrowSchema schema, wl_schema;
+	struct ArrowArray array, wl_array, moved;
+	const double *data;
+	size_t num_of_pixels;
+	double value;
+	int ret, i;
+
+	ret = ocean_batch_create(&batch, spec, CAPACITY);
+	if (ret < 0) {
+		printf("ocean_batch_create: %d\n", ret);
+		return ret;
+	}
+	num_of_pixels = ocean_batch_get_num_of_pixels(batch);
+
+	ocean_set_integration_time(ctx, 100);
+	for (i = 0; i < NUM_FRAMES; i++) {
+		ocean_request_spectra(ctx, spec);
+		ret = ocean_batch_append(batch, spec);
+		if (ret < 0) {
+			printf("ocean_batch_append: %d\n", ret);
+			goto out;
+		}
+
+		if (memcmp(ocean_batch_get_data(batch) + i * num_of_pixels,
+			   ocean_spectra_get_data(spec), num_of_pixels * sizeof(double))) {
+			printf("frame %d differs\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ret = ocean_batch_export_arrow(batch, &array, &schema);
+	if (ret < 0) {
+		printf("ocean_batch_export_arrow: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_batch_export_wavelength_arrow(batch, &wl_array, &wl_schema);
+	if (ret < 0) {
+		printf("ocean_batch_export_wavelength_arrow: %d\n", ret);
+		array.release(&array);
+		schema.release(&schema);
+		goto out;
+	}
+
+	ret = check_export(batch, &array, &schema);
+	if (ret == 0 && (wl_array.length != (int64_t)num_of_pixels ||
+			 ((const double *)wl_array.buffers[1])[1] !=
+			 ocean_spectra_get_wavelength(spec, 1))) {
+		printf("wavelength: %lld values\n", (long long)wl_array.length);
+		ret = -EINVAL;
+	}
+
+	if (ret == 0 && ocean_batch_clear(batch) != -EBUSY) {
+		printf("cleared an exported batch\n");
+		ret = -EINVAL;
+	}
+
+	value = ocean_batch_get_data(batch)[num_of_pixels + 1];
+
+	/* a consumer moves the intensity column out and releases the rest */
+	moved = *array.children[3];
+	array.children[3]->release = NULL;
+	array.release(&array);
+	schema.release(&schema);
+	wl_array.release(&wl_array);
+	wl_schema.release(&wl_schema);
+	if (array.release || schema.release) {
+		printf("release did not mark the array released\n");
+		ret = -EINVAL;
+	}
+
+	/* the batch has to outlive its owner as long as data is imported */
+	ocean_batch_free(batch);
+	batch = NULL;
+
+	data = moved.children[0]->buffers[1];
+	if (ret == 0 && data[num_of_pixels + 1] != value) {
+		printf("moved column lost its data\n");
+		ret = -EINVAL;
+	}
+	moved.release(&moved);
+
+out:
+	ocean_batch_free(batch);
+	return ret;
+}
+
+static int test_batch(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_batch *batch = NULL;
+	int ret, i;
+
+	ret = ocean_batch_create(&batch, spec, 2);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 3; i++) {
+		ocean_request_spectra(ctx, spec);
+		ret = ocean_batch_append(batch, spec);
+		if ((i < 2 && ret < 0) || (i == 2 && ret != -ENOSPC)) {
+			printf("append %d: %d\n", i, ret);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ret = ocean_batch_clear(batch);
+	if (ret < 0 || ocean_batch_get_size(batch) != 0) {
+		printf("ocean_batch_clear: %d\n", ret);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = ocean_batch_append(batch, spec);
+	if (ret < 0 || ocean_batch_get_sequence(batch, 0) != ocean_spectra_get_sequence(spec))
+		ret = -EINVAL;
+
+out:
+	ocean_batch_free(batch);
+	return ret;
+}
+
+/**
+ * The frames of one request land in consecutive rows of the matrix
+ */
+static int test_request_batch(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_batch *batch = NULL;
+	uint64_t first;
+	int ret, i;
+
+	ret = ocean_batch_create(&batch, spec, CAPACITY);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_request_spectra_batch(ctx, spec, CAPACITY - 1, batch);
+	if (ret < 0 || ocean_batch_get_size(batch) != CAPACITY - 1) {
+		printf("ocean_request_spectra_batch: %d, %zu frames\n", ret,
+			ocean_batch_get_size(batch));
+		ret = -EINVAL;
+		goto out;
+	}
+
+	first = ocean_batch_get_sequence(batch, 0);
+	for (i = 0; i < CAPACITY - 1; i++) {
+		if (ocean_batch_get_sequence(batch, i) != first + i ||
+		    ocean_batch_get_integration_time(batch, i) != 100) {
+			printf("frame %d: sequence %llu\n", i,
+				(unsigned long long)ocean_batch_get_sequence(batch, i));
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	/* the last frame stays in the spectra */
+	if (ocean_spectra_get_sequence(spec) != first + CAPACITY - 2 ||
+	    (uintptr_t)ocean_batch_get_data(batch) % 64) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* all or nothing */
+	ret = ocean_request_spectra_batch(ctx, spec, 2, batch);
+	if (ret != -ENOSPC || ocean_batch_get_size(batch) != CAPACITY - 1) {
+		printf("overflow: %d\n", ret);
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = 0;
+
+out:
+	ocean_batch_free(batch);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = ocean_create(&ctx);
+	if (ret < 0) {
+		printf("ocean_create: %d\n", ret);
+		return 1;
+	}
+
+	ret = ocean_open(ctx, 0x2457, 0x1026);
+	if (ret < 0) {
+		printf("ocean_open: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_spectra_create(&spec, ctx);
+	if (ret < 0) {
+		printf("ocean_spectra_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_export(ctx, spec);
+	if (ret == 0)
+		ret = test_batch(ctx, spec);
+	if (ret == 0)
+		ret = test_request_batch(ctx, spec);
+
+out:
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+#include "libocean.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_FRAMES 256
+#define REPEAT 200
+
+static unsigned seed = 1;
+
+static unsigned next_random(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Build raw frames the way the NIRQuest sends them: the (dummy) spectra
+ * scaled by a slowly drifting lamp, some noise, 16 bit little endian with
+ * the msb flipped.
+ */
+static void make_frames(struct ocean_spectra *spec, uint8_t *frames, size_t frame_size)
+{
+	const double *data = ocean_spectra_get_data(spec);
+	const size_t len = ocean_spectra_get_size(spec);
+	size_t f, i;
+
+	for (f = 0; f < NUM_FRAMES; f++) {
+		uint8_t *raw = frames + f * frame_size;
+		const double lamp = 1.0 + 0.05 * (f % 32) / 32.0;
+
+		memset(raw, 0, frame_size);
+		for (i = 0; i < len && 2 * i + 1 < frame_size; i++) {
+			unsigned val = data[i] * lamp + (next_random() % 16);
+
+			val ^= 0x8000;
+			raw[2 * i] = val & 0xff;
+			raw[2 * i + 1] = val >> 8;
+		}
+	}
+}
+
+/**
+ * Encode all frames into one stream and decode them again
+ */
+static int round_trip(const char *name, const uint8_t *frames, size_t frame_size,
+		      unsigned key_interval, bool timing)
+{
+	struct ocean_encoder *enc = NULL;
+	struct ocean_decoder *dec = NULL;
+	uint8_t *stream = NULL, *frame = NULL;
+	size_t max, pos = 0, f;
+	double start, t_enc = 0.0, t_dec = 0.0;
+	int ret, r;
+
+	ret = ocean_encoder_create(&enc, frame_size);
+	if (ret < 0) {
+		printf("ocean_encoder_create: %d\n", ret);
+		goto out;
+	}
+	ocean_encoder_set_key_interval(enc, key_interval);
+
+	ret = ocean_decoder_create(&dec, frame_size);
+	if (ret < 0) {
+		printf("ocean_decoder_create: %d\n", ret);
+		goto out;
+	}
+
+	max = ocean_encoder_get_max_size(enc);
+	stream = malloc(max * NUM_FRAMES);
+	frame = malloc(frame_size);
+	if (!stream || !frame) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (r = 0; r < (timing ? REPEAT : 1); r++) {
+		ocean_encoder_reset(enc);
+		pos = 0;
+
+		start = now();
+		for (f = 0; f < NUM_FRAMES; f++) {
+			ret = ocean_encoder_encode(enc, frames + f * frame_size,
+						   stream + pos, max);
+			if (ret < 0) {
+				printf("%s: ocean_encoder_encode: %d\n", name, ret);
+				goto out;
+			}
+			pos += ret;
+		}
+		t_enc += now() - start;
+
+		ocean_decoder_reset(dec);
+		start = now();
+		for (f = 0, ret = 0; f < pos; f += ret) {
+			ret = ocean_decoder_decode(dec, stream + f, pos - f, frame);
+			if (ret < 0) {
+				printf("%s: ocean_decoder_decode: %d\n", name, ret);
+				goto out;
+			}
+		}
+		t_dec += now() - start;
+	}
+
+	/* compare every frame */
+	ocean_decoder_reset(dec);
+	for (f = 0, pos = 0; f < NUM_FRAMES; f++) {
+		ret = ocean_decoder_decode(dec, stream + pos, max * NUM_FRAMES - pos, frame);
+		if (ret < 0) {
+			printf("%s: ocean_decoder_decode: %d\n", name, ret);
+			goto out;
+		}
+		pos += ret;
+
+		if (memcmp(frame, frames + f * frame_size, frame_size) != 0) {
+			printf("%s: frame %zu differs\n", name, f);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	printf("%-8s %5zu bytes/frame, ratio %5.2f", name, frame_size,
+		(double)frame_size * NUM_FRAMES / pos);
+	if (timing) {
+		const double bytes = (double)frame_size * NUM_FRAMES * REPEAT;
+
+		printf(", encode %7.1f MB/s, decode %7.1f MB/s",
+			bytes / t_enc * 1e-6, bytes / t_dec * 1e-6);
+	}
+	printf("\n");
+	ret = 0;
+
+out:
+	free(frame);
+	free(stream);
+	ocean_decoder_free(dec);
+	ocean_encoder_free(enc);
+	return ret;
+}
+
+/**
+ * The decoder has to refuse streams it can not handle
+ */
+static int test_errors(const uint8_t *frames, size_t frame_size)
+{
+	struct ocean_encoder *enc = NULL;
+	struct ocean_decoder *dec = NULL;
+	uint8_t stream[2][4096], frame[4096];
+	int len[2], ret;
+
+	if (ocean_encoder_create(&enc, frame_size) < 0 ||
+	    ocean_decoder_create(&dec, frame_size) < 0) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = ocean_encoder_encode(enc, frames, stream[0], 16);
+	if (ret != -ENOSPC) {
+		printf("encode into small buffer: %d\n", ret);
+		goto fail;
+	}
+
+	len[0] = ocean_encoder_encode(enc, frames, stream[0], sizeof(stream[0]));
+	len[1] = ocean_encoder_encode(enc, frames + frame_size, stream[1], sizeof(stream[1]));
+
+	ret = ocean_decoder_decode(dec, stream[1], len[1], frame);
+	if (ret != -ENODATA) {
+		printf("delta frame without key frame: %d\n", ret);
+		goto fail;
+	}
+
+	ret = ocean_decoder_decode(dec, stream[0], len[0] / 2, frame);
+	if (ret != -EBADMSG) {
+		printf("truncated frame: %d\n", ret);
+		goto fail;
+	}
+
+	stream[0][0] ^= 0xff;
+	ret = ocean_decoder_decode(dec, stream[0], len[0], frame);
+	if (ret != -EBADMSG) {
+		printf("corrupt header: %d\n", ret);
+		goto fail;
+	}
+	stream[0][0] ^= 0xff;
+
+	ret = ocean_decoder_decode(dec, stream[0], len[0], frame);
+	if (ret != len[0]) {
+		printf("key frame: %d\n", ret);
+		goto fail;
+	}
+
+	ret = ocean_decoder_decode(dec, stream[1], len[1], frame);
+	if (ret != len[1] || memcmp(frame, frames + frame_size, frame_size)) {
+		printf("delta frame: %d\n", ret);
+		goto fail;
+	}
+
+	ret = 0;
+	goto out;
+fail:
+	ret = -EINVAL;
+out:
+	ocean_decoder_free(dec);
+	ocean_encoder_free(enc);
+	return ret;
+}
+
+/**
+ * Every prefix of a packet is truncated, each is decoded from a buffer of
+ * just its length so reading past it shows under valgrind or asan
+ */
+static int test_prefixes(const uint8_t *frames, size_t frame_size)
+{
+	struct ocean_encoder *enc = NULL;
+	struct ocean_decoder *dec = NULL;
+	uint8_t stream[2][4096], frame[4096];
+	uint8_t *prefix;
+	int len[2], ret = 0;
+	size_t i, n;
+
+	if (ocean_encoder_create(&enc, frame_size) < 0 ||
+	    ocean_decoder_create(&dec, frame_size) < 0) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	len[0] = ocean_encoder_encode(enc, frames, stream[0], sizeof(stream[0]));
+	len[1] = ocean_encoder_encode(enc, frames + frame_size, stream[1], sizeof(stream[1]));
+	if (len[0] < 0 || len[1] < 0) {
+		printf("encode: %d %d\n", len[0], len[1]);
+		goto fail;
+	}
+
+	/* the key frame, then the delta frame on top of it */
+	for (i = 0; i < 2; i++) {
+		for (n = 1; n < (size_t)len[i]; n++) {
+			prefix = malloc(n);
+			if (!prefix) {
+				ret = -ENOMEM;
+				goto out;
+			}
+
+			memcpy(prefix, stream[i], n);
+			ret = ocean_decoder_decode(dec, prefix, n, frame);
+			free(prefix);
+			if (ret != -EBADMSG) {
+				printf("prefix %zu of %d: %d\n", n, len[i], ret);
+				goto fail;
+			}
+		}
+
+		ret = ocean_decoder_decode(dec, stream[i], len[i], frame);
+		if (ret != len[i] || memcmp(frame, frames + i * frame_size, frame_size)) {
+			printf("frame %zu after prefixes: %d\n", i, ret);
+			goto fail;
+		}
+	}
+
+	ret = 0;
+	goto out;
+fail:
+	ret = -EINVAL;
+out:
+	ocean_decoder_free(dec);
+	ocean_encoder_free(enc);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	uint8_t *frames = NULL;
+	size_t frame_size, i;
+	int ret;
+
+	ret = ocean_create(&ctx);
+	if (ret < 0) {
+		printf("ocean_create: %d\n", ret);
+		return 1;
+	}
+
+	ret = ocean_open(ctx, 0x2457, 0x1026);
+	if (ret < 0) {
+		printf("ocean_open: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_spectra_create(&spec, ctx);
+	if (ret < 0) {
+		printf("ocean_spectra_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0) {
+		printf("ocean_request_spectra: %d\n", ret);
+		goto out;
+	}
+
+	/* one byte more than the raw data, to cover odd sizes */
+	frame_size = ocean_spectra_get_raw_size(spec) + 1;
+	frames = malloc(frame_size * NUM_FRAMES);
+	if (!frames) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	make_frames(spec, frames, frame_size);
+	ret = round_trip("spectra", frames, frame_size, 64, true);
+	if (ret == 0)
+		ret = round_trip("odd", frames, frame_size, 0, false);
+	if (ret == 0)
+		ret = round_trip("even", frames, frame_size - 1, 1, false);
+
+	for (i = 0; i < frame_size * NUM_FRAMES; i++)
+		frames[i] = next_random();
+	if (ret == 0)
+		ret = round_trip("random", frames, frame_size, 64, false);
+
+	memset(frames, 0, frame_size * NUM_FRAMES);
+	if (ret == 0)
+		ret = round_trip("zero", frames, frame_size, 64, false);
+	if (ret == 0)
+		ret = round_trip("tiny", frames, 3, 64, false);
+
+	make_frames(spec, frames, frame_size);
+	if (ret == 0)
+		ret = test_errors(frames, frame_size);
+	if (ret == 0)
+		ret = test_prefixes(frames, frame_size);
+	if (ret == 0)
+		ret = test_prefixes(frames, frame_size - 1);
+
+out:
+	free(frames);
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/* the decoder of libocean is private, the test builds its own */
+#include "ocean-nirquest.c"
+
+#include <stdlib.h>
+
+#define NUM_OF_PIXELS 1024
+#define SYNC_BYTE 0x69
+
+/* pixel 511 ends before the first sync byte, pixel 512 starts after it */
+#define SYNC_AT (512 * 2)
+
+static unsigned seed = 1;
+
+static unsigned next_random(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) & 0xffff;
+}
+
+static int spectra_init(struct ocean_spectra *spec, uint8_t *raw)
+{
+	memset(spec, 0, sizeof(*spec));
+	spec->raw = raw;
+	spec->raw_size = NUM_OF_PIXELS * 2 + NUM_OF_PIXELS / 512;
+	spec->data_size = NUM_OF_PIXELS;
+	spec->non_lin_coef[0] = 1.0;
+	spec->saturation = 60000;
+	spec->data = malloc(spec->data_size * sizeof(double));
+	spec->saturation_map = calloc((spec->data_size + 63) / 64, sizeof(uint64_t));
+	if (!spec->data || !spec->saturation_map)
+		return -ENOMEM;
+
+	/* whatever was decoded before */
+	memset(spec->data, 0xff, spec->data_size * sizeof(double));
+	memset(spec->saturation_map, 0xff, (spec->data_size + 63) / 64 * sizeof(uint64_t));
+	return 0;
+}
+
+static void spectra_release(struct ocean_spectra *spec)
+{
+	free(spec->saturation_map);
+	free(spec->data);
+}
+
+/* Like the NIRQuest sends it: little endian, msb flipped, a sync byte after
+ * every 512 pixels, some of them saturated */
+static void make_frame(uint8_t *raw)
+{
+	unsigned val;
+	size_t i = 0, j;
+
+	for (j = 0; j < NUM_OF_PIXELS; j++) {
+		val = next_random();
+		if (j % 37 == 0)
+			val = 60000 + val % 5536;
+		val ^= 0x8000;
+		raw[i++] = val & 0xff;
+		raw[i++] = val >> 8;
+		if ((j + 1) % 512 == 0)
+			raw[i++] = SYNC_BYTE;
+	}
+}
+
+static int compare(const char *name, struct ocean_spectra *a, struct ocean_spectra *b)
+{
+	const size_t len = a->data_size - 1;
+
+	if (memcmp(a->data, b->data, a->data_size * sizeof(double))) {
+		printf("%s: data differs\n", name);
+		return -EINVAL;
+	}
+
+	if (a->stats.min != b->stats.min || a->stats.max != b->stats.max ||
+	    a->stats.mean != b->stats.mean || a->stats.peak != b->stats.peak ||
+	    a->stats.saturated != b->stats.saturated) {
+		printf("%s: stats min %f max %f at %zu mean %f saturated %zu, expected "
+		       "min %f max %f at %zu mean %f saturated %zu\n", name,
+		       b->stats.min, b->stats.max, b->stats.peak, b->stats.mean,
+		       b->stats.saturated, a->stats.min, a->stats.max, a->stats.peak,
+		       a->stats.mean, a->stats.saturated);
+		return -EINVAL;
+	}
+
+	if (memcmp(a->saturation_map, b->saturation_map, (len + 63) / 64 * sizeof(uint64_t))) {
+		printf("%s: saturation map differs\n", name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * A frame decoded in pieces, ending at @splits and then at the end of the
+ * frame, is the same as one decoded at once
+ */
+static int test_split(const char *name, struct ocean_spectra *whole, uint8_t *raw,
+		      const size_t *splits, size_t num_splits)
+{
+	struct ocean_spectra spec;
+	struct ocean_decode d;
+	size_t k;
+	int ret;
+
+	ret = spectra_init(&spec, raw);
+	if (ret < 0)
+		goto out;
+
+	ocean_decode_begin(&d);
+	for (k = 0; k < num_splits; k++)
+		ocean_decode_update(&spec, &d, splits[k]);
+	ocean_decode_update(&spec, &d, spec.raw_size);
+	ocean_decode_end(&spec, &d);
+
+	ret = compare(name, whole, &spec);
+out:
+	spectra_release(&spec);
+	return ret;
+}
+
+/**
+ * Every byte on its own
+ */
+static int test_bytes(struct ocean_spectra *whole, uint8_t *raw)
+{
+	struct ocean_spectra spec;
+	struct ocean_decode d;
+	size_t avail;
+	int ret;
+
+	ret = spectra_init(&spec, raw);
+	if (ret < 0)
+		goto out;
+
+	ocean_decode_begin(&d);
+	for (avail = 1; avail <= spec.raw_size; avail++)
+		ocean_decode_update(&spec, &d, avail);
+	ocean_decode_end(&spec, &d);
+
+	ret = compare("bytes", whole, &spec);
+out:
+	spectra_release(&spec);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t mid_pixel[] = { 301 };
+	static const size_t at_sync[] = { SYNC_AT };
+	static const size_t after_sync[] = { SYNC_AT + 1 };
+	static const size_t around_sync[] = { SYNC_AT - 1, SYNC_AT, SYNC_AT + 1, SYNC_AT + 2 };
+	/* the same point twice, and the last sync byte */
+	static const size_t mixed[] = { 3, 3, 640, SYNC_AT + 2, 1537, 2 * SYNC_AT + 1 };
+	struct ocean_spectra whole;
+	uint8_t raw[NUM_OF_PIXELS * 2 + NUM_OF_PIXELS / 512];
+	struct ocean_decode d;
+	int ret;
+
+	make_frame(raw);
+	ret = spectra_init(&whole, raw);
+	if (ret < 0)
+		goto out;
+
+	ocean_decode_begin(&d);
+	ocean_decode_update(&whole, &d, whole.raw_size);
+	ocean_decode_end(&whole, &d);
+	if (!whole.stats.saturated) {
+		printf("nothing saturated\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = test_split("mid pixel", &whole, raw, mid_pixel, ARRAY_SIZE(mid_pixel));
+	if (ret == 0)
+		ret = test_split("at sync", &whole, raw, at_sync, ARRAY_SIZE(at_sync));
+	if (ret == 0)
+		ret = test_split("after sync", &whole, raw, after_sync, ARRAY_SIZE(after_sync));
+	if (ret == 0)
+		ret = test_split("around sync", &whole, raw, around_sync, ARRAY_SIZE(around_sync));
+	if (ret == 0)
+		ret = test_split("mixed", &whole, raw, mixed, ARRAY_SIZE(mixed));
+	if (ret == 0)
+		ret = test_bytes(&whole, raw);
+
+out:
+	spectra_release(&whole);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define NUM_FRAMES 50
+#define WINDOW 7
+
+static unsigned seed = 11;
+
+static unsigned rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+static double noise(void)
+{
+	return (rnd() % 2001) / 1000.0 - 1.0;
+}
+
+/**
+ * Noisy frames with spikes and dips added: exactly the spikes are
+ * replaced, by something close to the clean value
+ */
+static int test_synthetic(struct ocean_spectra *spec, enum ocean_despike_mode mode)
+{
+	struct ocean_despike *ds = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	double *clean = NULL, *frame = NULL;
+	size_t i, spikes, total = 0;
+	int ret, f, n;
+
+	ret = ocean_despike_create(&ds, spec, WINDOW);
+	if (ret == 0)
+		ret = ocean_despike_set_mode(ds, mode);
+	/* the noise stays within 2 of the signal */
+	if (ret == 0)
+		ret = ocean_despike_set_threshold(ds, 5.0, 5.0);
+	if (ret < 0)
+		goto out;
+
+	clean = malloc(len * sizeof(double));
+	frame = malloc(len * sizeof(double));
+	if (!clean || !frame) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (f = 0; f < NUM_FRAMES; f++) {
+		for (i = 0; i < len; i++) {
+			clean[i] = 1000.0 + 10.0 * sin(i / 20.0);
+			frame[i] = clean[i] + noise();
+		}
+
+		spikes = 0;
+		if (f >= WINDOW) {
+			for (n = 0; n < 5; n++) {
+				i = rnd() % len;
+				frame[i] += (n & 1) ? -300.0 : 500.0 + f;
+			}
+			/* the same pixel in every frame, it never gets into the window */
+			frame[len - 1] += 400.0;
+			for (i = 0; i < len; i++)
+				spikes += fabs(frame[i] - clean[i]) > 100.0;
+		}
+
+		ret = ocean_despike_apply(ds, frame, len);
+		if (ret < 0)
+			goto out;
+		if ((size_t)ret != spikes) {
+			printf("mode %d frame %d: %d replaced, %zu spikes\n", mode, f, ret,
+			       spikes);
+			ret = -EINVAL;
+			goto out;
+		}
+		total += ret;
+
+		for (i = 0; i < len; i++) {
+			if (fabs(frame[i] - clean[i]) > 3.0) {
+				printf("mode %d frame %d pixel %zu: %f, expected %f\n", mode, f,
+				       i, frame[i], clean[i]);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	ret = total > 0 ? 0 : -EINVAL;
+
+	if (ocean_despike_apply(ds, frame, len - 1) != -EINVAL)
+		ret = -EINVAL;
+
+out:
+	free(frame);
+	free(clean);
+	ocean_despike_free(ds);
+	return ret;
+}
+
+/**
+ * Behind ocean_request_spectra(), against a second device without. The
+ * dummy alternates two frames, with an even window and a low threshold
+ * the newest one is half of the spread away from the median and replaced.
+ */
+static int test_request(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_spectra_stats stats;
+	struct ocean_spectra *ref_spec = NULL;
+	struct ocean_despike *ds = NULL;
+	struct ocean *ref = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	const double *data, *ref_data;
+	double max;
+	size_t i, differ, total = 0;
+	int ret, f;
+
+	if (ocean_despike_create(&ds, spec, 2) != -EINVAL ||
+	    ocean_set_despike(NULL, NULL) != -EINVAL)
+		return -EINVAL;
+
+	ret = ocean_despike_create(&ds, spec, 4);
+	if (ret == 0)
+		ret = ocean_despike_set_threshold(ds, 0.5, 0.0);
+	if (ret == 0)
+		ret = ocean_create(&ref);
+	if (ret == 0)
+		ret = ocean_open(ref, 0x2457, 0x1026);
+	if (ret == 0)
+		ret = ocean_spectra_create(&ref_spec, ref);
+	if (ret == 0)
+		ret = ocean_set_despike(ctx, ds);
+	if (ret < 0)
+		goto out;
+
+	for (f = 0; f < 12; f++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_request_spectra(ref, ref_spec);
+		if (ret == 0)
+			ret = ocean_spectra_get_stats(spec, &stats);
+		if (ret < 0)
+			goto out;
+
+		data = ocean_spectra_get_data(spec);
+		ref_data = ocean_spectra_get_data(ref_spec);
+		for (i = 0, differ = 0, max = data[0]; i < len; i++) {
+			differ += data[i] != ref_data[i];
+			if (data[i] > max)
+				max = data[i];
+		}
+
+		/* the stats are those of the cleaned data */
+		if (max != stats.max || data[stats.peak] != max) {
+			printf("frame %d: max %f, stats %f\n", f, max, stats.max);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (differ != stats.replaced) {
+			printf("frame %d: %zu pixels differ, %zu replaced\n", f, differ,
+			       stats.replaced);
+			ret = -EINVAL;
+			goto out;
+		}
+		total += stats.replaced;
+	}
+
+	ret = total > 0 ? 0 : -EINVAL;
+
+out:
+	ocean_set_despike(ctx, NULL);
+	ocean_spectra_free(ref_spec);
+	ocean_free(ref);
+	ocean_despike_free(ds);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_synthetic(spec, OCEAN_DESPIKE_MEDIAN);
+	if (ret == 0)
+		ret = test_synthetic(spec, OCEAN_DESPIKE_SIGMA);
+	if (ret == 0)
+		ret = test_request(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+/* a few absorption lines on a flat background, moved by @shift pixels */
+static void lines(double *data, size_t len, double shift)
+{
+	static const double center[] = { 60.0, 140.0, 210.0, 330.0, 400.0 };
+	static const double depth[] = { 300.0, 800.0, 450.0, 600.0, 200.0 };
+	size_t i, l;
+
+	for (i = 0; i < len; i++) {
+		data[i] = 5000.0;
+		for (l = 0; l < 5; l++) {
+			const double x = (i - shift - center[l]) / 4.0;
+
+			data[i] -= depth[l] * exp(-0.5 * x * x);
+		}
+	}
+}
+
+/**
+ * Known shifts are found to a fraction of a pixel, directly and through
+ * the FFT alike, on the whole frame and on a band around one line
+ */
+static int test_shifts(struct ocean_spectra *spec)
+{
+	static const double shifts[] = { 0.0, 0.25, -0.5, 1.7, -3.3, 7.5, -11.9 };
+	struct ocean_drift_result direct, fft, band;
+	struct ocean_drift *drift = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	double *data = ocean_spectra_get_data(spec);
+	const double lower = ocean_spectra_get_wavelength(spec, 110);
+	const double upper = ocean_spectra_get_wavelength(spec, 170);
+	size_t s;
+	int ret;
+
+	lines(data, len, 0.0);
+	ret = ocean_drift_create(&drift, spec, 16);
+	if (ret < 0)
+		return ret;
+
+	for (s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++) {
+		const double nm = ocean_spectra_get_wavelength_at(spec, 255.0 + shifts[s]) -
+				  ocean_spectra_get_wavelength_at(spec, 255.0);
+
+		lines(data, len, shifts[s]);
+
+		ret = ocean_drift_set_method(drift, OCEAN_DRIFT_DIRECT);
+		if (ret == 0)
+			ret = ocean_drift_update(drift, spec, &direct);
+		if (ret == 0)
+			ret = ocean_drift_set_method(drift, OCEAN_DRIFT_FFT);
+		if (ret == 0)
+			ret = ocean_drift_update(drift, spec, &fft);
+		if (ret == 0)
+			ret = ocean_drift_set_bands(drift, &lower, &upper, 1);
+		if (ret == 0)
+			ret = ocean_drift_update(drift, spec, &band);
+		if (ret == 0)
+			ret = ocean_drift_set_bands(drift, NULL, NULL, 0);
+		if (ret < 0)
+			break;
+
+		if (fabs(direct.shift - shifts[s]) > 0.05 || fabs(band.shift - shifts[s]) > 0.05 ||
+		    fabs(direct.shift - fft.shift) > 1e-6 ||
+		    fabs(direct.shift_nm - nm) > 0.01 + 0.05 * fabs(nm) ||
+		    direct.correlation < 0.9 || direct.correlation > 1.0 + 1e-9) {
+			printf("shift %f: direct %f (%f nm, %f), fft %f, band %f\n", shifts[s],
+			       direct.shift, direct.shift_nm, direct.correlation, fft.shift,
+			       band.shift);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	ocean_drift_free(drift);
+	return ret;
+}
+
+static int test_invalid(struct ocean_spectra *spec)
+{
+	struct ocean_drift_result result;
+	struct ocean_drift *drift = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	double *data = ocean_spectra_get_data(spec);
+	double lower = 100.0, upper = 200.0;
+	int ret;
+
+	if (ocean_drift_create(&drift, spec, 0) != -EINVAL ||
+	    ocean_drift_create(&drift, spec, len) != -EINVAL)
+		return -EINVAL;
+
+	lines(data, len, 0.0);
+	ret = ocean_drift_create(&drift, spec, 8);
+	if (ret < 0)
+		return ret;
+
+	/* no pixel within the band, and a flat frame */
+	if (ocean_drift_set_bands(drift, &lower, &upper, 1) != -ERANGE)
+		ret = -EINVAL;
+	ocean_drift_set_bands(drift, NULL, NULL, 0);
+	memset(data, 0, len * sizeof(double));
+	if (ocean_drift_update(drift, spec, &result) != -ERANGE)
+		ret = -EINVAL;
+
+	ocean_drift_free(drift);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_shifts(spec);
+	if (ret == 0)
+		ret = test_invalid(spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
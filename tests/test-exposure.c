@@ -0,0 +1,234 @@
+#include "libocean.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define NUM_OF_PIXELS 512
+#define SATURATION 65535.0
+#define DARK 1500.0
+
+static unsigned seed = 1;
+
+static double noise(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 16) % 200) - 100.0;
+}
+
+/**
+ * A detector counting linearly with the integration time on top of the
+ * dark offset, clipped at the saturation level. @light is the count rate
+ * of the brightest pixel per ms.
+ */
+static void expose(double *data, double light, uint32_t time)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_PIXELS; i++) {
+		const double line = exp(-0.5 * pow((i - 300) / 40.0, 2));
+		const double value = DARK + light * time * (0.1 + 0.9 * line) + noise();
+
+		data[i] = value > SATURATION ? SATURATION : value;
+	}
+
+	/* hot pixels, the percentile has to ignore them */
+	data[17] = SATURATION;
+	data[400] = SATURATION;
+}
+
+static double level(const double *data)
+{
+	double sorted[NUM_OF_PIXELS], tmp;
+	int i, j;
+
+	memcpy(sorted, data, sizeof(sorted));
+	for (i = 1; i < NUM_OF_PIXELS; i++)
+		for (j = i; j > 0 && sorted[j - 1] > sorted[j]; j--) {
+			tmp = sorted[j];
+			sorted[j] = sorted[j - 1];
+			sorted[j - 1] = tmp;
+		}
+
+	return sorted[(int)(0.98 * NUM_OF_PIXELS)];
+}
+
+/**
+ * Returns the number of frames until the level stays within the tolerance
+ */
+static int converge(struct ocean_exposure *exp, double light, uint32_t *time)
+{
+	double data[NUM_OF_PIXELS];
+	int frame;
+
+	for (frame = 1; frame <= 10; frame++) {
+		uint32_t next;
+
+		expose(data, light, *time);
+		next = ocean_exposure_next(exp, data, NUM_OF_PIXELS, SATURATION, *time);
+		if (next == *time)
+			return frame;
+		*time = next;
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int test_converge(struct ocean_exposure *exp)
+{
+	static const struct {
+		double light;
+		uint32_t time;
+		int frames;
+	} cases[] = {
+		/* too dark, too bright, saturated, far too dark */
+		{ 50.0, 10, 3 },
+		{ 50.0, 900, 3 },
+		{ 500.0, 2000, 5 },
+		{ 20.0, 5, 4 },
+	};
+	double data[NUM_OF_PIXELS];
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		uint32_t time = cases[i].time;
+		double l;
+
+		ocean_exposure_reset(exp);
+		ret = converge(exp, cases[i].light, &time);
+
+		expose(data, cases[i].light, time);
+		l = level(data);
+		printf("light %6.1f: %4u ms after %d frames, level %.0f\n",
+			cases[i].light, time, ret, l);
+
+		/* settling takes one more frame to see it is in range */
+		if (ret < 0 || ret > cases[i].frames + 1 ||
+		    fabs(l - 0.75 * SATURATION) > 0.06 * 0.75 * SATURATION)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_hysteresis(struct ocean_exposure *exp)
+{
+	double data[NUM_OF_PIXELS];
+	uint32_t time = 10;
+
+	ocean_exposure_reset(exp);
+	if (converge(exp, 50.0, &time) < 0)
+		return -EINVAL;
+
+	/* the lamp drifts a little, that is no reason to change */
+	expose(data, 50.0 * 1.03, time);
+	if (ocean_exposure_next(exp, data, NUM_OF_PIXELS, SATURATION, time) != time) {
+		printf("changed within the hysteresis\n");
+		return -EINVAL;
+	}
+
+	expose(data, 50.0 * 1.2, time);
+	if (ocean_exposure_next(exp, data, NUM_OF_PIXELS, SATURATION, time) >= time) {
+		printf("did not react to brighter light\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int test_limits(struct ocean_exposure *exp)
+{
+	uint32_t time = 100;
+
+	ocean_exposure_set_limits(exp, 5, 500);
+
+	ocean_exposure_reset(exp);
+	converge(exp, 0.01, &time);
+	if (time != 500) {
+		printf("dark: %u ms\n", time);
+		return -EINVAL;
+	}
+
+	ocean_exposure_reset(exp);
+	converge(exp, 100000.0, &time);
+	if (time != 5) {
+		printf("bright: %u ms\n", time);
+		return -EINVAL;
+	}
+
+	if (ocean_exposure_set_limits(exp, 10, 5) != -EINVAL ||
+	    ocean_exposure_set_target(exp, 1.5) != -EINVAL)
+		return -EINVAL;
+
+	return ocean_exposure_set_limits(exp, 1, 10000);
+}
+
+/**
+ * Hooked into ocean_request_spectra(), each frame tells the integration
+ * time it was taken with
+ */
+static int test_auto_exposure(struct ocean_exposure *exp)
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	uint32_t time, used;
+	int ret;
+
+	if (ocean_create(&ctx) < 0 || ocean_open(ctx, 0x2457, 0x1026) < 0 ||
+	    ocean_spectra_create(&spec, ctx) < 0) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	/* well below the dummy spectra, so it has to change */
+	ocean_exposure_reset(exp);
+	ocean_exposure_set_target(exp, 0.2);
+	ocean_set_integration_time(ctx, 100);
+	ocean_set_auto_exposure(ctx, exp);
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+	used = ocean_spectra_get_integration_time(spec);
+	ocean_get_integration_time(ctx, &time);
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+
+	if (used != 100 || time == 100 || ocean_spectra_get_integration_time(spec) != time) {
+		printf("frames taken with %u and %u ms, set %u ms\n", used,
+			ocean_spectra_get_integration_time(spec), time);
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_set_auto_exposure(ctx, NULL);
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_exposure *exp = NULL;
+	int ret;
+
+	ret = ocean_exposure_create(&exp);
+	if (ret < 0) {
+		printf("ocean_exposure_create: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_converge(exp);
+	if (ret == 0)
+		ret = test_hysteresis(exp);
+	if (ret == 0)
+		ret = test_limits(exp);
+	if (ret == 0)
+		ret = test_auto_exposure(exp);
+
+	ocean_exposure_free(exp);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define POOL_SIZE 8
+#define NUM_FRAMES 50
+
+/**
+ * A shared frame can not be written to, the last release hands it back
+ */
+static int test_refs(struct ocean *ctx, struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra *spec, *plain = NULL;
+	int ret;
+
+	ret = ocean_spectra_acquire(pool, &spec);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_spectra_ref(spec);
+	if (ret == 0 && ocean_request_spectra(ctx, spec) != -EBUSY)
+		ret = -EINVAL;
+	ocean_spectra_release(spec);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	ocean_spectra_release(spec);
+	/* once too often */
+	ocean_spectra_release(spec);
+	if (ret < 0)
+		return ret;
+
+	if (ocean_spectra_pool_get_available(pool) != POOL_SIZE) {
+		printf("available %u\n", ocean_spectra_pool_get_available(pool));
+		return -EINVAL;
+	}
+
+	ret = ocean_spectra_create(&plain, ctx);
+	if (ret < 0)
+		return ret;
+	if (ocean_spectra_ref(plain) != -EINVAL)
+		ret = -EINVAL;
+	ocean_spectra_free(plain);
+	return ret;
+}
+
+/**
+ * Every consumer sees the same frames, as far as its policy lets it
+ */
+static int test_policies(struct ocean *ctx, struct ocean_spectra_pool *pool)
+{
+	static const uint64_t expected[3][5] = {
+		{ 0, 1 },
+		{ 3, 4 },
+		{ 0, 1, 2, 3, 4 },
+	};
+	static const unsigned depth[3] = { 2, 2, 8 };
+	static const enum ocean_backpressure policy[3] = {
+		OCEAN_DROP_NEWEST, OCEAN_DROP_OLDEST, OCEAN_BLOCK
+	};
+	struct ocean_consumer *consumer[3] = { NULL };
+	struct ocean_spectra *frames[3][5];
+	struct ocean_fanout *fo = NULL;
+	unsigned c, f, n[3] = { 0 };
+	int ret;
+
+	ret = ocean_fanout_create(&fo);
+	for (c = 0; c < 3 && ret == 0; c++)
+		ret = ocean_fanout_subscribe(fo, &consumer[c], depth[c], policy[c]);
+	if (ret < 0)
+		goto out;
+
+	ocean_open(ctx, 0x2457, 0x1026);
+	for (f = 0; f < 5 && ret == 0; f++)
+		ret = ocean_fanout_request(fo, ctx, pool);
+	if (ret < 0)
+		goto out;
+
+	/* the frames queued for the block consumer, nothing else */
+	if (ocean_spectra_pool_get_available(pool) != POOL_SIZE - 5) {
+		printf("available %u\n", ocean_spectra_pool_get_available(pool));
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (c = 0; c < 3; c++)
+		while (n[c] < 5 && ocean_consumer_next(consumer[c], &frames[c][n[c]], 0) == 0)
+			n[c]++;
+
+	for (c = 0; c < 3; c++) {
+		if (n[c] != (c < 2 ? 2 : 5) || ocean_consumer_get_dropped(consumer[c]) != 5 - n[c]) {
+			printf("consumer %u: %u frames, %llu dropped\n", c, n[c],
+			       (unsigned long long)ocean_consumer_get_dropped(consumer[c]));
+			ret = -EINVAL;
+		}
+
+		for (f = 0; f < n[c] && ret == 0; f++) {
+			const uint64_t seq = ocean_spectra_get_sequence(frames[c][f]);
+
+			/* not a copy, the frame the block consumer got */
+			if (seq != expected[c][f] || frames[c][f] != frames[2][seq]) {
+				printf("consumer %u frame %u: sequence %llu\n", c, f,
+				       (unsigned long long)seq);
+				ret = -EINVAL;
+			}
+		}
+	}
+
+	for (c = 0; c < 3; c++)
+		for (f = 0; f < n[c]; f++)
+			ocean_spectra_release(frames[c][f]);
+
+	if (ret == 0 && ocean_spectra_pool_get_available(pool) != POOL_SIZE) {
+		printf("available %u after release\n", ocean_spectra_pool_get_available(pool));
+		ret = -EINVAL;
+	}
+
+out:
+	for (c = 0; c < 3; c++)
+		ocean_fanout_unsubscribe(fo, consumer[c]);
+	ocean_fanout_free(fo);
+	return ret;
+}
+
+struct reader {
+	struct ocean_consumer *consumer;
+	uint64_t expected;
+	int ret;
+};
+
+static void *reader(void *arg)
+{
+	const struct timespec nap = { 0, 200000 };
+	struct reader *r = arg;
+	struct ocean_spectra *spec;
+
+	while (r->expected < NUM_FRAMES) {
+		r->ret = ocean_consumer_next(r->consumer, &spec, 1000);
+		if (r->ret < 0)
+			break;
+
+		if (ocean_spectra_get_sequence(spec) != r->expected++)
+			r->ret = -EINVAL;
+		nanosleep(&nap, NULL);
+		ocean_spectra_release(spec);
+		if (r->ret < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * A slow consumer which must not lose a frame holds up the publisher, one
+ * which may does not
+ */
+static int test_block(struct ocean *ctx, struct ocean_spectra_pool *pool)
+{
+	struct ocean_consumer *display = NULL;
+	struct ocean_fanout *fo = NULL;
+	struct ocean_spectra *spec;
+	struct reader r = { 0 };
+	pthread_t thread;
+	int ret, f;
+
+	ret = ocean_fanout_create(&fo);
+	if (ret == 0)
+		ret = ocean_fanout_subscribe(fo, &r.consumer, 2, OCEAN_BLOCK);
+	if (ret == 0)
+		ret = ocean_fanout_subscribe(fo, &display, 1, OCEAN_DROP_OLDEST);
+	if (ret < 0)
+		goto out;
+
+	ocean_open(ctx, 0x2457, 0x1026);
+	pthread_create(&thread, NULL, reader, &r);
+	for (f = 0; f < NUM_FRAMES && ret == 0; f++) {
+		ret = ocean_fanout_request(fo, ctx, pool);
+		/* every frame in use, wait for the reader to hand one back */
+		if (ret == -EAGAIN) {
+			const struct timespec nap = { 0, 100000 };
+
+			nanosleep(&nap, NULL);
+			f--;
+			ret = 0;
+		}
+	}
+	pthread_join(thread, NULL);
+	if (ret == 0)
+		ret = r.ret;
+	if (ret < 0)
+		goto out;
+
+	if (r.expected != NUM_FRAMES || ocean_consumer_get_dropped(r.consumer) ||
+	    ocean_consumer_next(display, &spec, 0) < 0 ||
+	    ocean_spectra_get_sequence(spec) != NUM_FRAMES - 1 ||
+	    ocean_consumer_get_dropped(display) != NUM_FRAMES - 1) {
+		printf("read %llu, dropped %llu\n", (unsigned long long)r.expected,
+		       (unsigned long long)ocean_consumer_get_dropped(r.consumer));
+		ret = -EINVAL;
+		goto out;
+	}
+	ocean_spectra_release(spec);
+
+	if (ocean_consumer_next(r.consumer, &spec, 10) != -EAGAIN)
+		ret = -EINVAL;
+
+out:
+	ocean_fanout_unsubscribe(fo, display);
+	ocean_fanout_unsubscribe(fo, r.consumer);
+	ocean_fanout_free(fo);
+	if (ret == 0 && ocean_spectra_pool_get_available(pool) != POOL_SIZE)
+		ret = -EINVAL;
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra_pool *pool = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, NULL);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_spectra_pool_create(&pool, ctx, POOL_SIZE, 0);
+	if (ret < 0) {
+		printf("ocean_spectra_pool_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_refs(ctx, pool);
+	if (ret == 0)
+		ret = test_policies(ctx, pool);
+	if (ret == 0)
+		ret = test_block(ctx, pool);
+
+out:
+	ocean_spectra_pool_free(pool);
+	fixture_teardown(ctx, NULL);
+	return ret < 0 ? 1 : 0;
+}
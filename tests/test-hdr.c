@@ -0,0 +1,204 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+
+/**
+ * Without noise the merged rates are those of the short exposure alone,
+ * also where the long one clipped
+ */
+static int test_merge(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	static const uint32_t times[] = { 200, 10 };
+	const size_t len = ocean_spectra_get_size(spec);
+	struct ocean_spectra_stats stats;
+	struct ocean_dummy_model model;
+	struct ocean_hdr *hdr = NULL;
+	const double *merged;
+	double rate[4096];
+	uint32_t time;
+	size_t i;
+	int ret;
+
+	ocean_dummy_model_init(&model);
+	model.read_noise = 0.0;
+	model.gain = 0.0;
+	model.dark_rate = 0.0;
+
+	ret = ocean_dummy_set_model(ctx, &model);
+	if (ret == 0)
+		ret = ocean_hdr_create(&hdr, spec, times, 2);
+	if (ret == 0)
+		ret = ocean_hdr_set_offset(hdr, model.offset);
+	if (ret < 0)
+		goto out;
+
+	/* the long exposure alone clips */
+	ret = ocean_set_integration_time(ctx, 200);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret == 0)
+		ret = ocean_spectra_get_stats(spec, &stats);
+	if (ret == 0)
+		ret = ocean_set_integration_time(ctx, 10);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+	if (!stats.saturated) {
+		printf("nothing saturated at 200 ms\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < len; i++)
+		rate[i] = (ocean_spectra_get_data(spec)[i] - model.offset) / 10;
+
+	ret = ocean_set_integration_time(ctx, 100);
+	if (ret == 0)
+		ret = ocean_hdr_request(hdr, ctx, spec);
+	if (ret == 0)
+		ret = ocean_get_integration_time(ctx, &time);
+	if (ret < 0)
+		goto out;
+
+	merged = ocean_hdr_get_data(hdr);
+	for (i = 0; i < len; i++) {
+		/* both rounded to counts */
+		if (fabs(merged[i] - rate[i]) > 0.1) {
+			printf("pixel %zu: %f counts/ms, expected %f\n", i, merged[i], rate[i]);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	if (ocean_hdr_get_saturated(hdr) || time != 100) {
+		printf("%zu saturated, integration time %u afterwards\n",
+		       ocean_hdr_get_saturated(hdr), time);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* everything clipped, the short exposure is all there is */
+	ret = ocean_hdr_set_limit(hdr, 1e-6);
+	if (ret == 0)
+		ret = ocean_hdr_request(hdr, ctx, spec);
+	if (ret < 0)
+		goto out;
+	if (ocean_hdr_get_saturated(hdr) != len ||
+	    fabs(ocean_hdr_get_data(hdr)[len / 2] - rate[len / 2]) > 0.1) {
+		printf("%zu saturated\n", ocean_hdr_get_saturated(hdr));
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_hdr_free(hdr);
+	ocean_dummy_set_model(ctx, NULL);
+	return ret;
+}
+
+/**
+ * The merge against a plain loop over the exposures, on an odd number of
+ * pixels so the last one is past the vectors
+ */
+static int test_reference(struct ocean *ctx)
+{
+	static const uint32_t times[] = { 5, 40, 20 };
+	static const uint32_t sorted[] = { 5, 20, 40 };
+	struct ocean_spectra *spec = NULL;
+	struct ocean_hdr *hdr = NULL;
+	double frames[3 * 514], merged[514];
+	double sum, weight, expected;
+	size_t len, i, k, saturated = 0;
+	int ret;
+
+	/* the last pixel is not handed out, 513 are left */
+	ret = ocean_dummy_set_num_of_pixels(ctx, 514);
+	if (ret == 0)
+		ret = ocean_spectra_create(&spec, ctx);
+	if (ret == 0)
+		ret = ocean_hdr_create(&hdr, spec, times, 3);
+	if (ret == 0)
+		ret = ocean_hdr_set_offset(hdr, 100.0);
+	if (ret < 0)
+		goto out;
+
+	len = ocean_spectra_get_size(spec);
+	/* brighter towards the end, the last pixels clip everywhere */
+	for (k = 0; k < 3; k++)
+		for (i = 0; i < len; i++)
+			frames[k * len + i] = 100.0 + sorted[k] * i * 1.5;
+
+	ret = ocean_hdr_merge(hdr, frames, 4000.0, merged);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < len; i++) {
+		sum = 0.0;
+		weight = 0.0;
+		for (k = 0; k < 3; k++) {
+			if (frames[k * len + i] >= 0.95 * 4000.0)
+				continue;
+			sum += frames[k * len + i] - 100.0;
+			weight += sorted[k];
+		}
+		if (weight == 0.0)
+			saturated++;
+		expected = weight > 0.0 ? sum / weight : (frames[i] - 100.0) / sorted[0];
+
+		if (fabs(merged[i] - expected) > 1e-9) {
+			printf("pixel %zu: %f, expected %f\n", i, merged[i], expected);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	if ((size_t)ret != saturated || !saturated) {
+		printf("%d saturated, expected %zu\n", ret, saturated);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = 0;
+out:
+	ocean_hdr_free(hdr);
+	ocean_spectra_free(spec);
+	return ret;
+}
+
+static int test_invalid(struct ocean_spectra *spec)
+{
+	static const uint32_t times[] = { 10, 20, 0 };
+	struct ocean_hdr *hdr = NULL;
+
+	if (ocean_hdr_create(&hdr, spec, times, 1) != -EINVAL ||
+	    ocean_hdr_create(&hdr, spec, times, 3) != -EINVAL ||
+	    ocean_hdr_create(&hdr, spec, times, 9) != -EINVAL ||
+	    ocean_hdr_set_limit(NULL, 0.5) != -EINVAL)
+		return -EINVAL;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_merge(ctx, spec);
+	if (ret == 0)
+		ret = test_invalid(spec);
+	if (ret == 0)
+		ret = test_reference(ctx);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <string.h>
+
+static int check(struct ocean *ctx, const struct ocean_integrity_stats *expected)
+{
+	struct ocean_integrity_stats stats;
+	int ret;
+
+	ret = ocean_get_integrity_stats(ctx, &stats);
+	if (ret < 0)
+		return ret;
+
+	if (memcmp(&stats, expected, sizeof(stats))) {
+		printf("frames %llu, short %llu, bad sync %llu, resyncs %llu, dropped %llu\n",
+		       (unsigned long long)stats.frames, (unsigned long long)stats.short_frames,
+		       (unsigned long long)stats.bad_sync, (unsigned long long)stats.resyncs,
+		       (unsigned long long)stats.dropped);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * A corrupt frame is dropped and requested again, a request which only
+ * gets corrupt ones fails and the next one works again
+ */
+static int test_drop(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_integrity_stats expected = { 0 };
+	int ret;
+
+	ret = ocean_request_spectra(ctx, spec);
+	expected.frames = 1;
+	if (ret == 0)
+		ret = check(ctx, &expected);
+	if (ret < 0)
+		return ret;
+
+	ret = ocean_dummy_inject_fault(ctx, OCEAN_DUMMY_BAD_SYNC, 1);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	expected.frames += 2;
+	expected.bad_sync++;
+	expected.resyncs++;
+	expected.dropped++;
+	if (ret == 0)
+		ret = check(ctx, &expected);
+	if (ret < 0)
+		return ret;
+
+	if (ocean_spectra_get_flags(spec) & OCEAN_FRAME_CORRUPT)
+		return -EINVAL;
+
+	ret = ocean_dummy_inject_fault(ctx, OCEAN_DUMMY_SHORT_FRAME, 3);
+	if (ret == 0 && ocean_request_spectra(ctx, spec) != -EBADMSG)
+		ret = -EINVAL;
+	expected.frames += 3;
+	expected.short_frames += 3;
+	expected.resyncs += 3;
+	expected.dropped += 3;
+	if (ret == 0)
+		ret = check(ctx, &expected);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	expected.frames++;
+	if (ret == 0)
+		ret = check(ctx, &expected);
+
+	return ret;
+}
+
+/**
+ * Flagged, a corrupt frame is handed out as it is
+ */
+static int test_flag(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	int ret;
+
+	if (ocean_set_corrupt_policy(ctx, 2) != -EINVAL)
+		return -EINVAL;
+
+	ret = ocean_set_corrupt_policy(ctx, OCEAN_CORRUPT_FLAG);
+	if (ret == 0)
+		ret = ocean_dummy_inject_fault(ctx, OCEAN_DUMMY_BAD_SYNC, 1);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+	if (!(ocean_spectra_get_flags(spec) & OCEAN_FRAME_CORRUPT)) {
+		printf("corrupt frame not flagged\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret == 0 && (ocean_spectra_get_flags(spec) & OCEAN_FRAME_CORRUPT)) {
+		printf("intact frame flagged\n");
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_set_corrupt_policy(ctx, OCEAN_CORRUPT_DROP);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, NULL);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_dummy_set_num_of_pixels(ctx, 1500);
+	if (ret == 0)
+		ret = ocean_spectra_create(&spec, ctx);
+	if (ret < 0) {
+		printf("1500 pixels: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_drop(ctx, spec);
+	if (ret == 0)
+		ret = test_flag(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define INTERVAL 5
+#define NUM_FRAMES 200
+
+static struct ocean_monitor *mon;
+static volatile int done;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Reads as fast as it can, the values may only ever move forward
+ */
+static void *reader(void *arg)
+{
+	struct ocean_housekeeping hk, last;
+	long bad = 0;
+
+	memset(&last, 0, sizeof(last));
+	while (!done) {
+		if (ocean_monitor_get(mon, &hk) < 0)
+			continue;
+
+		if (hk.updates < last.updates || hk.timestamp < last.timestamp ||
+		    (hk.updates == last.updates && memcmp(&hk, &last, sizeof(hk))))
+			bad++;
+		last = hk;
+	}
+
+	return (void *)bad;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_housekeeping hk;
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	pthread_t thread;
+	void *bad = NULL;
+	uint64_t start;
+	int ret, i;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_set_integration_time(ctx, 42);
+	if (ret == 0)
+		ret = ocean_monitor_create(&mon, ctx, INTERVAL);
+	if (ret < 0) {
+		printf("monitor: %d\n", ret);
+		goto out;
+	}
+
+	pthread_create(&thread, NULL, reader, NULL);
+
+	/* frames and housekeeping side by side */
+	start = now_ms();
+	for (i = 0; i < NUM_FRAMES && ret == 0; i++)
+		ret = ocean_request_spectra(ctx, spec);
+	while (ret == 0 && now_ms() - start < 20 * INTERVAL)
+		;
+
+	done = 1;
+	pthread_join(thread, &bad);
+
+	if (ret < 0 || ocean_monitor_get(mon, &hk) < 0 || (long)bad) {
+		printf("request %d, %ld inconsistent reads\n", ret, (long)bad);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	printf("%llu polls, pcb %.1f, sink %.1f, %u ms\n",
+		(unsigned long long)hk.updates, hk.pcb, hk.sink, hk.integration_time);
+	if (hk.updates < 5 || hk.integration_time != 42) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* stopping does not wait for the next poll */
+	ocean_monitor_free(mon);
+	ret = ocean_monitor_create(&mon, ctx, 60000);
+	if (ret == 0) {
+		start = now_ms();
+		ocean_monitor_free(mon);
+		if (now_ms() - start > 1000) {
+			printf("stopping took %llu ms\n",
+				(unsigned long long)(now_ms() - start));
+			ret = -EINVAL;
+		}
+	}
+	mon = NULL;
+
+out:
+	ocean_monitor_free(mon);
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,316 @@
+#include "libocean.h"
+#include "oceand.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OCEAND "../daemon/oceand-dummy"
+#define BATCH 16
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *ptr = buf;
+
+	while (len) {
+		ssize_t ret = read(fd, ptr, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret < 0 ? -errno : -ECONNRESET;
+		ptr += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int send_command(int fd, uint16_t type, const void *payload, size_t len)
+{
+	struct oceand_header hdr = {
+		.type = type,
+		.length = len,
+	};
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    (len && write(fd, payload, len) != (ssize_t)len))
+		return -EIO;
+	return 0;
+}
+
+/* Returns the payload of the next message, free() it */
+static int recv_message(int fd, struct oceand_header *hdr, uint8_t **payload)
+{
+	int ret;
+
+	ret = read_full(fd, hdr, sizeof(*hdr));
+	if (ret < 0)
+		return ret;
+
+	*payload = malloc(hdr->length + 1);
+	if (!*payload)
+		return -ENOMEM;
+
+	ret = read_full(fd, *payload, hdr->length);
+	if (ret < 0) {
+		free(*payload);
+		*payload = NULL;
+	}
+	return ret;
+}
+
+/**
+ * Send a command and wait for its reply, skipping frames. Returns the
+ * result of the command and copies up to @len bytes of the reply.
+ */
+static int command(int fd, uint16_t type, const void *arg, size_t arg_len,
+		   void *buf, size_t len)
+{
+	const struct oceand_reply *reply;
+	struct oceand_header hdr;
+	uint8_t *payload;
+	int ret;
+
+	ret = send_command(fd, type, arg, arg_len);
+	if (ret < 0)
+		return ret;
+
+	for (;;) {
+		ret = recv_message(fd, &hdr, &payload);
+		if (ret < 0)
+			return ret;
+		if (hdr.type == (type | OCEAND_REPLY))
+			break;
+		free(payload);
+		if (hdr.type != OCEAND_FRAMES)
+			return -EBADMSG;
+	}
+
+	reply = (const struct oceand_reply *)payload;
+	ret = hdr.length < sizeof(*reply) ? -EBADMSG : reply->result;
+	if (ret == 0 && buf) {
+		if (hdr.length - sizeof(*reply) < len)
+			ret = -EBADMSG;
+		else
+			memcpy(buf, reply + 1, len);
+	}
+
+	free(payload);
+	return ret;
+}
+
+static int connect_to(const char *path)
+{
+	const struct timespec wait = { .tv_nsec = 10000000 };
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	int fd, i;
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	/* give the daemon some time to come up */
+	for (i = 0; i < 500; i++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -errno;
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			return fd;
+		close(fd);
+		nanosleep(&wait, NULL);
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int test_control(int fd, struct ocean_spectra *spec)
+{
+	struct oceand_status status;
+	struct oceand_info info;
+	uint32_t arg = 20;
+	double *wavelength;
+	int ret, i;
+
+	ret = command(fd, OCEAND_HELLO, NULL, 0, &info, sizeof(info));
+	if (ret < 0 || info.version != OCEAND_VERSION ||
+	    info.num_of_pixels != ocean_spectra_get_size(spec) ||
+	    strcmp(info.serial, "NQ51DUMMY")) {
+		printf("OCEAND_HELLO: %d\n", ret);
+		return -EINVAL;
+	}
+
+	ret = command(fd, OCEAND_SET_INTEGRATION_TIME, &arg, sizeof(arg), NULL, 0);
+	if (ret < 0) {
+		printf("OCEAND_SET_INTEGRATION_TIME: %d\n", ret);
+		return ret;
+	}
+
+	ret = command(fd, OCEAND_GET_STATUS, NULL, 0, &status, sizeof(status));
+	if (ret < 0 || status.integration_time != 20 || status.frames == 0) {
+		printf("OCEAND_GET_STATUS: %d, %u ms, %llu frames\n", ret,
+			status.integration_time, (unsigned long long)status.frames);
+		return -EINVAL;
+	}
+
+	ret = command(fd, OCEAND_SET_INTEGRATION_TIME, NULL, 0, NULL, 0);
+	if (ret != -EINVAL) {
+		printf("command without argument: %d\n", ret);
+		return -EINVAL;
+	}
+
+	ret = command(fd, 0x77, NULL, 0, NULL, 0);
+	if (ret != -ENOSYS) {
+		printf("unknown command: %d\n", ret);
+		return -EINVAL;
+	}
+
+	wavelength = malloc(info.num_of_pixels * sizeof(double));
+	if (!wavelength)
+		return -ENOMEM;
+
+	ret = command(fd, OCEAND_GET_WAVELENGTHS, NULL, 0, wavelength,
+		      info.num_of_pixels * sizeof(double));
+	for (i = 0; ret == 0 && i < (int)info.num_of_pixels; i++) {
+		if (wavelength[i] != ocean_spectra_get_wavelength(spec, i)) {
+			printf("wavelength %d: %f\n", i, wavelength[i]);
+			ret = -EINVAL;
+		}
+	}
+	free(wavelength);
+
+	if (ret < 0)
+		printf("OCEAND_GET_WAVELENGTHS: %d\n", ret);
+	return ret;
+}
+
+static int test_frames(int fd, struct ocean_spectra *spec)
+{
+	const struct oceand_frames *frames;
+	const struct oceand_frame *frame;
+	uint64_t next = 0, dropped = 0;
+	struct oceand_header hdr;
+	uint32_t arg = BATCH;
+	uint8_t *payload;
+	int ret, m, i;
+
+	ret = command(fd, OCEAND_SUBSCRIBE, &arg, sizeof(arg), NULL, 0);
+	if (ret < 0) {
+		printf("OCEAND_SUBSCRIBE: %d\n", ret);
+		return ret;
+	}
+
+	for (m = 0; m < 8; m++) {
+		ret = recv_message(fd, &hdr, &payload);
+		if (ret < 0)
+			return ret;
+
+		frames = (const struct oceand_frames *)payload;
+		if (hdr.type != OCEAND_FRAMES || frames->count != BATCH ||
+		    frames->num_of_pixels != ocean_spectra_get_size(spec) ||
+		    hdr.length != sizeof(*frames) + BATCH * (sizeof(*frame) +
+					frames->num_of_pixels * sizeof(double))) {
+			printf("message %d: type 0x%x, %u bytes\n", m, hdr.type, hdr.length);
+			free(payload);
+			return -EINVAL;
+		}
+
+		/* frames are either delivered or accounted for */
+		frame = (const struct oceand_frame *)(frames + 1);
+		if (m && frame->sequence != next + frames->dropped - dropped) {
+			printf("message %d: sequence %llu, expected %llu\n", m,
+				(unsigned long long)frame->sequence,
+				(unsigned long long)(next + frames->dropped - dropped));
+			ret = -EINVAL;
+		}
+
+		for (i = 0; ret == 0 && i < BATCH; i++) {
+			const double *data = (const double *)(frame + 1);
+
+			if ((i && frame->sequence != next) || frame->integration_time != 20) {
+				printf("message %d, frame %d: sequence %llu\n", m, i,
+					(unsigned long long)frame->sequence);
+				ret = -EINVAL;
+			}
+			next = frame->sequence + 1;
+			frame = (const struct oceand_frame *)(data + frames->num_of_pixels);
+		}
+		dropped = frames->dropped;
+
+		free(payload);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = command(fd, OCEAND_UNSUBSCRIBE, NULL, 0, NULL, 0);
+	if (ret < 0) {
+		printf("OCEAND_UNSUBSCRIBE: %d\n", ret);
+		return ret;
+	}
+
+	printf("received %d frames, %llu dropped\n", m * BATCH,
+		(unsigned long long)dropped);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	char path[64];
+	int fd = -1, status, ret;
+	pid_t pid;
+
+	snprintf(path, sizeof(path), "oceand-test-%d.sock", (int)getpid());
+
+	/* to compare against */
+	if (ocean_create(&ctx) < 0 || ocean_open(ctx, 0x2457, 0x1026) < 0 ||
+	    ocean_spectra_create(&spec, ctx) < 0) {
+		printf("no dummy device\n");
+		ret = -ENODEV;
+		goto out;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		execl(OCEAND, OCEAND, "-s", path, NULL);
+		printf("exec %s: %s\n", OCEAND, strerror(errno));
+		_exit(127);
+	}
+	if (pid < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	fd = connect_to(path);
+	if (fd < 0) {
+		printf("connect %s: %d\n", path, fd);
+		ret = fd;
+	}
+
+	if (fd >= 0)
+		ret = test_control(fd, spec);
+	if (fd >= 0 && ret == 0)
+		ret = test_frames(fd, spec);
+
+	kill(pid, SIGTERM);
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		printf("oceand did not exit cleanly\n");
+		ret = -EINVAL;
+	} else if (access(path, F_OK) == 0) {
+		printf("oceand left %s behind\n", path);
+		ret = -EINVAL;
+	}
+
+out:
+	if (fd >= 0)
+		close(fd);
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	return ret < 0 ? 1 : 0;
+}
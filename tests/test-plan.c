@@ -0,0 +1,230 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+#include "fixture.h"
+
+#include <errno.h>
+
+#define REPEAT 3
+
+/**
+ * Dark and light frames interleaved, every frame tagged with its step and
+ * taken at its settings
+ */
+static int test_run(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	static const struct ocean_plan_step steps[] = {
+		{ .integration_time = 10, .strobe = false, .frames = 2 },
+		{ .integration_time = 20, .strobe = true, .frames = 3 },
+	};
+	static const unsigned expected[] = { 0, 0, 1, 1, 1 };
+	struct ocean_batch *batch = NULL;
+	struct ocean_plan *plan = NULL;
+	uint32_t time;
+	size_t i, n;
+	int ret;
+
+	ret = ocean_plan_create(&plan);
+	if (ret == 0)
+		ret = ocean_plan_add_step(plan, &steps[0]);
+	if (ret == 0)
+		ret = ocean_plan_add_step(plan, &steps[1]);
+	if (ret != 1)
+		goto out;
+	ret = ocean_plan_set_repeat(plan, REPEAT);
+	if (ret < 0)
+		goto out;
+
+	n = ocean_plan_get_num_of_frames(plan);
+	ret = ocean_batch_create(&batch, spec, n - 1);
+	if (ret == 0 && (n != REPEAT * 5 || ocean_plan_run(ctx, plan, spec, batch) != -ENOSPC))
+		ret = -EINVAL;
+	ocean_batch_free(batch);
+	batch = NULL;
+	if (ret == 0)
+		ret = ocean_batch_create(&batch, spec, n);
+	if (ret == 0)
+		ret = ocean_plan_run(ctx, plan, spec, batch);
+	if (ret == 0)
+		ret = ocean_get_integration_time(ctx, &time);
+	if (ret < 0)
+		goto out;
+
+	if (ocean_batch_get_size(batch) != n || time != 100) {
+		printf("%zu frames, integration time %u afterwards\n",
+		       ocean_batch_get_size(batch), time);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		const unsigned step = expected[i % 5];
+
+		if (ocean_batch_get_step(batch, i) != step ||
+		    ocean_batch_get_integration_time(batch, i) != steps[step].integration_time ||
+		    (i && ocean_batch_get_sequence(batch, i) != ocean_batch_get_sequence(batch, i - 1) + 1)) {
+			printf("frame %zu: step %u, %u ms\n", i, ocean_batch_get_step(batch, i),
+			       ocean_batch_get_integration_time(batch, i));
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+out:
+	ocean_batch_free(batch);
+	ocean_plan_free(plan);
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * Stepping down in integration time, also where the sequence wraps around:
+ * the short frames are queued behind the long ones
+ */
+static int test_descending(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	static const struct ocean_plan_step steps[] = {
+		{ .integration_time = 50, .frames = 1 },
+		{ .integration_time = 5, .frames = 2 },
+	};
+	struct ocean_batch *batch = NULL;
+	struct ocean_plan *plan = NULL;
+	size_t i, n;
+	int ret;
+
+	ret = ocean_plan_create(&plan);
+	if (ret == 0)
+		ret = ocean_plan_add_step(plan, &steps[0]);
+	if (ret == 0)
+		ret = ocean_plan_add_step(plan, &steps[1]);
+	if (ret == 1)
+		ret = ocean_plan_set_repeat(plan, 2);
+	if (ret < 0)
+		goto out;
+
+	n = ocean_plan_get_num_of_frames(plan);
+	ret = ocean_batch_create(&batch, spec, n);
+	if (ret == 0)
+		ret = ocean_dummy_set_pacing(ctx, OCEAN_DUMMY_PACED);
+	if (ret == 0)
+		ret = ocean_plan_run(ctx, plan, spec, batch);
+	if (ret < 0) {
+		printf("ocean_plan_run: %d\n", ret);
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		const unsigned step = i % 3 ? 1 : 0;
+
+		if (ocean_batch_get_step(batch, i) != step ||
+		    ocean_batch_get_integration_time(batch, i) != steps[step].integration_time) {
+			printf("frame %zu: step %u, %u ms\n", i, ocean_batch_get_step(batch, i),
+			       ocean_batch_get_integration_time(batch, i));
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+out:
+	ocean_dummy_set_pacing(ctx, OCEAN_DUMMY_UNTHROTTLED);
+	ocean_batch_free(batch);
+	ocean_plan_free(plan);
+	return ret;
+}
+
+/**
+ * The automatic exposure does not touch the settings of a plan
+ */
+static int test_exposure(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	static const struct ocean_plan_step step = { .integration_time = 10, .frames = 4 };
+	struct ocean_exposure *exp = NULL;
+	struct ocean_batch *batch = NULL;
+	struct ocean_plan *plan = NULL;
+	uint32_t time;
+	size_t i;
+	int ret;
+
+	ret = ocean_plan_create(&plan);
+	if (ret == 0)
+		ret = ocean_plan_add_step(plan, &step);
+	if (ret == 0)
+		ret = ocean_batch_create(&batch, spec, step.frames);
+	if (ret == 0)
+		ret = ocean_exposure_create(&exp);
+	if (ret == 0)
+		ret = ocean_set_auto_exposure(ctx, exp);
+	if (ret == 0)
+		ret = ocean_plan_run(ctx, plan, spec, batch);
+	if (ret == 0)
+		ret = ocean_get_integration_time(ctx, &time);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < step.frames; i++)
+		if (ocean_batch_get_integration_time(batch, i) != step.integration_time)
+			ret = -EINVAL;
+	if (ret < 0 || time != 100) {
+		printf("integration time %u afterwards\n", time);
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_set_auto_exposure(ctx, NULL);
+	ocean_exposure_free(exp);
+	ocean_batch_free(batch);
+	ocean_plan_free(plan);
+	return ret;
+}
+
+static int test_invalid(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_plan_step step = { .integration_time = 10, .frames = 0 };
+	struct ocean_batch *batch = NULL;
+	struct ocean_plan *plan = NULL;
+	int ret;
+
+	ret = ocean_plan_create(&plan);
+	if (ret == 0)
+		ret = ocean_batch_create(&batch, spec, 4);
+	if (ret < 0)
+		goto out;
+
+	if (ocean_plan_add_step(plan, &step) != -EINVAL ||
+	    ocean_plan_set_repeat(plan, 0) != -EINVAL ||
+	    ocean_plan_run(ctx, plan, spec, batch) != -EINVAL ||
+	    ocean_plan_get_num_of_frames(plan) != 0)
+		ret = -EINVAL;
+
+out:
+	ocean_batch_free(batch);
+	ocean_plan_free(plan);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_set_integration_time(ctx, 100);
+	if (ret < 0) {
+		printf("ocean_set_integration_time: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_run(ctx, spec);
+	if (ret == 0)
+		ret = test_descending(ctx, spec);
+	if (ret == 0)
+		ret = test_exposure(ctx, spec);
+	if (ret == 0)
+		ret = test_invalid(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#define POOL_SIZE 4
+#define NUM_FRAMES 100
+
+/*
+ * Counts every allocation of the process while armed, the library
+ * included. glibc keeps its own entry points around for exactly that,
+ * the tests are built with hidden visibility though.
+ */
+#define interpose __attribute__((visibility("default")))
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static int armed;
+static unsigned allocations;
+
+interpose void *malloc(size_t size)
+{
+	allocations += armed;
+	return __libc_malloc(size);
+}
+
+interpose void *calloc(size_t nmemb, size_t size)
+{
+	allocations += armed;
+	return __libc_calloc(nmemb, size);
+}
+
+interpose void *realloc(void *ptr, size_t size)
+{
+	allocations += armed;
+	return __libc_realloc(ptr, size);
+}
+
+interpose int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	allocations += armed;
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+static int test_pool(struct ocean *ctx, struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra *spec[POOL_SIZE + 1];
+	struct ocean_spectra *plain = NULL;
+	int ret, i;
+
+	for (i = 0; i < POOL_SIZE; i++) {
+		ret = ocean_spectra_acquire(pool, &spec[i]);
+		if (ret < 0 || (uintptr_t)ocean_spectra_get_data(spec[i]) % 64 ||
+		    (uintptr_t)ocean_spectra_get_raw_data(spec[i]) % 64) {
+			printf("acquire %d: %d\n", i, ret);
+			return -EINVAL;
+		}
+	}
+
+	if (ocean_spectra_acquire(pool, &spec[POOL_SIZE]) != -EAGAIN ||
+	    ocean_spectra_pool_get_available(pool) != 0)
+		return -EINVAL;
+
+	/* the calibration is the one of the device */
+	ret = ocean_spectra_create(&plain, ctx);
+	if (ret < 0)
+		return ret;
+	if (ocean_spectra_get_size(plain) != ocean_spectra_get_size(spec[0]) ||
+	    ocean_spectra_get_wavelength(plain, 100) != ocean_spectra_get_wavelength(spec[3], 100)) {
+		printf("not calibrated like the device\n");
+		ret = -EINVAL;
+	}
+	ocean_spectra_free(plain);
+
+	/* either way back into the pool */
+	for (i = 0; i < POOL_SIZE; i++)
+		if (i % 2)
+			ocean_spectra_release(spec[i]);
+		else
+			ocean_spectra_free(spec[i]);
+
+	if (ocean_spectra_pool_get_available(pool) != POOL_SIZE)
+		return -EINVAL;
+
+	return ret;
+}
+
+/**
+ * Acquisition, auto exposure and statistics from the pool, once the
+ * first frame is through nothing may allocate anymore
+ */
+static int test_steady_state(struct ocean *ctx, struct ocean_spectra_pool *pool)
+{
+	struct ocean_spectra_stats stats;
+	struct ocean_spectra *spec;
+	int ret = 0, i;
+
+	for (i = 0; i < NUM_FRAMES && ret == 0; i++) {
+		ret = ocean_spectra_acquire(pool, &spec);
+		if (ret < 0)
+			break;
+
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_spectra_get_stats(spec, &stats);
+		ocean_spectra_release(spec);
+
+		/* warmed up */
+		armed = 1;
+	}
+	armed = 0;
+
+	if (ret < 0 || allocations) {
+		printf("%d frames, %u allocations\n", i, allocations);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra_pool *pool = NULL;
+	struct ocean_exposure *exp = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, NULL);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_exposure_create(&exp);
+	if (ret < 0) {
+		printf("ocean_exposure_create: %d\n", ret);
+		goto out;
+	}
+	ocean_set_auto_exposure(ctx, exp);
+
+	ret = ocean_spectra_pool_create(&pool, ctx, POOL_SIZE, OCEAN_POOL_HUGEPAGES);
+	if (ret < 0) {
+		printf("ocean_spectra_pool_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_pool(ctx, pool);
+	if (ret == 0)
+		ret = test_steady_state(ctx, pool);
+
+out:
+	ocean_spectra_pool_free(pool);
+	ocean_set_auto_exposure(ctx, NULL);
+	ocean_exposure_free(exp);
+	fixture_teardown(ctx, NULL);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define NUM_FRAMES 200
+
+/* exit code of a skipped test */
+#define SKIP 77
+
+/**
+ * The thread ends up pinned and with SCHED_FIFO, taking frames faults in
+ * no memory and every frame is counted
+ */
+static int test_profile(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	const int priority = sched_get_priority_min(SCHED_FIFO);
+	const int cpu = sched_getcpu();
+	struct ocean_realtime_stats stats;
+	struct sched_param param;
+	int ret, policy, f;
+
+	if (ocean_get_realtime_stats(ctx, &stats) != -ENODATA ||
+	    ocean_set_realtime(ctx, -1, 1000) != -EINVAL)
+		return -EINVAL;
+
+	ret = ocean_set_realtime(ctx, cpu, priority);
+	if (ret == -EPERM || ret == -ENOMEM || ret == -ENOTSUP) {
+		printf("no real-time profile here: %s\n", strerror(-ret));
+		return SKIP;
+	}
+	if (ret < 0)
+		return ret;
+
+	if (pthread_getschedparam(pthread_self(), &policy, &param) ||
+	    policy != SCHED_FIFO || param.sched_priority != priority ||
+	    sched_getcpu() != cpu) {
+		printf("policy %d priority %d cpu %d\n", policy, param.sched_priority,
+		       sched_getcpu());
+		return -EINVAL;
+	}
+
+	for (f = 0; f < NUM_FRAMES; f++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = ocean_get_realtime_stats(ctx, &stats);
+	if (ret < 0)
+		return ret;
+
+	if (stats.frames != NUM_FRAMES || stats.latency_min > stats.latency_mean ||
+	    stats.latency_mean > stats.latency_max ||
+	    stats.minor_faults || stats.major_faults) {
+		printf("frames %llu latency %llu/%llu/%llu faults %llu/%llu\n",
+		       (unsigned long long)stats.frames,
+		       (unsigned long long)stats.latency_min,
+		       (unsigned long long)stats.latency_mean,
+		       (unsigned long long)stats.latency_max,
+		       (unsigned long long)stats.minor_faults,
+		       (unsigned long long)stats.major_faults);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_profile(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	if (ret == SKIP)
+		return SKIP;
+	return ret < 0 ? 1 : 0;
+}
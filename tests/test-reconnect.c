@@ -0,0 +1,96 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+#include "fixture.h"
+
+#include <errno.h>
+
+/**
+ * Gone the requests fail, back the device gets the settings again and the
+ * first frame says so, without a gap in the sequence
+ */
+static int test_reconnect(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	uint64_t sequence;
+	int ret;
+
+	ret = ocean_set_reconnect(ctx, true);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		return ret;
+	sequence = ocean_spectra_get_sequence(spec);
+
+	ret = ocean_dummy_set_plugged(ctx, false);
+	if (ret == 0 && ocean_request_spectra(ctx, spec) != -ENODEV) {
+		printf("request without the device\n");
+		ret = -EINVAL;
+	}
+	if (ret == 0)
+		ret = ocean_dummy_set_plugged(ctx, true);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		return ret;
+
+	if (!(ocean_spectra_get_flags(spec) & OCEAN_FRAME_RECONNECTED) ||
+	    ocean_spectra_get_sequence(spec) != sequence + 1 ||
+	    ocean_spectra_get_integration_time(spec) != 20) {
+		printf("first frame: flags 0x%x, sequence %llu, %u ms\n",
+		       ocean_spectra_get_flags(spec),
+		       (unsigned long long)ocean_spectra_get_sequence(spec),
+		       ocean_spectra_get_integration_time(spec));
+		return -EINVAL;
+	}
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret == 0 && ((ocean_spectra_get_flags(spec) & OCEAN_FRAME_RECONNECTED) ||
+			 ocean_spectra_get_sequence(spec) != sequence + 2)) {
+		printf("second frame: flags 0x%x\n", ocean_spectra_get_flags(spec));
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+/**
+ * Without reconnecting the device stays gone
+ */
+static int test_disabled(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	int ret;
+
+	ret = ocean_set_reconnect(ctx, false);
+	if (ret == 0)
+		ret = ocean_dummy_set_plugged(ctx, false);
+	if (ret == 0)
+		ret = ocean_dummy_set_plugged(ctx, true);
+	if (ret == 0 && ocean_request_spectra(ctx, spec) != -ENODEV)
+		ret = -EINVAL;
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = ocean_set_integration_time(ctx, 20);
+	if (ret < 0) {
+		printf("ocean_set_integration_time: %d\n", ret);
+		goto out;
+	}
+
+	ret = test_reconnect(ctx, spec);
+	if (ret == 0)
+		ret = test_disabled(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+#include "libocean.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+/* a cubic over the pixels, and its derivatives */
+static double cubic(double x, unsigned deriv)
+{
+	x /= 100.0;
+	switch (deriv) {
+	case 0:
+		return 3.0 + 2.0 * x - 5.0 * x * x + 0.5 * x * x * x;
+	case 1:
+		return (2.0 - 10.0 * x + 1.5 * x * x) / 100.0;
+	default:
+		return (-10.0 + 3.0 * x) / 10000.0;
+	}
+}
+
+/**
+ * The filters reproduce a polynomial up to their order exactly, also at
+ * the edges, and filtering in place gives the same
+ */
+static int test_polynomial(struct ocean_spectra *spec, unsigned window, unsigned deriv)
+{
+	struct ocean_savgol *sg = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	double *in = NULL, *out = NULL;
+	size_t i;
+	int ret;
+
+	ret = ocean_savgol_create(&sg, spec, window, 3, deriv);
+	if (ret < 0)
+		return ret;
+
+	in = malloc(len * sizeof(double));
+	out = malloc(len * sizeof(double));
+	if (!in || !out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < len; i++)
+		in[i] = cubic(i, 0);
+
+	ret = ocean_savgol_apply(sg, in, out, len);
+	if (ret == 0)
+		ret = ocean_savgol_apply_inplace(sg, in, len);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < len; i++) {
+		const double expected = cubic(i, deriv);
+
+		if (fabs(out[i] - expected) > 1e-9 || in[i] != out[i]) {
+			printf("window %u deriv %u pixel %zu: %g/%g, expected %g\n", window,
+			       deriv, i, out[i], in[i], expected);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+out:
+	free(out);
+	free(in);
+	ocean_savgol_free(sg);
+	return ret;
+}
+
+/**
+ * The textbook weights for five points and a parabola
+ */
+static int test_coefficients(struct ocean_spectra *spec)
+{
+	static const double expected[] = { -3, 12, 17, 12, -3 };
+	struct ocean_savgol *sg = NULL;
+	const double *coef;
+	size_t len, i;
+	int ret;
+
+	if (ocean_savgol_create(&sg, spec, 4, 2, 0) != -EINVAL ||
+	    ocean_savgol_create(&sg, spec, 5, 5, 0) != -EINVAL ||
+	    ocean_savgol_create(&sg, spec, 5, 2, 3) != -EINVAL)
+		return -EINVAL;
+
+	ret = ocean_savgol_create(&sg, spec, 5, 2, 0);
+	if (ret < 0)
+		return ret;
+
+	coef = ocean_savgol_get_coefficients(sg, &len);
+	if (len != 5)
+		ret = -EINVAL;
+	for (i = 0; i < len && ret == 0; i++) {
+		if (fabs(coef[i] - expected[i] / 35.0) > 1e-12) {
+			printf("weight %zu: %g\n", i, coef[i] * 35.0);
+			ret = -EINVAL;
+		}
+	}
+
+	ocean_savgol_free(sg);
+	return ret;
+}
+
+/**
+ * Behind ocean_request_spectra(), against filtering the frames of a second
+ * device without
+ */
+static int test_request(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_spectra *ref_spec = NULL;
+	struct ocean_savgol *sg = NULL;
+	struct ocean *ref = NULL;
+	const size_t len = ocean_spectra_get_size(spec);
+	struct ocean_spectra_stats stats;
+	const double *data;
+	double sum;
+	size_t i, peak;
+	int ret, f;
+
+	ret = ocean_savgol_create(&sg, spec, 11, 2, 1);
+	if (ret == 0)
+		ret = ocean_create(&ref);
+	if (ret == 0)
+		ret = ocean_open(ref, 0x2457, 0x1026);
+	if (ret == 0)
+		ret = ocean_spectra_create(&ref_spec, ref);
+	if (ret == 0)
+		ret = ocean_set_savgol(ctx, sg);
+	if (ret < 0)
+		goto out;
+
+	for (f = 0; f < 4; f++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_request_spectra(ref, ref_spec);
+		if (ret == 0)
+			ret = ocean_savgol_process(sg, ref_spec);
+		if (ret < 0)
+			goto out;
+
+		if (memcmp(ocean_spectra_get_data(spec), ocean_spectra_get_data(ref_spec),
+			   len * sizeof(double))) {
+			printf("frame %d differs\n", f);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* the stats are those of the derivative, not of the counts */
+		data = ocean_spectra_get_data(spec);
+		ocean_spectra_get_stats(spec, &stats);
+		for (i = 0, sum = 0.0, peak = 0; i < len; i++) {
+			sum += data[i];
+			if (data[i] > data[peak])
+				peak = i;
+		}
+		if (stats.max != data[peak] || stats.peak != peak ||
+		    fabs(stats.mean - sum / len) > 1e-9) {
+			printf("frame %d: stats max %f at %zu mean %f, data %f at %zu mean %f\n",
+			       f, stats.max, stats.peak, stats.mean, data[peak], peak, sum / len);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+out:
+	ocean_set_savgol(ctx, NULL);
+	ocean_spectra_free(ref_spec);
+	ocean_free(ref);
+	ocean_savgol_free(sg);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	unsigned deriv;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_coefficients(spec);
+	for (deriv = 0; deriv <= 2 && ret == 0; deriv++) {
+		ret = test_polynomial(spec, 7, deriv);
+		if (ret == 0)
+			ret = test_polynomial(spec, 31, deriv);
+	}
+	if (ret == 0)
+		ret = test_request(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}
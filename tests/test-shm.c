@@ -0,0 +1,205 @@
+#include "libocean.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_FRAMES 100
+
+/**
+ * Read every frame in a second process and compare it against the frames
+ * of an own dummy context, which hands out the same sequence.
+ */
+static int subscriber(const char *name, int ready)
+{
+	struct ocean_subscriber *sub = NULL;
+	struct ocean_spectra *spec = NULL;
+	struct ocean_shm_frame frame;
+	struct ocean *ctx = NULL;
+	int ret, i;
+
+	ret = ocean_subscriber_open(&sub, name);
+	if (ret < 0) {
+		printf("ocean_subscriber_open: %d\n", ret);
+		goto out;
+	}
+
+	if (ocean_create(&ctx) < 0 || ocean_open(ctx, 0x2457, 0x1026) < 0 ||
+	    ocean_spectra_create(&spec, ctx) < 0) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	/* tell the publisher we are listening */
+	if (write(ready, "r", 1) != 1) {
+		ret = -EIO;
+		goto out;
+	}
+
+	for (i = 0; i < NUM_FRAMES; i++) {
+		ret = ocean_subscriber_next(sub, &frame, 5000);
+		if (ret < 0) {
+			printf("ocean_subscriber_next(%d): %d\n", i, ret);
+			goto out;
+		}
+
+		ocean_request_spectra(ctx, spec);
+
+		if (frame.sequence != (uint64_t)i || frame.lost ||
+		    frame.num_of_pixels != ocean_spectra_get_size(spec) ||
+		    memcmp(frame.data, ocean_spectra_get_data(spec),
+			   frame.num_of_pixels * sizeof(double)) ||
+		    frame.wavelength[1] != ocean_spectra_get_wavelength(spec, 1) ||
+		    !ocean_subscriber_valid(sub, &frame)) {
+			printf("frame %d: sequence %llu lost %llu\n", i,
+				(unsigned long long)frame.sequence,
+				(unsigned long long)frame.lost);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ret = ocean_subscriber_next(sub, &frame, 0);
+	if (ret != -EAGAIN) {
+		printf("frame after the last one: %d\n", ret);
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = 0;
+
+out:
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	ocean_subscriber_close(sub);
+	return ret;
+}
+
+/**
+ * A subscriber which falls behind skips to the newest frames
+ */
+static int test_overrun(struct ocean *ctx, struct ocean_spectra *spec,
+			const char *name)
+{
+	struct ocean_publisher *pub = NULL;
+	struct ocean_subscriber *sub = NULL;
+	struct ocean_shm_frame frame;
+	int ret, i;
+
+	ret = ocean_publisher_create(&pub, name, spec, 4);
+	if (ret < 0) {
+		printf("ocean_publisher_create: %d\n", ret);
+		goto out;
+	}
+
+	ret = ocean_subscriber_open(&sub, name);
+	if (ret < 0) {
+		printf("ocean_subscriber_open: %d\n", ret);
+		goto out;
+	}
+
+	for (i = 0; i < 10; i++) {
+		ocean_request_spectra(ctx, spec);
+		ocean_publisher_publish(pub, spec);
+	}
+
+	ret = ocean_subscriber_next(sub, &frame, 0);
+	if (ret < 0 || frame.lost != 6 ||
+	    frame.sequence != ocean_spectra_get_sequence(spec) - 3) {
+		printf("overrun: %d lost %llu\n", ret, (unsigned long long)frame.lost);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* the frame is gone once the publisher wraps around */
+	for (i = 0; i < 4; i++) {
+		ocean_request_spectra(ctx, spec);
+		ocean_publisher_publish(pub, spec);
+	}
+
+	if (ocean_subscriber_valid(sub, &frame)) {
+		printf("overwritten frame is still valid\n");
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_subscriber_close(sub);
+	ocean_publisher_free(pub);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_publisher *pub = NULL;
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	char name[64], c;
+	int ready[2], status, ret, i;
+	pid_t pid;
+
+	snprintf(name, sizeof(name), "libocean-test-%d", (int)getpid());
+
+	ret = ocean_create(&ctx);
+	if (ret < 0) {
+		printf("ocean_create: %d\n", ret);
+		return 1;
+	}
+
+	if (ocean_open(ctx, 0x2457, 0x1026) < 0 ||
+	    ocean_spectra_create(&spec, ctx) < 0) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	ret = ocean_publisher_create(&pub, name, spec, NUM_FRAMES);
+	if (ret < 0) {
+		printf("ocean_publisher_create: %d\n", ret);
+		goto out;
+	}
+
+	if (pipe(ready) < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		close(ready[0]);
+		ret = subscriber(name, ready[1]);
+		fflush(stdout);
+		_exit(ret < 0 ? 1 : 0);
+	}
+	close(ready[1]);
+
+	if (pid < 0 || read(ready[0], &c, 1) != 1) {
+		printf("subscriber did not start\n");
+		ret = -ECHILD;
+		goto out;
+	}
+
+	ocean_set_publisher(ctx, pub);
+	for (i = 0; i < NUM_FRAMES; i++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret < 0) {
+			printf("ocean_request_spectra: %d\n", ret);
+			break;
+		}
+	}
+	ocean_set_publisher(ctx, NULL);
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		printf("subscriber failed\n");
+		ret = -EINVAL;
+		goto out;
+	}
+	printf("subscriber received %d frames\n", NUM_FRAMES);
+
+	ret = test_overrun(ctx, spec, name);
+
+out:
+	ocean_publisher_free(pub);
+	ocean_spectra_free(spec);
+	ocean_free(ctx);
+	return ret < 0 ? 1 : 0;
+}
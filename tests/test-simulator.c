@@ -0,0 +1,374 @@
+#include "libocean.h"
+#include "libocean-dummy.h"
+#include "fixture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_FRAMES 200
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The counts in the raw data, the way the NIRQuest sends them. Returns
+ * the number of pixels, 0 if the layout is off. */
+static size_t decode(struct ocean_spectra *spec, double *counts, size_t len)
+{
+	const uint8_t *raw = ocean_spectra_get_raw_data(spec);
+	const size_t raw_size = ocean_spectra_get_raw_size(spec);
+	size_t i = 0, j;
+
+	for (j = 0; j < len; j++) {
+		counts[j] = ((raw[i + 1] << 8) | raw[i]) ^ 0x8000;
+		i += 2;
+		if ((j + 1) % 512 == 0 && raw[i++] != 0x69)
+			return 0;
+	}
+	/* the frame ends with a sync byte */
+	if (len % 512 && raw[i++] != 0x69)
+		return 0;
+
+	return i == raw_size ? len : 0;
+}
+
+static int request(struct ocean *ctx, struct ocean_spectra *spec, double *counts)
+{
+	/* including the last pixel, which is not handed out */
+	const size_t len = ocean_spectra_get_size(spec) + 1;
+	int ret;
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		return ret;
+
+	return decode(spec, counts, len) == len ? 0 : -EBADMSG;
+}
+
+/**
+ * The data is what the raw bytes say, for the recording and the model, at
+ * every number of pixels
+ */
+static int test_pixels(struct ocean *ctx)
+{
+	static const uint32_t pixels[] = { 512, 1024, 1500, 4096 };
+	struct ocean_dummy_model model;
+	struct ocean_spectra *spec = NULL, *old = NULL;
+	double counts[4096];
+	size_t p, i, len;
+	int ret, f;
+
+	if (ocean_dummy_set_num_of_pixels(ctx, 511) != -ERANGE ||
+	    ocean_dummy_set_num_of_pixels(ctx, 4097) != -ERANGE)
+		return -EINVAL;
+
+	ocean_dummy_model_init(&model);
+	ret = ocean_spectra_create(&old, ctx);
+	if (ret < 0)
+		return ret;
+
+	for (p = 0; p < sizeof(pixels) / sizeof(pixels[0]); p++) {
+		ret = ocean_dummy_set_num_of_pixels(ctx, pixels[p]);
+		if (ret == 0)
+			ret = ocean_spectra_create(&spec, ctx);
+		if (ret < 0)
+			goto out;
+
+		len = ocean_spectra_get_size(spec);
+		if (len != pixels[p] - 1 ||
+		    ocean_spectra_get_raw_size(spec) != pixels[p] * 2 + (pixels[p] + 511) / 512 ||
+		    (pixels[p] != 512 && ocean_request_spectra(ctx, old) != -EINVAL) ||
+		    fabs(ocean_spectra_get_wavelength(spec, len) -
+			 ocean_spectra_get_wavelength(old, 511)) > 2.0) {
+			printf("%u pixels: size %zu/%zu\n", pixels[p], len,
+			       ocean_spectra_get_raw_size(spec));
+			ret = -EINVAL;
+			goto out;
+		}
+
+		for (f = 0; f < 4; f++) {
+			ret = ocean_dummy_set_model(ctx, f < 2 ? NULL : &model);
+			if (ret == 0)
+				ret = request(ctx, spec, counts);
+			if (ret < 0)
+				goto out;
+
+			for (i = 0; i < len; i++) {
+				if (counts[i] != ocean_spectra_get_data(spec)[i]) {
+					printf("%u pixels frame %d pixel %zu: %f, raw %f\n",
+					       pixels[p], f, i, ocean_spectra_get_data(spec)[i],
+					       counts[i]);
+					ret = -EINVAL;
+					goto out;
+				}
+			}
+		}
+
+		ocean_spectra_free(spec);
+		spec = NULL;
+	}
+
+out:
+	ocean_dummy_set_model(ctx, NULL);
+	ocean_dummy_set_num_of_pixels(ctx, 512);
+	ocean_spectra_free(spec);
+	ocean_spectra_free(old);
+	return ret;
+}
+
+/**
+ * Without noise the brightest pixel is the offset plus the rates times the
+ * integration time, with noise the variance is the read noise plus the
+ * shot noise of the signal
+ */
+static int test_model(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	static const uint32_t times[] = { 10, 20, 100 };
+	struct ocean_accumulator *acc = NULL;
+	struct ocean_dummy_model model;
+	struct ocean_spectra_stats stats;
+	const size_t len = ocean_spectra_get_size(spec);
+	const double *mean, *variance;
+	double measured = 0.0, expected = 0.0;
+	size_t t, i;
+	int ret, f;
+
+	ocean_dummy_model_init(&model);
+	model.read_noise = 0.0;
+	model.gain = 0.0;
+	ret = ocean_dummy_set_model(ctx, &model);
+	if (ret < 0)
+		return ret;
+
+	for (t = 0; t < sizeof(times) / sizeof(times[0]); t++) {
+		const double peak = model.offset + (model.signal_rate + model.dark_rate) * times[t];
+
+		ret = ocean_set_integration_time(ctx, times[t]);
+		if (ret == 0)
+			ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_spectra_get_stats(spec, &stats);
+		if (ret < 0)
+			goto out;
+
+		if (fabs(stats.max - peak) > 0.5 || stats.saturated) {
+			printf("%u ms: peak %f, expected %f\n", times[t], stats.max, peak);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ocean_dummy_model_init(&model);
+	ret = ocean_dummy_set_model(ctx, &model);
+	if (ret == 0)
+		ret = ocean_accumulator_create(&acc, spec, OCEAN_ACCUMULATE_COUNTS);
+	for (f = 0; f < NUM_FRAMES && ret == 0; f++) {
+		ret = ocean_request_spectra(ctx, spec);
+		if (ret == 0)
+			ret = ocean_accumulator_add(acc, spec);
+	}
+	if (ret < 0)
+		goto out;
+
+	mean = ocean_accumulator_get_mean(acc);
+	variance = ocean_accumulator_get_variance(acc);
+	for (i = 0; i < len; i++) {
+		measured += variance[i];
+		expected += model.read_noise * model.read_noise +
+			    (mean[i] - model.offset) / model.gain;
+	}
+
+	if (fabs(measured / expected - 1.0) > 0.05) {
+		printf("variance %f, expected %f\n", measured / len, expected / len);
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_accumulator_free(acc);
+	ocean_dummy_set_model(ctx, NULL);
+	ocean_set_integration_time(ctx, 100);
+	return ret;
+}
+
+/**
+ * Clipping at the configured level, which is full scale of the data
+ */
+static int test_saturation(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_dummy_model model;
+	struct ocean_spectra_stats stats;
+	const size_t len = ocean_spectra_get_size(spec);
+	const uint64_t *map = ocean_spectra_get_saturation_map(spec);
+	double counts[512];
+	size_t i, saturated = 0;
+	int ret;
+
+	ocean_dummy_model_init(&model);
+	model.saturation = 20000;
+	ret = ocean_dummy_set_model(ctx, &model);
+	if (ret == 0)
+		ret = request(ctx, spec, counts);
+	if (ret == 0)
+		ret = ocean_spectra_get_stats(spec, &stats);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < len; i++) {
+		const bool clipped = counts[i] >= model.saturation;
+
+		if (counts[i] > model.saturation || clipped != !!(map[i / 64] & (1ull << (i % 64)))) {
+			printf("pixel %zu: %f\n", i, counts[i]);
+			ret = -EINVAL;
+			goto out;
+		}
+		saturated += clipped;
+	}
+
+	if (!saturated || stats.saturated != saturated ||
+	    stats.max != ocean_spectra_get_saturation(spec)) {
+		printf("saturated %zu/%zu, max %f\n", stats.saturated, saturated, stats.max);
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_dummy_set_model(ctx, NULL);
+	return ret;
+}
+
+/**
+ * The same seed gives the same frames, after ocean_open() and on another
+ * device
+ */
+static int test_seed(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	struct ocean_spectra *other_spec = NULL;
+	struct ocean_dummy_model model;
+	struct ocean *other = NULL;
+	const size_t size = ocean_spectra_get_raw_size(spec);
+	uint8_t first[2048];
+	int ret;
+
+	ocean_dummy_model_init(&model);
+	ret = ocean_create(&other);
+	if (ret == 0)
+		ret = ocean_open(other, 0x2457, 0x1026);
+	if (ret == 0)
+		ret = ocean_spectra_create(&other_spec, other);
+	if (ret == 0)
+		ret = ocean_dummy_set_model(ctx, &model);
+	if (ret == 0)
+		ret = ocean_dummy_set_model(other, &model);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret == 0)
+		ret = ocean_request_spectra(other, other_spec);
+	if (ret < 0)
+		goto out;
+
+	memcpy(first, ocean_spectra_get_raw_data(spec), size);
+	if (memcmp(first, ocean_spectra_get_raw_data(other_spec), size)) {
+		printf("other device differs\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+	if (!memcmp(first, ocean_spectra_get_raw_data(spec), size)) {
+		printf("no noise\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = ocean_open(ctx, 0x2457, 0x1026);
+	if (ret == 0)
+		ret = ocean_request_spectra(ctx, spec);
+	if (ret < 0)
+		goto out;
+	if (memcmp(first, ocean_spectra_get_raw_data(spec), size)) {
+		printf("reopened device differs\n");
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_dummy_set_model(ctx, NULL);
+	ocean_spectra_free(other_spec);
+	ocean_free(other);
+	return ret;
+}
+
+/**
+ * Paced, back to back frames come at the integration time
+ */
+static int test_pacing(struct ocean *ctx, struct ocean_spectra *spec)
+{
+	double start, paced, unthrottled;
+	int ret, f;
+
+	if (ocean_dummy_set_pacing(ctx, 2) != -EINVAL)
+		return -EINVAL;
+
+	ret = ocean_set_integration_time(ctx, 5);
+	if (ret == 0)
+		ret = ocean_dummy_set_pacing(ctx, OCEAN_DUMMY_PACED);
+	if (ret < 0)
+		goto out;
+
+	start = now();
+	for (f = 0; f < 10 && ret == 0; f++)
+		ret = ocean_request_spectra(ctx, spec);
+	paced = now() - start;
+	if (ret == 0)
+		ret = ocean_dummy_set_pacing(ctx, OCEAN_DUMMY_UNTHROTTLED);
+	if (ret < 0)
+		goto out;
+
+	start = now();
+	for (f = 0; f < 10 && ret == 0; f++)
+		ret = ocean_request_spectra(ctx, spec);
+	unthrottled = now() - start;
+	if (ret < 0)
+		goto out;
+
+	if (paced < 0.05 || unthrottled > paced) {
+		printf("paced %f s, unthrottled %f s\n", paced, unthrottled);
+		ret = -EINVAL;
+	}
+
+out:
+	ocean_dummy_set_pacing(ctx, OCEAN_DUMMY_UNTHROTTLED);
+	ocean_set_integration_time(ctx, 100);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ocean_spectra *spec = NULL;
+	struct ocean *ctx = NULL;
+	int ret;
+
+	ret = fixture_setup(&ctx, &spec);
+	if (ret < 0)
+		goto out;
+
+	ret = test_pixels(ctx);
+	if (ret == 0)
+		ret = test_model(ctx, spec);
+	if (ret == 0)
+		ret = test_saturation(ctx, spec);
+	if (ret == 0)
+		ret = test_seed(ctx, spec);
+	if (ret == 0)
+		ret = test_pacing(ctx, spec);
+
+out:
+	fixture_teardown(ctx, spec);
+	return ret < 0 ? 1 : 0;
+}